@@ -1,6 +1,7 @@
 
-#include <stdio.h>
+#include <avr/pgmspace.h>
 #include "LCDHandler.h"
+#include "compact_format.h"
 #include "i2cMultiMaster.h"
 #include "usart_serial.h"
 #include "temperatureHandler.h"
@@ -12,6 +13,23 @@
 
 int LCD_USART;
 
+/**
+ *  Command sequence that clears the LCD screen.
+ */
+static const char lcdClear[] PROGMEM = {0xFE, 0x01};
+
+/**
+ *  Size of the buffer holding the text written to the LCD (two lines of 16
+ *  characters plus room for the terminator).
+ */
+#define LCD_TEXT_SIZE 40
+
+/**
+ *  Fraction bits of the Q-format values written to the LCD (Q15.16, which
+ *  rounds to two decimals like %2.2f).
+ */
+#define LCD_FRACTION_BITS 16
+
 /**
  * Initialise the LCD screen
  * Set Baud rate to the default (9600bps)
@@ -24,7 +42,7 @@ void setupLCD()
 //                                          portSERIAL_BUFFER_TX,
 //                                          portSERIAL_BUFFER_RX);
 
-	LCD_USART = usartOpen(USART_1, 9600, portSERIAL_BUFFER_TX, portSERIAL_BUFFER_RX);
+	LCD_USART = usartOpen(USART_1, 9600);
 }
 
 /**
@@ -44,20 +62,36 @@ void writeToLCD(float speed,
                 int leftTemperature,
                 int rightTemperature)
 {
-	usart_fprintf_P(LCD_USART, PSTR("%c"), 0xFE);
-	usart_fprintf_P(LCD_USART, PSTR("%c"), 0x01);
+	char text[LCD_TEXT_SIZE];
+	FORMAT_BUFFER line;
 
+	// "S: %2.2f D: %2.2f A:%2d L:%2d R:%2d", without the float printf library
+	format_initialize(&line, text, sizeof(text));
+	FORMAT_APPEND_LITERAL(&line, "S: ");
+	format_append_fixed(&line, (int32_t)(speed * (1L << LCD_FRACTION_BITS)), LCD_FRACTION_BITS, 2, 2);
+	FORMAT_APPEND_LITERAL(&line, " D: ");
+	format_append_fixed(&line, (int32_t)(distanceTravelled * (1L << LCD_FRACTION_BITS)), LCD_FRACTION_BITS, 2, 2);
+	FORMAT_APPEND_LITERAL(&line, " A:");
+	format_append_decimal(&line, ambientTemperature, 2);
+	FORMAT_APPEND_LITERAL(&line, " L:");
+	format_append_decimal(&line, leftTemperature, 2);
+	FORMAT_APPEND_LITERAL(&line, " R:");
+	format_append_decimal(&line, rightTemperature, 2);
 
-	//usart_fprintf_P(LCD_USART, PSTR("Testing"));
-	usart_fprintf_P(LCD_USART, PSTR("S: %2.2f D: %2.2f "), speed, distanceTravelled);
-	usart_fprintf_P(LCD_USART, PSTR("A:%2d L:%2d R:%2d"), ambientTemperature, leftTemperature, rightTemperature);
+	// Clear the screen and write the text as a single message
+	USART_IOV message[] = {
+		{lcdClear, sizeof(lcdClear), USART_IOV_PGM},
+		{text, line.length, USART_IOV_RAM}
+	};
+	usart_xwritev(LCD_USART, message, 2);
 
 //	usart_xflushRx(LCD_USART);
 //    xSerialFlush(&xSerial1Port); // Flush commands to LCD
 }
 
 /**
- * Shuts down the LCD screen and frees the allocated memory.
+ * Shuts down the LCD screen. Its buffers are static (see USART_BUFFER_TABLE),
+ * so the LCD can be set up again without using the heap.
  */
 void shutdownLCD()
 {
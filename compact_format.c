@@ -0,0 +1,420 @@
+/*
+ * compact_format.c
+ *
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+/****************************************************************************//*!
+ * \defgroup compact_format Module Compact Format
+ * @{
+******************************************************************************/
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS:
+ * Program file: Section I. Prologue: description about the file, description author(s), revision control
+ * 				information, references, etc.
+ */
+
+/*(Doxygen help: use \brief to provide short summary and \details command can be used)*/
+
+/*!	\file compact_format.c
+ * 	\brief This file defines and implements the compact format functions including APIs.
+ *
+ * \details Each function appends one typed field to a FORMAT_BUFFER. Digits are produced by repeated division into
+ * a small local array, least significant digit first, and then copied in order after the padding. Fixed-point numbers
+ * are rounded to the requested number of decimals using integer arithmetic only.
+ *
+ * Module APIs:
+ * 	- format_initialize(): attaches a character array to a FORMAT_BUFFER and empties it.
+ * 	- format_append_character(), format_append_string(), format_append_string_P(): append text.
+ * 	- format_append_decimal(), format_append_unsigned(): append an integer in decimal (like %*ld and %*lu).
+ * 	- format_append_hex(): append an integer in lowercase hexadecimal (like %x or %0*x).
+ * 	- format_append_fixed(): append a Q-format fixed-point number with a number of decimals (like %*.*f).
+ *
+ *
+ * \note The buffer is always terminated, fields that do not fit are truncated.
+ *
+ */
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS:
+ * Program file: Section II. Include(s): header file includes. System include files and then user include files.
+ * 				Ensure to add comments for an inclusion which is not very obvious. Suggested order of inclusion is
+ * 								System -> Other Modules -> Same Module -> Specific to this file
+ * Note: Avoid nested inclusions.
+ */
+
+/* --Includes-- */
+/*AVR library*/
+#include <avr/pgmspace.h>
+
+/* module includes */
+#include "compact_format.h"		/* for module functions */
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS:
+ * Program file: Section III. Defines and typedefs: order of appearance -> constant macros, function macros,
+ * 				typedefs and then enums.
+ * Naming convention: Use upper case and words joined with an underscore (_). Limit  the  use  of  abbreviations.
+ * Constants: define and use constants, rather than using numerical values; it make code more readable, and easier
+ * 			  to modify.
+ */
+
+
+#define DIGITS_SIZE 													10								/*!<Maximum number of digits of a 32 bit number (decimal)*/
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS:
+ * Program file: Section IV. Global   or   external   data   declarations -> externs, non­static globals, and then
+ * 				static globals.
+ *
+ * Naming convention: variables names must be meaningful lower case and words joined with an underscore (_). Limit
+ * 					  the  use  of  abbreviations.
+ * Guidelines for variable declaration:
+ *				1) Do not group unrelated variables declarations even if of same data type.
+ * 				2) Do not declare multiple variables in one declaration that spans lines. Start a new declaration
+ * 				   on each line, in­stead.
+ * 				3) Move the declaration of each local variable into the smallest scope that includes all its uses.
+ * 				   This makes the program cleaner.
+ */
+
+
+/*!
+ * \brief Powers of ten used to scale the fraction of fixed-point numbers.
+ */
+static const uint16_t format_powers_of_ten[FORMAT_FIXED_MAXIMUM_DECIMALS + 1] PROGMEM = {1, 10, 100, 1000, 10000};
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS
+ * Program file: Section V. Functions: order on abstraction level or usage; and if independent alphabetical
+ * 				or­dering is good choice.
+ *
+ * 1) Declare all the functions (entry points, external functions, local functions, and ISR-interrupt service
+ *    routines) before first function definition in the program file or in header file and include it; and define
+ *    functions in the same order as of declaration.
+ * 2) Suggested order of declaration and definition of functions is
+ * 	  Entry points -> External functions -> Local functions -> ISR-Interrupt Service Routines
+ * 3) Declare function names, parameters (names and types) and re­turn type in one line; if not possible fold it at
+ *    an appropriate place to make it easily readable.
+ * 4) No function definition should be longer than a page or screen long. If it is long, try and split it into two
+ *    or more functions.
+ * 5) Indentation and Spacing: this can improve the readability of the source code greatly. Tabs should be used to
+ *    indent code, rather than spaces; because spaces can often be out by one and lead to confusions.
+ * 6) Keep the length of source lines to 79 characters or less, for max­imum readability.
+ */
+
+/*---------------------------------------  Function Declarations  -------------------------------------------------*/
+/*
+ * Declare all your functions, except for entry points, for the module here; ensure to follow the same order while
+ * defining them later.
+ */
+
+/*Convert a number to digits, least significant first*/
+static uint8_t format_digits(uint32_t value, uint8_t base, char *digits);
+
+/*Append the digits in order, after padding*/
+static void format_append_digits(FORMAT_BUFFER *format_buffer, const char *digits, uint8_t count);
+
+/*Append a padding character*/
+static void format_append_padding(FORMAT_BUFFER *format_buffer, char padding, uint8_t count);
+
+/*---------------------------------------  ENTRY POINTS  ---------------------------------------------------------*/
+/*define your entry points here*/
+
+/*(Doxygen help: use \brief to provide short summary, \details for detailed description and \param for parameters */
+
+
+/*!\brief Initialize a format buffer.
+ *
+ * \details Attaches the character array to the format buffer and empties the string.
+ *
+ *
+ * @param format_buffer - format buffer to initialize.
+ * @param buffer - character array holding the string.
+ * @param size - size of the character array, including the terminator (must be at least 1).
+ *
+ * @return void
+ *
+ */
+void format_initialize(FORMAT_BUFFER *format_buffer, char *buffer, uint16_t size){
+	format_buffer->buffer = buffer;
+	format_buffer->size = size;
+	format_buffer->length = 0;
+	format_buffer->buffer[0] = '\0';
+}
+
+
+/*!\brief Append a character.
+ *
+ * \details The character is dropped if the buffer is full.
+ *
+ *
+ * @param format_buffer - format buffer.
+ * @param character - character to append.
+ *
+ * @return void
+ *
+ */
+void format_append_character(FORMAT_BUFFER *format_buffer, char character){
+	if (format_buffer->length + 1 < format_buffer->size){
+		format_buffer->buffer[format_buffer->length++] = character;
+		format_buffer->buffer[format_buffer->length] = '\0';
+	}
+}
+
+
+/*!\brief Append a string stored in RAM.
+ *
+ *
+ * @param format_buffer - format buffer.
+ * @param string - terminated string.
+ *
+ * @return void
+ *
+ */
+void format_append_string(FORMAT_BUFFER *format_buffer, const char *string){
+	while (*string != '\0' && format_buffer->length + 1 < format_buffer->size)
+		format_buffer->buffer[format_buffer->length++] = *string++;
+	format_buffer->buffer[format_buffer->length] = '\0';
+}
+
+
+/*!\brief Append a string stored in program memory.
+ *
+ * \details Use FORMAT_APPEND_LITERAL() to append a literal.
+ *
+ *
+ * @param format_buffer - format buffer.
+ * @param string - terminated string in program memory.
+ *
+ * @return void
+ *
+ */
+void format_append_string_P(FORMAT_BUFFER *format_buffer, PGM_P string){
+	char character = pgm_read_byte(string);
+
+	while (character != '\0' && format_buffer->length + 1 < format_buffer->size){
+		format_buffer->buffer[format_buffer->length++] = character;
+		character = pgm_read_byte(++string);
+	}
+	format_buffer->buffer[format_buffer->length] = '\0';
+}
+
+
+/*!\brief Append a signed integer in decimal.
+ *
+ * \details Equivalent to %*ld: right aligned, padded with spaces to width characters.
+ *
+ *
+ * @param format_buffer - format buffer.
+ * @param value - number to append.
+ * @param width - minimum number of characters, including the sign (0 - no padding).
+ *
+ * @return void
+ *
+ */
+void format_append_decimal(FORMAT_BUFFER *format_buffer, int32_t value, uint8_t width){
+	char digits[DIGITS_SIZE];
+	uint8_t count = 0;
+	uint8_t negative = (value < 0);
+
+	count = format_digits(negative ? -(uint32_t)value : (uint32_t)value, 10, digits);
+
+	if (width > count + negative)
+		format_append_padding(format_buffer, ' ', width - count - negative);
+	if (negative)
+		format_append_character(format_buffer, '-');
+	format_append_digits(format_buffer, digits, count);
+}
+
+
+/*!\brief Append an unsigned integer in decimal.
+ *
+ * \details Equivalent to %*lu: right aligned, padded with spaces to width characters.
+ *
+ *
+ * @param format_buffer - format buffer.
+ * @param value - number to append.
+ * @param width - minimum number of characters (0 - no padding).
+ *
+ * @return void
+ *
+ */
+void format_append_unsigned(FORMAT_BUFFER *format_buffer, uint32_t value, uint8_t width){
+	char digits[DIGITS_SIZE];
+	uint8_t count = format_digits(value, 10, digits);
+
+	if (width > count)
+		format_append_padding(format_buffer, ' ', width - count);
+	format_append_digits(format_buffer, digits, count);
+}
+
+
+/*!\brief Append an unsigned integer in lowercase hexadecimal.
+ *
+ * \details Equivalent to %0*lx: padded with zeros to digits characters.
+ *
+ *
+ * @param format_buffer - format buffer.
+ * @param value - number to append.
+ * @param digits - minimum number of digits (0 - no padding, like %x).
+ *
+ * @return void
+ *
+ */
+void format_append_hex(FORMAT_BUFFER *format_buffer, uint32_t value, uint8_t digits){
+	char hex_digits[DIGITS_SIZE];
+	uint8_t count = format_digits(value, 16, hex_digits);
+
+	if (digits > count)
+		format_append_padding(format_buffer, '0', digits - count);
+	format_append_digits(format_buffer, hex_digits, count);
+}
+
+
+/*!\brief Append a Q-format fixed-point number.
+ *
+ * \details Equivalent to %*.*f for the number value / 2^fraction_bits: rounded to decimals decimals, right aligned
+ * and padded with spaces to width characters. Only integer arithmetic is used. Unlike %f, a negative number rounding
+ * to zero is appended without sign.
+ *
+ * \note fraction_bits is limited to FORMAT_FIXED_MAXIMUM_FRACTION_BITS and decimals to
+ * FORMAT_FIXED_MAXIMUM_DECIMALS.
+ *
+ * @param format_buffer - format buffer.
+ * @param value - fixed-point number, e.g. Q8 is value = real number * 256.
+ * @param fraction_bits - number of fraction bits of value.
+ * @param decimals - number of decimals to append (0 - no decimal point).
+ * @param width - minimum number of characters, including the sign and the decimal point (0 - no padding).
+ *
+ * @return void
+ *
+ */
+void format_append_fixed(FORMAT_BUFFER *format_buffer, int32_t value, uint8_t fraction_bits, uint8_t decimals, uint8_t width){
+	char digits[DIGITS_SIZE];
+	char fraction_digits[DIGITS_SIZE];
+	uint8_t negative = (value < 0);
+	uint32_t magnitude = negative ? -(uint32_t)value : (uint32_t)value;
+	uint32_t integral = 0, fraction = 0, scale = 0;
+	uint8_t count = 0, fraction_count = 0, length = 0;
+
+	if (fraction_bits > FORMAT_FIXED_MAXIMUM_FRACTION_BITS)
+		fraction_bits = FORMAT_FIXED_MAXIMUM_FRACTION_BITS;
+	if (decimals > FORMAT_FIXED_MAXIMUM_DECIMALS)
+		decimals = FORMAT_FIXED_MAXIMUM_DECIMALS;
+	scale = pgm_read_word(&format_powers_of_ten[decimals]);
+
+	/*Scale the fraction to decimals digits, rounded to nearest (fraction * scale fits in 32 bits)*/
+	integral = magnitude >> fraction_bits;
+	fraction = magnitude & (((uint32_t)1 << fraction_bits) - 1);
+	fraction = fraction * scale;
+	if (fraction_bits > 0)
+		fraction = (fraction + ((uint32_t)1 << (fraction_bits - 1))) >> fraction_bits;
+	if (fraction >= scale){
+		integral++;
+		fraction -= scale;
+	}
+	if (integral == 0 && fraction == 0)
+		negative = 0;
+
+	count = format_digits(integral, 10, digits);
+	if (decimals > 0){
+		fraction_count = format_digits(fraction, 10, fraction_digits);
+		length = 1 + decimals;
+	}
+	length += count + negative;
+
+	if (width > length)
+		format_append_padding(format_buffer, ' ', width - length);
+	if (negative)
+		format_append_character(format_buffer, '-');
+	format_append_digits(format_buffer, digits, count);
+	if (decimals > 0){
+		format_append_character(format_buffer, '.');
+		format_append_padding(format_buffer, '0', decimals - fraction_count);
+		format_append_digits(format_buffer, fraction_digits, fraction_count);
+	}
+}
+
+
+/*---------------------------------------  LOCAL FUNCTIONS  ------------------------------------------------------*/
+/*define your local functions here*/
+
+/*(Doxygen help: use \brief to provide short summary, \details for detailed description and \param for parameters */
+
+
+/*!\brief Convert a number to digits.
+ *
+ * \details Digits are stored least significant first, lowercase for hexadecimal. Zero gives one digit.
+ *
+ *
+ * @param value - number to convert.
+ * @param base - 10 or 16.
+ * @param digits - returns the digits, at least DIGITS_SIZE characters.
+ *
+ * @return number of digits.
+ *
+ */
+static uint8_t format_digits(uint32_t value, uint8_t base, char *digits){
+	uint8_t count = 0;
+	uint8_t digit = 0;
+
+	do{
+		digit = value % base;
+		digits[count++] = (digit < 10) ? '0' + digit : 'a' + digit - 10;
+		value /= base;
+	}while (value > 0);
+
+	return count;
+}
+
+
+/*!\brief Append digits.
+ *
+ * \details Appends the digits produced by format_digits, most significant first.
+ *
+ *
+ * @param format_buffer - format buffer.
+ * @param digits - digits, least significant first.
+ * @param count - number of digits.
+ *
+ * @return void
+ *
+ */
+static void format_append_digits(FORMAT_BUFFER *format_buffer, const char *digits, uint8_t count){
+	while (count > 0)
+		format_append_character(format_buffer, digits[--count]);
+}
+
+
+/*!\brief Append padding.
+ *
+ *
+ * @param format_buffer - format buffer.
+ * @param padding - padding character.
+ * @param count - number of padding characters.
+ *
+ * @return void
+ *
+ */
+static void format_append_padding(FORMAT_BUFFER *format_buffer, char padding, uint8_t count){
+	while (count-- > 0)
+		format_append_character(format_buffer, padding);
+}
+
+
+/*---------------------------------------  ISR-Interrupt Service Routines  ---------------------------------------*/
+/*define your Interrupt Service Routines here*/
+
+/*(Doxygen help: use \brief to provide short summary, \details for detailed description and \param for parameters */
+
+
+/*NO ISR*/
+
+/*!@}*/   // end module
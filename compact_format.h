@@ -0,0 +1,153 @@
+/*
+ * compact_format.h
+ *
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+/****************************************************************************//*!
+ * \defgroup compact_format Module Compact Format
+ * @{
+******************************************************************************/
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS
+ * Header file: Section I. Prologue: description about the file, description author(s), revision control
+ * 				information, references, etc.
+ * Note: 1. Header files should be functionally organized.
+ *		 2. Declarations   for   separate   subsystems   should   be   in   separate
+ */
+
+/*(Doxygen help: use \brief to provide short summary and \details command can be used)*/
+
+/*!\file compact_format.h
+ * 	\brief This file declares the compact format API functions.
+ *
+ * \details Small integer and fixed-point formatter, to be used on hot paths instead of the printf family. The layout
+ * of a string is defined at compile time by the sequence of calls, each call appending one typed field to a
+ * FORMAT_BUFFER; no format string is parsed at run time, and neither varargs nor the floating point printf library
+ * are needed. Literal text is kept in program memory.
+ *
+ * Module APIs:
+ * 	- format_initialize(): attaches a character array to a FORMAT_BUFFER and empties it.
+ * 	- format_append_character(), format_append_string(), format_append_string_P(): append text.
+ * 	- format_append_decimal(), format_append_unsigned(): append an integer in decimal (like %*ld and %*lu).
+ * 	- format_append_hex(): append an integer in lowercase hexadecimal (like %x or %0*x).
+ * 	- format_append_fixed(): append a Q-format fixed-point number with a number of decimals (like %*.*f).
+ *
+ *
+ * \note The buffer is always terminated, fields that do not fit are truncated.
+ *
+ * Usage guidelines:-
+ *
+ * 		=> Initialize a FORMAT_BUFFER on a local character array using format_initialize().
+ *
+ * 		=> Append the fields in order. Use FORMAT_APPEND_LITERAL() for literal text, so that it stays in program memory.
+ *
+ * 			Example: "A:%2d\n\r" becomes
+ * 				FORMAT_APPEND_LITERAL(&text, "A:");
+ * 				format_append_decimal(&text, ambient_temperature, 2);
+ * 				FORMAT_APPEND_LITERAL(&text, "\n\r");
+ *
+ * 		=> Transmit buffer/length, e.g. with usart_xwritev().
+ *
+ *
+ */
+
+
+#ifndef INCLUDE_COMPACT_FORMAT_H_
+#define INCLUDE_COMPACT_FORMAT_H_
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS:
+ * Header file: Section II. Include(s): header file includes. System include files and then user include files.
+ * 				Ensure to add comments for an inclusion which is not very obvious. Suggested order of inclusion is
+ * 								System -> Other Modules -> Same Module -> Specific to this file
+ * Note: Avoid nested inclusions.
+ */
+
+#include <stdint.h>
+#include <avr/pgmspace.h>			/* for PGM_P and PSTR */
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS
+ * Header file: Section III. Defines and typedefs: order of appearance -> constant macros, function macros,
+ * 				typedefs and then enums.
+ *
+ * Custom data types and typedef: these definitions are best placed in a header file so that all source code
+ * files which rely on that header file have access to the same set of definitions. This also makes it easier
+ * to modify.
+ * Naming convention: Use upper case and words joined with an underscore (_). Limit  the  use  of  abbreviations.
+ * Constants: define and use constants, rather than using numerical values; it make code more readable, and easier
+ * 			  to modify.
+ * Note: Avoid initialized data definitions.
+ */
+
+#define FORMAT_FIXED_MAXIMUM_FRACTION_BITS								16								/*!<Maximum number of fraction bits of a Q-format number*/
+#define FORMAT_FIXED_MAXIMUM_DECIMALS									4								/*!<Maximum number of decimals printed for a Q-format number*/
+
+#define FORMAT_APPEND_LITERAL(format_buffer, literal)					format_append_string_P((format_buffer), PSTR(literal))		/*!<Append literal text, stored in program memory*/
+
+/*!
+ * \brief String under construction.
+ *
+ *
+ * \details Character array, its size and the length of the string built so far. The string is always terminated.
+ *
+ */
+typedef struct{
+	char *buffer;																		/*!<Character array holding the string*/
+	uint16_t size;																		/*!<Size of the character array, including the terminator*/
+	uint16_t length;																	/*!<Length of the string*/
+} FORMAT_BUFFER;
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS:
+ * Header file: Section IV. Global   or   external   data   declarations -> externs, non­static globals, and then
+ * 				static globals.
+ *
+ * Naming convention: variables names must be meaningful lower case and words joined with an underscore (_). Limit
+ * 					  the  use  of  abbreviations.
+ */
+
+
+/* NO GLOBAL DATA */
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS
+ * Header file: Section V. Functions: order on abstraction level or usage; and if independent alphabetical
+ * 				or­dering is good choice.
+ *
+ * 1) Declare all the entry point functions.
+ * 2) Declare function names, parameters (names and types) and re­turn type in one line; if not possible fold it at
+ *    an appropriate place to make it easily readable.
+ */
+
+
+/*---------------------------------------  ENTRY POINTS  ---------------------------------------------------------*/
+/*Declare your entry points here*/
+
+void format_initialize(FORMAT_BUFFER *format_buffer, char *buffer, uint16_t size);
+
+void format_append_character(FORMAT_BUFFER *format_buffer, char character);
+
+void format_append_string(FORMAT_BUFFER *format_buffer, const char *string);
+
+void format_append_string_P(FORMAT_BUFFER *format_buffer, PGM_P string);
+
+void format_append_decimal(FORMAT_BUFFER *format_buffer, int32_t value, uint8_t width);
+
+void format_append_unsigned(FORMAT_BUFFER *format_buffer, uint32_t value, uint8_t width);
+
+void format_append_hex(FORMAT_BUFFER *format_buffer, uint32_t value, uint8_t digits);
+
+void format_append_fixed(FORMAT_BUFFER *format_buffer, int32_t value, uint8_t fraction_bits, uint8_t decimals, uint8_t width);
+
+#endif /* INCLUDE_COMPACT_FORMAT_H_ */
+
+/*!@}*/   // end module
@@ -46,6 +46,9 @@
  *
  * \note Ensure to initialize the module in the beginning of program.
  *
+ * \note The compare B interrupt of TIMER0 (once per period) is used by usart_serial to detect the end of received
+ * messages (usart_xsetIdleGap); the period and the mode of TIMER0 must not be changed.
+ *
  * Usage guidelines:-
  *
  * 		=> Initialize the module by calling, initialize_module_timer0(). It should be done at
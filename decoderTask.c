@@ -11,6 +11,13 @@
 
 float distanceTravelled = 0;
 
+/**
+ * Last periods read from the encoders (in ticks of 500 ns), kept for
+ * telemetry.
+ */
+static volatile uint32_t lastTicksLeft = 0;
+static volatile uint32_t lastTicksRight = 0;
+
 /**
  * Calculates the speed and the distance travelled of chico. It calculates the
  * speed of both the right and left wheel.  Then does the average to return the speed.
@@ -34,6 +41,7 @@ void decoderTask(int period, float *returnSpeed, float *returnDistanceTravelled)
 
 	if(newDataAvailableLeft)
 	{
+		lastTicksLeft = ticksLeft;
 		float timeLeft = ticksLeft*500E-9;
 		leftSpeed = distancePerRisingEdge /timeLeft; // (m/s)
 	}
@@ -44,6 +52,7 @@ void decoderTask(int period, float *returnSpeed, float *returnDistanceTravelled)
 
 	if(newDataAvailableRight)
 	{
+		lastTicksRight = ticksRight;
 		float timeRight = ticksRight*500E-9;
 		rightSpeed = distancePerRisingEdge /timeRight; // (m/s)
 	}
@@ -57,3 +66,19 @@ void decoderTask(int period, float *returnSpeed, float *returnDistanceTravelled)
 	*returnDistanceTravelled += leftSpeed * (period / (float)1000);
 }
 
+/**
+ * Returns the last periods read from the encoders by decoderTask.
+ *
+ * @param ticksLeft  A pointer in which the period of the left encoder will be
+ * stored, in ticks of 500 ns.
+ * @param ticksRight A pointer in which the period of the right encoder will be
+ * stored, in ticks of 500 ns.
+ */
+void getEncoderPeriods(uint32_t *ticksLeft, uint32_t *ticksRight)
+{
+	taskENTER_CRITICAL();
+	*ticksLeft = lastTicksLeft;
+	*ticksRight = lastTicksRight;
+	taskEXIT_CRITICAL();
+}
+
@@ -2,6 +2,9 @@
 #ifndef DECODERTASK_H_
 #define DECODERTASK_H_
 
+#include <stdint.h>
+
 void decoderTask(int period, float *returnSpeed, float *returnDistanceTravelled);
+void getEncoderPeriods(uint32_t *ticksLeft, uint32_t *ticksRight);
 
 #endif /* DECODERTASK_H_ */
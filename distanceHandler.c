@@ -1,10 +1,15 @@
 #include "custom_timer.h"
 #include "FreeRTOS.h"
-#include "usart_serial.h"
+#include "logging.h"
 #include <util/delay.h>
 
 #define CHECK_BIT_STATUS(variable, position) 							( (variable) & (1 << (position)) )
 
+/**
+ * Last distance measured by getDistance, in centimeters (-1 if no echo).
+ */
+static volatile int lastDistance = -1;
+
 /**
  * Gets the distance that chico has from an heat source.  It sends a sonar signal and calculates
  * the elapsed time between the send of the signal and the time when the signal comes back to chico.
@@ -21,7 +26,7 @@ int getDistance() {
 	PORTA &= 0b11111110; //pin A0 LOW
 	DDRA &= 0b11111110; //input
 
-	usart_fprintf_P(USART_0, PSTR("1\n"));
+	LOG_DEBUG(LOG_MODULE_SONAR, LOG_SONAR_TRIGGERED);
 
 	unsigned long count = 0;
 
@@ -29,19 +34,31 @@ int getDistance() {
 		_delay_us(5);
 		count++;
 		if(count > 200000){
-			usart_fprintf_P(USART_0, PSTR("NOOOO CHICO!!!!!\n"));
+			LOG_WARNING(LOG_MODULE_SONAR, LOG_SONAR_NO_ECHO);
+			lastDistance = -1;
 			return -1;
 		}
 	}
 
 	unsigned long start = time_in_microseconds();
-	usart_fprintf_P(USART_0, PSTR("2\n"));
+	LOG_DEBUG(LOG_MODULE_SONAR, LOG_SONAR_ECHO_STARTED);
 	loop_until_bit_is_clear(PINA, PA0);
 	unsigned long end = time_in_microseconds();
-	usart_fprintf_P(USART_0, PSTR("3\n"));
+	LOG_DEBUG(LOG_MODULE_SONAR, LOG_SONAR_ECHO_ENDED);
 	long elapsedTime = end - start;
 
 	int distance = elapsedTime/29/2;
-	usart_fprintf_P(USART_0, PSTR("Dist: %lu \n"), end);
+	LOG_DEBUG(LOG_MODULE_SONAR, LOG_SONAR_DISTANCE, elapsedTime, distance);
+	lastDistance = distance;
 	return distance;
 }
+
+/**
+ * Returns the last distance measured by getDistance, without a new
+ * measurement.
+ *
+ * Returns the distance in centimeters (-1 if no echo was received).
+ */
+int getLastDistance() {
+	return lastDistance;
+}
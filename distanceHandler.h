@@ -3,5 +3,6 @@
 #define DISTANCEHANDLER_H_
 
 int getDistance(void);
+int getLastDistance(void);
 
 #endif /* DISTANCEHANDLER_H_ */
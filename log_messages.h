@@ -0,0 +1,100 @@
+#ifndef LOG_MESSAGES_H_
+#define LOG_MESSAGES_H_
+
+/**
+ *  Dictionary of the log messages, shared by the robot (logging.c) and the
+ *  host decoder (tools/telemetry_decoder.c).
+ *
+ *  Each entry is LOG_MESSAGE(identifier, argument types, format). The robot
+ *  only keeps the argument types: a log call sends the position of its entry
+ *  in this list (the message ID, assigned by the compiler) and the raw bytes
+ *  of its arguments, in a TELEMETRY_RECORD_LOG record. The format strings are
+ *  only compiled into the host decoder, which rebuilds the text.
+ *
+ *  Argument types, one character per argument, in the order of the format:
+ *  - 'c' : char (1 byte), for %c.
+ *  - 'b' : 8 bit integer (1 byte), for %d, %u, %x.
+ *  - 'w' : 16 bit integer (2 bytes), for %d, %u, %x.
+ *  - 'l' : 32 bit integer (4 bytes), for %ld, %lu, %lx; pass a long.
+ *  - 's' : string in RAM, for %s; sent NUL terminated, truncated to the room
+ *          left in the record.
+ *
+ *  Append new messages at the end, so that the IDs of a robot and a decoder
+ *  built from different revisions of this file still match.
+ */
+#define LOG_MESSAGES \
+	/* Sonar (distanceHandler.c) */ \
+	LOG_MESSAGE(LOG_SONAR_TRIGGERED,          "",      "Sonar: triggered") \
+	LOG_MESSAGE(LOG_SONAR_NO_ECHO,            "",      "Sonar: no echo") \
+	LOG_MESSAGE(LOG_SONAR_ECHO_STARTED,       "",      "Sonar: echo started") \
+	LOG_MESSAGE(LOG_SONAR_ECHO_ENDED,         "",      "Sonar: echo ended") \
+	LOG_MESSAGE(LOG_SONAR_DISTANCE,           "lw",    "Sonar: echo %lu us, distance %d cm") \
+	/* Gainspan WiFi (wireless_interface.c) */ \
+	LOG_MESSAGE(LOG_GS_COMMAND,               "s",     "Command: %s") \
+	LOG_MESSAGE(LOG_GS_RESPONSE,              "s",     "Response: %s") \
+	LOG_MESSAGE(LOG_GS_COMMAND_SUCCESS,       "s",     "Command-%s: SUCCESS!") \
+	LOG_MESSAGE(LOG_GS_COMMAND_ERROR,         "s",     "Command-%s: ERROR!") \
+	LOG_MESSAGE(LOG_GS_COMMAND_NO_RESPONSE,   "s",     "Command-%s: NO RESPONSE CAPTURED!") \
+	LOG_MESSAGE(LOG_GS_ACTIVATION_STARTED,    "",      "Gainspan Device: activation in progress....") \
+	LOG_MESSAGE(LOG_GS_ACTIVATED,             "",      "Gainspan Device: activated successfully!") \
+	LOG_MESSAGE(LOG_GS_ACTIVATED_WITH_ERRORS, "",      "Gainspan Device: activated with errors!") \
+	LOG_MESSAGE(LOG_GS_ACTIVATION_FAILED,     "",      "Gainspan Device: activation failure!") \
+	LOG_MESSAGE(LOG_GS_BAUD_RATE_SWITCHED,    "lllll", "Gainspan Device: %lu baud OK, AT round trip %lu ms at %lu baud, %lu ms at %lu baud") \
+	LOG_MESSAGE(LOG_GS_BAUD_RATE_FAILED,      "lllll", "Gainspan Device: %lu baud failed, AT round trip %lu ms at %lu baud, %lu ms at %lu baud") \
+	/* Web server (wireless_interface.c) */ \
+	LOG_MESSAGE(LOG_WEB_PAGE_CONFIGURED,      "",      "Web Page: configured....") \
+	LOG_MESSAGE(LOG_WEB_PAGE_ELEMENT_EXISTS,  "c",     "Web Page: element choice identifier %c already exists....") \
+	LOG_MESSAGE(LOG_WEB_PAGE_ELEMENT_ADDED,   "c",     "Web Page: element %c added....") \
+	LOG_MESSAGE(LOG_WEB_PAGE_FULL,            "b",     "Web Page: can't add element, max %u allowed....") \
+	LOG_MESSAGE(LOG_WEB_SERVER_INITIALIZED,   "",      "Web Server: Initialized....") \
+	LOG_MESSAGE(LOG_WEB_SERVER_STARTED,       "",      "Web Server: Started....") \
+	LOG_MESSAGE(LOG_WEB_SERVER_PAGE_EMPTY,    "",      "Web Server: can't start, web-page empty....") \
+	LOG_MESSAGE(LOG_WEB_SERVER_PAGE_SERVED,   "ll",    "Web Server: page served in %lu ms at %lu baud") \
+	/* Logging (logging.c) */ \
+	LOG_MESSAGE(LOG_DROPPED,                  "wb",    "Log: %u messages of module %u dropped (rate limit)") \
+	/* Boot (main.c) */ \
+	LOG_MESSAGE(LOG_BOOT_WIFI_READY,          "lll",   "Boot: Wi-Fi up in %lu ms (module %lu ms, web server %lu ms)") \
+	/* Gainspan WiFi (wireless_interface.c) */ \
+	LOG_MESSAGE(LOG_GS_ACTIVATION_STEP,       "sbw",   "Gainspan Device: step %s, outcome %u (0 error, 1 OK, 2 no response, 3 skipped), %u ms") \
+	/* Boot (main.c) */ \
+	LOG_MESSAGE(LOG_BOOT_TASKS_CREATED,       "l",     "Boot: tasks created at %lu ms, starting the scheduler") \
+	LOG_MESSAGE(LOG_BOOT_WIFI_STARTED,        "l",     "Boot: Wi-Fi bring-up started at %lu ms") \
+	LOG_MESSAGE(LOG_BOOT_WIFI_RETRY,          "lb",    "Boot: Wi-Fi activation failed at %lu ms (attempt %u), retrying") \
+	LOG_MESSAGE(LOG_BOOT_WIFI_LINK_READY,     "l",     "Boot: Wi-Fi link up at %lu ms") \
+	/* Web server (wireless_interface.c) */ \
+	LOG_MESSAGE(LOG_WEB_PAGE_RENDERED,        "w",     "Web Page: rendered, %u characters") \
+	LOG_MESSAGE(LOG_WEB_PAGE_TRUNCATED,       "w",     "Web Page: truncated to %u characters, shorten the titles or labels") \
+	LOG_MESSAGE(LOG_GS_BULK_NOT_ACKNOWLEDGED, "bbw",   "Gainspan Device: bulk data to CID %u, outcome %u (0 failed, 2 no answer), %u characters") \
+	LOG_MESSAGE(LOG_WEB_CLIENT_CONNECTED,     "bb",    "Web Server: client CID %u connected, %u connections") \
+	LOG_MESSAGE(LOG_WEB_CLIENT_REFUSED,       "bb",    "Web Server: client CID %u refused, all %u connections in use") \
+	LOG_MESSAGE(LOG_WEB_CLIENT_TIMED_OUT,     "bw",    "Web Server: client CID %u closed, request incomplete after %u characters") \
+	LOG_MESSAGE(LOG_GS_COMMAND_TOO_LONG,      "bb",    "Gainspan Device: command %u not sent, longer than %u characters") \
+	/* USART health counters (usart_getStats, wireless_interface.c) */ \
+	LOG_MESSAGE(LOG_USART_TRAFFIC,            "bll",   "USART%u rx:%lu tx:%lu") \
+	LOG_MESSAGE(LOG_USART_DROPS,              "bwwwww", "USART%u rx drops fe:%u dor:%u upe:%u full:%u tx drops full:%u") \
+	LOG_MESSAGE(LOG_USART_LOAD,               "bwwww", "USART%u high water rx:%u tx:%u lock waits:%u max:%u ticks") \
+	LOG_MESSAGE(LOG_USART_FLOW,               "bwww",  "USART%u flow control rts stops:%u cts pauses:%u priority max delay:%u") \
+	/* Boot (main.c) */ \
+	LOG_MESSAGE(LOG_BOOT_WEB_SERVER_UP,       "lll",   "Boot: web server up at %lu ms (module %lu ms, web server %lu ms)") \
+	/* Web server (wireless_interface.c) */ \
+	LOG_MESSAGE(LOG_WEB_SERVER_CLIENT_SERVED, "blwl",  "Web Server: page served to CID %u in %lu ms (%u characters) at %lu baud") \
+	LOG_MESSAGE(LOG_WEB_CLIENT_DROPPED,       "b",     "Web Server: client CID %u closed, connected during a command (its request may be lost)") \
+	LOG_MESSAGE(LOG_WEB_SERVER_PAGE_NOT_SERVED, "bw",  "Web Server: page not served to CID %u, not rendered or truncated (%u characters)")
+
+/**
+ *  Largest number of arguments of a message.
+ */
+#define LOG_MAX_ARGUMENTS 6
+
+/**
+ *  Message IDs.
+ */
+typedef enum
+{
+#define LOG_MESSAGE(identifier, types, format) identifier,
+	LOG_MESSAGES
+#undef LOG_MESSAGE
+	LOG_MESSAGE_COUNT
+} LOG_MESSAGE_ID;
+
+#endif /* LOG_MESSAGES_H_ */
@@ -0,0 +1,217 @@
+#include <stdarg.h>
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "logging.h"
+#include "telemetry.h"
+#include "custom_timer.h"
+
+/**
+ *  Argument types of each message, see log_messages.h. The format strings
+ *  are not stored on the robot.
+ */
+static const char logArgumentTypes[LOG_MESSAGE_COUNT][LOG_MAX_ARGUMENTS + 1] PROGMEM =
+{
+#define LOG_MESSAGE(identifier, types, format) types,
+	LOG_MESSAGES
+#undef LOG_MESSAGE
+};
+
+/**
+ *  Rate limit of each module, see LOG_MODULES.
+ */
+static const struct
+{
+	uint8_t burst;
+	uint16_t tokenPeriodMs;
+} logModuleLimits[LOG_MODULE_COUNT] PROGMEM =
+{
+#define LOG_MODULE(identifier, threshold, burst, tokenPeriodMs) { burst, tokenPeriodMs },
+	LOG_MODULES
+#undef LOG_MODULE
+};
+
+/**
+ *  Runtime state of each module: threshold and token bucket.
+ */
+static struct
+{
+	LOG_LEVEL threshold;
+	uint8_t tokens;
+	uint16_t dropped;
+	uint32_t lastRefill;
+} logModules[LOG_MODULE_COUNT] =
+{
+#define LOG_MODULE(identifier, threshold, burst, tokenPeriodMs) { threshold, burst, 0, 0 },
+	LOG_MODULES
+#undef LOG_MODULE
+};
+
+static uint8_t takeLogToken(LOG_MODULE_ID module, uint16_t *dropped);
+static void sendLogMessage(LOG_MESSAGE_ID messageId, va_list arguments);
+static void sendLog(LOG_MESSAGE_ID messageId, ...);
+
+/**
+ * Sends a log message of a module, if its level is within the threshold of
+ * the module and the module has not exceeded its rate. Use the LOG_ERROR,
+ * LOG_WARNING, LOG_INFO and LOG_DEBUG macros rather than calling it directly,
+ * so that the levels above LOG_COMPILE_LEVEL compile to nothing.
+ *
+ * Messages over the rate are dropped; their count is reported (LOG_DROPPED)
+ * before the next message of the module that gets through.
+ *
+ * @param module    Module that logs.
+ * @param level     Level of the message.
+ * @param messageId ID of the message, followed by its arguments (see
+ *                  log_messages.h).
+ */
+void logModuleMessage(LOG_MODULE_ID module, LOG_LEVEL level, LOG_MESSAGE_ID messageId, ...)
+{
+	uint16_t dropped;
+	va_list arguments;
+
+	if (level > logModules[module].threshold || !takeLogToken(module, &dropped))
+		return;
+
+	if (dropped > 0)
+		sendLog(LOG_DROPPED, dropped, (int)module);
+
+	va_start(arguments, messageId);
+	sendLogMessage(messageId, arguments);
+	va_end(arguments);
+}
+
+/**
+ * Changes the runtime threshold of a module. Levels above LOG_COMPILE_LEVEL
+ * stay disabled.
+ *
+ * @param module Module.
+ * @param level  Highest level sent (LOG_LEVEL_NONE to silence the module).
+ */
+void logSetLevel(LOG_MODULE_ID module, LOG_LEVEL level)
+{
+	logModules[module].threshold = level;
+}
+
+/**
+ * @return The runtime threshold of a module.
+ */
+LOG_LEVEL logGetLevel(LOG_MODULE_ID module)
+{
+	return logModules[module].threshold;
+}
+
+/**
+ * Refills the token bucket of a module for the time elapsed since the last
+ * refill, then takes a token from it.
+ *
+ * @param module  Module.
+ * @param dropped Number of messages dropped since the last message sent; only
+ *                valid if a token was taken.
+ * @return 1 if a token was taken, 0 if the message must be dropped.
+ */
+static uint8_t takeLogToken(LOG_MODULE_ID module, uint16_t *dropped)
+{
+	uint8_t burst = pgm_read_byte(&logModuleLimits[module].burst);
+	uint16_t tokenPeriodMs = pgm_read_word(&logModuleLimits[module].tokenPeriodMs);
+	uint32_t now = time_in_milliseconds();
+	uint8_t taken = 0;
+
+	taskENTER_CRITICAL();
+	uint32_t elapsed = now - logModules[module].lastRefill;
+
+	if (elapsed >= tokenPeriodMs)
+	{
+		uint32_t earned = elapsed / tokenPeriodMs;
+
+		if (logModules[module].tokens + earned >= burst)
+		{
+			logModules[module].tokens = burst;
+			logModules[module].lastRefill = now;
+		}
+		else
+		{
+			// Keep the remainder, so a steady rate earns its tokens.
+			logModules[module].tokens += earned;
+			logModules[module].lastRefill += earned * tokenPeriodMs;
+		}
+	}
+
+	if (logModules[module].tokens > 0)
+	{
+		logModules[module].tokens--;
+		*dropped = logModules[module].dropped;
+		logModules[module].dropped = 0;
+		taken = 1;
+	}
+	else if (logModules[module].dropped < UINT16_MAX)
+		logModules[module].dropped++;
+	taskEXIT_CRITICAL();
+
+	return taken;
+}
+
+/**
+ * Sends a log message to the telemetry port: its ID and the raw bytes of its
+ * arguments, little-endian. No text is formatted on the robot; the host
+ * decoder (tools/telemetry_decoder.c) rebuilds it from log_messages.h.
+ *
+ * The arguments must match the types of the message: 'c', 'b' and 'w' are
+ * passed as int, 'l' as long and 's' as a string in RAM. Arguments that do
+ * not fit in a record are dropped, a string is truncated.
+ *
+ * @param messageId ID of the message.
+ * @param arguments Arguments of the message.
+ */
+static void sendLogMessage(LOG_MESSAGE_ID messageId, va_list arguments)
+{
+	uint8_t payload[TELEMETRY_MAX_PAYLOAD_SIZE];
+	uint8_t length = 0;
+	const char *types = logArgumentTypes[messageId];
+	char type;
+
+	payload[length++] = (uint8_t)messageId;
+	payload[length++] = (uint8_t)(messageId >> 8);
+
+	while ((type = pgm_read_byte(types++)) != '\0')
+	{
+		if (type == 's')
+		{
+			const char *string = va_arg(arguments, const char *);
+
+			// Always terminated, truncated to the room left.
+			while (*string != '\0' && length < sizeof(payload) - 1)
+				payload[length++] = *string++;
+			if (length < sizeof(payload))
+				payload[length++] = '\0';
+			continue;
+		}
+
+		uint32_t value = (type == 'l') ? va_arg(arguments, uint32_t) : (uint16_t)va_arg(arguments, int);
+		uint8_t size = (type == 'l') ? 4 : (type == 'w') ? 2 : 1;
+
+		if (length + size > sizeof(payload))
+			break;
+		for (; size > 0; size--, value >>= 8)
+			payload[length++] = (uint8_t)value;
+	}
+
+	sendTelemetryLog(payload, length);
+}
+
+/**
+ * Sends a log message, bypassing the threshold and the rate limit.
+ *
+ * @param messageId ID of the message, followed by its arguments.
+ */
+static void sendLog(LOG_MESSAGE_ID messageId, ...)
+{
+	va_list arguments;
+
+	va_start(arguments, messageId);
+	sendLogMessage(messageId, arguments);
+	va_end(arguments);
+}
@@ -0,0 +1,87 @@
+#ifndef LOGGING_H_
+#define LOGGING_H_
+
+#include <stdint.h>
+
+#include "log_messages.h"
+
+/**
+ *  Log levels, from the most to the least important. A message is sent when
+ *  its level is at most the threshold of its module.
+ */
+#define LOG_LEVEL_NONE		0
+#define LOG_LEVEL_ERROR		1
+#define LOG_LEVEL_WARNING	2
+#define LOG_LEVEL_INFO		3
+#define LOG_LEVEL_DEBUG		4
+
+typedef uint8_t LOG_LEVEL;
+
+/**
+ *  Highest level compiled in; the log calls of the levels above it compile
+ *  to nothing, with their arguments. Override it from the build
+ *  (-DLOG_COMPILE_LEVEL=4 for the Gainspan command traces).
+ */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL	LOG_LEVEL_INFO
+#endif
+
+/**
+ *  Modules that log. Each entry is LOG_MODULE(identifier, default threshold,
+ *  burst, token period):
+ *  - default threshold : runtime threshold at start-up (see logSetLevel).
+ *  - burst             : messages that can be sent back to back.
+ *  - token period      : ms to earn the right to send one more message.
+ *
+ *  The rate limit keeps a chatty module from filling the TX ring of the
+ *  telemetry port, which would block the task that logs.
+ */
+#define LOG_MODULES \
+	LOG_MODULE(LOG_MODULE_SONAR,      LOG_LEVEL_WARNING, 4,  1000) \
+	LOG_MODULE(LOG_MODULE_GAINSPAN,   LOG_LEVEL_INFO,    16, 50) \
+	LOG_MODULE(LOG_MODULE_WEB_SERVER, LOG_LEVEL_INFO,    8,  250)
+
+typedef enum
+{
+#define LOG_MODULE(identifier, threshold, burst, tokenPeriodMs) identifier,
+	LOG_MODULES
+#undef LOG_MODULE
+	LOG_MODULE_COUNT
+} LOG_MODULE_ID;
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(module, ...)		logModuleMessage(module, LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(module, ...)		do { } while (0)
+#endif
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_WARNING
+#define LOG_WARNING(module, ...)	logModuleMessage(module, LOG_LEVEL_WARNING, __VA_ARGS__)
+#else
+#define LOG_WARNING(module, ...)	do { } while (0)
+#endif
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(module, ...)		logModuleMessage(module, LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(module, ...)		do { } while (0)
+#endif
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(module, ...)		logModuleMessage(module, LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(module, ...)		do { } while (0)
+#endif
+
+/**
+ *  True if a message of the level would be sent by the module (ignoring the
+ *  rate limit); a constant 0 if the level is not compiled in. Guards output
+ *  that is not a log message.
+ */
+#define LOG_ENABLED(module, level)	((level) <= LOG_COMPILE_LEVEL && (level) <= logGetLevel(module))
+
+void logModuleMessage(LOG_MODULE_ID module, LOG_LEVEL level, LOG_MESSAGE_ID messageId, ...);
+void logSetLevel(LOG_MODULE_ID module, LOG_LEVEL level);
+LOG_LEVEL logGetLevel(LOG_MODULE_ID module);
+
+#endif /* LOGGING_H_ */
@@ -6,6 +6,7 @@
 
 /* Scheduler include files. */
 #include "FreeRTOS.h"
+#include "event_groups.h"
 #include "queue.h"
 #include "semphr.h"
 #include "task.h"
@@ -20,6 +21,8 @@
 #include "usart_serial.h"
 #include "distanceHandler.h"
 #include "custom_timer.h"
+#include "telemetry.h"
+#include "logging.h"
 
 /// Global variable that stores the ambient temperature. Created for sharing
 /// information between tasks.
@@ -44,20 +47,37 @@ char previousClientRequest = 'A';
 TaskHandle_t xCommandHandler;
 TaskHandle_t xAttachmentHandler;
 TaskHandle_t xThermoSensorHandler;
+TaskHandle_t xTemperatureHandler;
+TaskHandle_t xDecoderHandler;
+TaskHandle_t xLCDHandler;
+TaskHandle_t xTelemetryHandler;
+TaskHandle_t xWifiEngineHandler;
+TaskHandle_t xWifiHandler;     // NULL once vTaskWifi has deleted itself
 int print_USART;
 
+/// Readiness of the Wi-Fi bring-up (vTaskWifi): tasks depending on the link
+/// wait for these bits instead of delaying for a fixed time.
+EventGroupHandle_t xWifiEvents;
+/// The Gainspan module is activated (wireless network up).
+#define WIFI_LINK_READY   0x01
+/// The web page is configured and the web server started.
+#define WIFI_SERVER_READY 0x02
+
+/// Time between two activation attempts when the module does not come up, in ms.
+#define WIFI_RETRY_PERIOD_MS 5000
+
 /**
  * This method initializes the wifi module by using the wireless_interface class.  Opens the
  * usart port for both the terminal (USART_0), and the wifi (USART_2).  Then it sets the wireless SSID.
- * Finally it activates the wireless connection using the wireless_interface class.
+ * No command is exchanged with the module here: the bring-up is done by vTaskWifi once the
+ * scheduler runs.
  */
 void initializeWifi() {
 	taskENABLE_INTERRUPTS();
-	int terminalUSART = usartOpen(USART_0, BAUD_RATE_115200, portSERIAL_BUFFER_TX, portSERIAL_BUFFER_RX);
-	int wifiUSART = usartOpen(USART_2, BAUD_RATE_9600, portSERIAL_BUFFER_TX, portSERIAL_BUFFER_RX);
+	int terminalUSART = usartOpen(USART_0, BAUD_RATE_115200);
+	int wifiUSART = usartOpen(USART_2, BAUD_RATE_9600);
 	gs_initialize_module(wifiUSART, BAUD_RATE_9600, terminalUSART, BAUD_RATE_115200);
 	gs_set_wireless_ssid("TeamJeffChico");
-	gs_activate_wireless_connection();
 }
 
 /**
@@ -77,6 +97,49 @@ void initializeWebServer() {
 	start_web_server();
 }
 
+/**
+ * The task brings up the wifi module in the background, so that the sensor and
+ * control tasks run from reset instead of waiting for the Gainspan handshake.
+ * It switches the link with the module from 9600 to 115200 baud (it stays at
+ * 9600 if the switch fails), activates the wireless connection (again every
+ * WIFI_RETRY_PERIOD_MS until the module comes up), then starts the web server.
+ * Each phase is logged with its time_in_milliseconds stamp and signalled in
+ * xWifiEvents. The task deletes itself once the web server is started, and
+ * clears xWifiHandler first.
+ *
+ * Its priority is below the control tasks, so the first stamp also tells when
+ * they have all run.
+ *
+ * @param pvParameters Used only for function definition compatibility.
+ */
+void vTaskWifi(void *pvParameters)
+{
+	unsigned long wifiStart = time_in_milliseconds();
+	unsigned long linkReady;
+	uint8_t attempts = 0;
+
+	LOG_INFO(LOG_MODULE_GAINSPAN, LOG_BOOT_WIFI_STARTED, wifiStart);
+
+	gs_set_baud_rate(BAUD_RATE_115200);
+	while (gs_activate_wireless_connection() == GAINSPAN_ACTIVE_FALSE)
+	{
+		attempts++;
+		LOG_WARNING(LOG_MODULE_GAINSPAN, LOG_BOOT_WIFI_RETRY, time_in_milliseconds(), attempts);
+		vTaskDelay(WIFI_RETRY_PERIOD_MS / portTICK_PERIOD_MS);
+	}
+	linkReady = time_in_milliseconds();
+	xEventGroupSetBits(xWifiEvents, WIFI_LINK_READY);
+	LOG_INFO(LOG_MODULE_GAINSPAN, LOG_BOOT_WIFI_LINK_READY, linkReady);
+
+	initializeWebServer();
+	xEventGroupSetBits(xWifiEvents, WIFI_SERVER_READY);
+	LOG_INFO(LOG_MODULE_GAINSPAN, LOG_BOOT_WEB_SERVER_UP, time_in_milliseconds(),
+	         linkReady - wifiStart, time_in_milliseconds() - linkReady);
+
+	xWifiHandler = NULL; // the handle is not valid once the task is deleted
+	vTaskDelete(NULL);
+}
+
 /**
  * The task handles the command mode of chico, it initializes the motion module and
  * the thermoSensor module to mode the head when going forward or backward. Then
@@ -216,7 +279,7 @@ void vTaskWebServer(void *pvParameters)
 	//vTaskSuspend(vTaskAttachmentMode);
 	//vTaskSuspend(vTaskCommandMode);
 
-	vTaskDelay(5500 / portTICK_PERIOD_MS);
+	xEventGroupWaitBits(xWifiEvents, WIFI_SERVER_READY, pdFALSE, pdTRUE, portMAX_DELAY);
 	while (1)
 	{
 		process_client_request();
@@ -342,6 +405,38 @@ void vTaskLCD(void *pvParameters)
     shutdownLCD();
 }
 
+/**
+ * The task responsible for sending the robot's status as binary telemetry
+ * records (see telemetry_protocol.h) on the terminal port, at the rate set
+ * with setTelemetryPeriod.
+ *
+ * @param pvParameters Used only for function definition compatibility.
+ */
+void vTaskTelemetry(void *pvParameters)
+{
+    TickType_t xLastWakeTime;
+    xLastWakeTime = xTaskGetTickCount();
+
+    while (1)
+    {
+        uint32_t ticksLeft;
+        uint32_t ticksRight;
+        // Order of the task states in the TELEMETRY_RECORD_TASKS record
+        TaskHandle_t tasks[] = {xTemperatureHandler, xThermoSensorHandler,
+                                xDecoderHandler, xLCDHandler,
+                                xCommandHandler, xAttachmentHandler};
+
+        getEncoderPeriods(&ticksLeft, &ticksRight);
+        sendTelemetryEncoders(ticksLeft, ticksRight);
+        sendTelemetryMotion(speed, distanceTravelled);
+        sendTelemetryThermal(ambientTemperature, getPixelTemperatures());
+        sendTelemetrySonar(getLastDistance());
+        sendTelemetryTasks(tasks, sizeof(tasks) / sizeof(tasks[0]));
+
+        vTaskDelayUntil(&xLastWakeTime, (getTelemetryPeriod() / portTICK_PERIOD_MS));
+    }
+}
+
 /**
  * The program's starting point. This funtion schedules the task and then
  * surrenders control of the system to the scheduler.
@@ -349,19 +444,29 @@ void vTaskLCD(void *pvParameters)
 int main()
 {
 	initialize_module_timer0();
+	// Before initializeWifi, so that the log messages of the bring-up go to the terminal.
+	setupTelemetry(USART_0);
 	initializeWifi();
-	initializeWebServer();
-	//xTaskCreate(vTaskWebServer, (const portCHAR *)"", 1024, NULL, 1, NULL);
-    xTaskCreate(vTaskTemperature, (const portCHAR *)"", 128, NULL, 3, NULL);
+	xWifiEvents = xEventGroupCreate();
+	// Exchanges the AT commands with the Gainspan module; below the control tasks, so that they keep their
+	// schedule while a command is in flight.
+	xTaskCreate(gs_at_engine_task, (const portCHAR *)"", GS_AT_ENGINE_STACK_SIZE, NULL, 2, &xWifiEngineHandler);
+	// Brings up the module through the engine, below the engine (its stack holds the response lines of the
+	// state queries and the web page configuration).
+	xTaskCreate(vTaskWifi, (const portCHAR *)"", 512, NULL, 1, &xWifiHandler);
+	xTaskCreate(vTaskWebServer, (const portCHAR *)"", 1024, NULL, 1, NULL); // waits for WIFI_SERVER_READY
+    xTaskCreate(vTaskTemperature, (const portCHAR *)"", 128, NULL, 3, &xTemperatureHandler);
 //    xTaskCreate(vTaskMoveChico, (const portCHAR *)"", 256, NULL, 3, NULL);
     xTaskCreate(vTaskMoveThermoSensor, (const portCHAR *)"", 256, NULL, 3, &xThermoSensorHandler);
     //vTaskSuspend(xThermoSensorHandler);
-    xTaskCreate(vTaskDecoder, (const portCHAR *)"", 128, NULL, 3, NULL);
-    xTaskCreate(vTaskLCD, (const portCHAR *)"", 128, NULL, 3, NULL);
+    xTaskCreate(vTaskDecoder, (const portCHAR *)"", 128, NULL, 3, &xDecoderHandler);
+    xTaskCreate(vTaskLCD, (const portCHAR *)"", 128, NULL, 3, &xLCDHandler);
+    xTaskCreate(vTaskTelemetry, (const portCHAR *)"", 256, NULL, 2, &xTelemetryHandler);
 	xTaskCreate(vTaskCommandMode, (const portCHAR *)"", 128, NULL, 3, &xCommandHandler);
 	//vTaskSuspend(xCommandHandler);
 	//xTaskCreate(vTaskAttachmentMode, (const portCHAR *)"", 256, NULL, 3, &xAttachmentHandler);
 	//vTaskSuspend(xAttachmentHandler);
+	LOG_INFO(LOG_MODULE_GAINSPAN, LOG_BOOT_TASKS_CREATED, time_in_milliseconds());
     vTaskStartScheduler();
 }
 
@@ -0,0 +1,142 @@
+/****************************************************************************//*!
+ * \defgroup spscRingModule  Single Producer Single Consumer Ring Module
+ * @{
+******************************************************************************/
+
+/****************************************************************************//*!
+ * \file spsc_ring.c
+ * \date Oct 17 2026
+ * \brief Lock-free single producer / single consumer byte ring buffer.
+ * \details SPSC Ring Module
+ *
+ * The single character operations (spscRingPush, spscRingPop) are inline functions of spsc_ring.h, so the
+ * interrupt service routines do not pay for a call.  This file provides the initialisation and the bulk operations,
+ * which copy a block in at most two contiguous parts and publish the index once.
+ *
+ * The module does not depend on the AVR or on freeRTOS, so the host benchmark (tools/spsc_ring_bench.c) exercises
+ * the same code as the robot.
+ *************************************************************************************************/
+
+#include <string.h>
+
+#include "spsc_ring.h"
+
+/*! Storage of the rings whose size is not valid (one character). */
+static uint8_t spscRingFallback[1];
+
+/*************************************************************************************//*!
+ *  \brief Size of a ring holding at least wanted characters.
+ * @param wanted - number of characters wanted.
+ * @return The smallest power of two not less than wanted, at most SPSC_RING_MAX_SIZE.
+******************************************************************************************/
+uint16_t spscRingRoundSize(uint16_t wanted)
+{
+	uint16_t size = 1;
+
+	while( size < wanted && size < SPSC_RING_MAX_SIZE )
+		size <<= 1;
+	return size;
+}
+
+/*************************************************************************************//*!
+ *  \brief Initialises an empty ring.
+ * @param ring - ring buffer.
+ * @param buffer - storage of the ring (size characters).
+ * @param size - size of the ring, a power of two, at most SPSC_RING_MAX_SIZE (see spscRingRoundSize).
+ * @return 1 on success, 0 if the storage or the size is not valid (the ring then holds a single character, so the
+ * producer and the consumer keep working).
+******************************************************************************************/
+uint8_t spscRingInit(SPSC_RING *ring, uint8_t *buffer, uint16_t size)
+{
+	ring->head = 0;
+	ring->tail = 0;
+
+	if( buffer == NULL || size == 0 || size > SPSC_RING_MAX_SIZE || (size & (size - 1)) != 0 )
+	{
+		ring->buffer = spscRingFallback;
+		ring->mask = 0;
+		return 0;
+	}
+
+	ring->buffer = buffer;
+	ring->mask = size - 1;
+	return 1;
+}
+
+/*************************************************************************************//*!
+ *  \brief Appends a block of characters (producer).
+ * The characters that fit are copied, then published at once.
+ * @param ring - ring buffer.
+ * @param data - characters to append.
+ * @param len - number of characters.
+ * @return Number of characters stored.
+******************************************************************************************/
+uint16_t spscRingPushBulk(SPSC_RING *ring, const uint8_t *data, uint16_t len)
+{
+	SPSC_RING_INDEX head = ring->head;
+	uint16_t size = (uint16_t)ring->mask + 1;
+	uint16_t space = size - spscRingUsed(ring);
+	uint16_t offset = head & ring->mask;
+	uint16_t first;
+
+	if( len > space )
+		len = space;
+
+	first = size - offset;
+	if( first > len )
+		first = len;
+	memcpy(&ring->buffer[offset], data, first);
+	memcpy(ring->buffer, data + first, len - first);
+
+	SPSC_RING_BARRIER(); // the characters are stored before they are published
+	spscRingStore(&ring->head, head + len);
+	return len;
+}
+
+/*************************************************************************************//*!
+ *  \brief Removes a block of characters (consumer).
+ * The characters available are copied, then released at once.
+ * @param ring - ring buffer.
+ * @param data - returns the characters.
+ * @param len - maximum number of characters.
+ * @return Number of characters read.
+******************************************************************************************/
+uint16_t spscRingPopBulk(SPSC_RING *ring, uint8_t *data, uint16_t len)
+{
+	SPSC_RING_INDEX tail = ring->tail;
+	uint16_t count = spscRingCount(ring);
+	uint16_t offset = tail & ring->mask;
+	uint16_t first;
+
+	if( len > count )
+		len = count;
+	if( len == 0 )
+		return 0;
+
+	SPSC_RING_BARRIER(); // the characters are read after head
+	first = (uint16_t)ring->mask + 1 - offset;
+	if( first > len )
+		first = len;
+	memcpy(data, &ring->buffer[offset], first);
+	memcpy(data + first, ring->buffer, len - first);
+
+	SPSC_RING_BARRIER(); // and before their slots are released
+	spscRingStore(&ring->tail, tail + len);
+	return len;
+}
+
+/*************************************************************************************//*!
+ *  \brief Discards the characters in the ring (consumer).
+ * Characters appended by the producer while the ring is flushed may be kept.
+ * @param ring - ring buffer.
+******************************************************************************************/
+void spscRingFlush(SPSC_RING *ring)
+{
+	SPSC_RING_INDEX head = spscRingLoad(&ring->head);
+
+	// A stale head must not move tail backwards.
+	if( SPSC_RING_DISTANCE(head, ring->tail) > 0 )
+		spscRingStore(&ring->tail, head);
+}
+
+/*!@}*/   // End of spscRingModule Group
@@ -0,0 +1,248 @@
+#include <stdint.h>
+#include <util/crc16.h>
+
+#include "telemetry.h"
+#include "custom_timer.h"
+
+/**
+ *  Port the telemetry frames are written to.
+ */
+static USART_ID telemetryUSART;
+
+/**
+ *  Period of the telemetry task, in ms.
+ */
+static volatile uint16_t telemetryPeriodMs = TELEMETRY_PERIOD_MS;
+
+/**
+ *  State of a task. The kernel only provides eTaskGetState with
+ *  INCLUDE_eTaskGetState (or the trace facility) set in FreeRTOSConfig.h;
+ *  without it, the states are reported as unknown instead of failing to link.
+ */
+#if (INCLUDE_eTaskGetState == 1) || (configUSE_TRACE_FACILITY == 1)
+#define telemetryTaskState(task) ((uint8_t)eTaskGetState(task))
+#else
+#define telemetryTaskState(task) TELEMETRY_TASK_STATE_UNKNOWN
+#endif
+
+static void sendTelemetryRecord(TELEMETRY_RECORD_TYPE type, const uint8_t *payload, uint8_t length);
+static uint8_t *putTelemetryWord(uint8_t *buffer, uint16_t value);
+static uint8_t *putTelemetryLong(uint8_t *buffer, uint32_t value);
+static uint8_t encodeTelemetryFrame(const uint8_t *record, uint8_t length, uint8_t *frame);
+
+/**
+ * Selects the port the telemetry frames are written to. The port must have
+ * been opened with usartOpen.
+ *
+ * @param usartId Port used for telemetry (USART_0, the terminal, by default).
+ */
+void setupTelemetry(USART_ID usartId)
+{
+	telemetryUSART = usartId;
+}
+
+/**
+ * Changes the rate at which the telemetry task emits the records.
+ *
+ * @param periodMs Period, in ms (at least one tick).
+ */
+void setTelemetryPeriod(uint16_t periodMs)
+{
+	if (periodMs < portTICK_PERIOD_MS)
+		periodMs = portTICK_PERIOD_MS;
+	telemetryPeriodMs = periodMs;
+}
+
+/**
+ * @return The period of the telemetry task, in ms.
+ */
+uint16_t getTelemetryPeriod()
+{
+	return telemetryPeriodMs;
+}
+
+/**
+ * Sends the periods of the wheel encoders.
+ *
+ * @param leftTicks  Period of the left encoder, in ticks of 0.5 us.
+ * @param rightTicks Period of the right encoder, in ticks of 0.5 us.
+ */
+void sendTelemetryEncoders(uint32_t leftTicks, uint32_t rightTicks)
+{
+	uint8_t payload[8];
+	uint8_t *end = payload;
+
+	end = putTelemetryLong(end, leftTicks);
+	end = putTelemetryLong(end, rightTicks);
+	sendTelemetryRecord(TELEMETRY_RECORD_ENCODERS, payload, end - payload);
+}
+
+/**
+ * Sends the speed and distance travelled, in Q15.16 fixed-point.
+ *
+ * @param speed             Speed of the robot, in `m/s`.
+ * @param distanceTravelled Distance travelled so far, in `m`.
+ */
+void sendTelemetryMotion(float speed, float distanceTravelled)
+{
+	uint8_t payload[8];
+	uint8_t *end = payload;
+
+	end = putTelemetryLong(end, (int32_t)(speed * (1L << TELEMETRY_FIXED_FRACTION_BITS)));
+	end = putTelemetryLong(end, (int32_t)(distanceTravelled * (1L << TELEMETRY_FIXED_FRACTION_BITS)));
+	sendTelemetryRecord(TELEMETRY_RECORD_MOTION, payload, end - payload);
+}
+
+/**
+ * Sends the ambient temperature and the temperature of the 8 pixels.
+ *
+ * @param ambientTemperature Ambient temperature, in `Celsius`.
+ * @param pixelTemperatures  Temperatures of the 8 pixels, in `Celsius`.
+ */
+void sendTelemetryThermal(int ambientTemperature, const int *pixelTemperatures)
+{
+	uint8_t payload[1 + TELEMETRY_THERMAL_PIXELS];
+
+	payload[0] = (uint8_t)ambientTemperature;
+	for (uint8_t pixel = 0; pixel < TELEMETRY_THERMAL_PIXELS; pixel++)
+		payload[1 + pixel] = (uint8_t)pixelTemperatures[pixel];
+	sendTelemetryRecord(TELEMETRY_RECORD_THERMAL, payload, sizeof(payload));
+}
+
+/**
+ * Sends the range measured by the sonar.
+ *
+ * @param distance Range, in `cm`.
+ */
+void sendTelemetrySonar(int distance)
+{
+	uint8_t payload[2];
+
+	putTelemetryWord(payload, (uint16_t)distance);
+	sendTelemetryRecord(TELEMETRY_RECORD_SONAR, payload, sizeof(payload));
+}
+
+/**
+ * Sends the state (eTaskState) of the tasks. Tasks that were not created
+ * (NULL handle) are reported as TELEMETRY_TASK_NOT_CREATED.
+ *
+ * @param tasks Handles of the tasks.
+ * @param count Number of tasks.
+ */
+void sendTelemetryTasks(const TaskHandle_t *tasks, uint8_t count)
+{
+	uint8_t payload[TELEMETRY_MAX_PAYLOAD_SIZE];
+
+	if (count > sizeof(payload) - 1)
+		count = sizeof(payload) - 1;
+
+	payload[0] = count;
+	for (uint8_t task = 0; task < count; task++)
+		payload[1 + task] = (tasks[task] != NULL) ? telemetryTaskState(tasks[task]) : TELEMETRY_TASK_NOT_CREATED;
+	sendTelemetryRecord(TELEMETRY_RECORD_TASKS, payload, 1 + count);
+}
+
+/**
+ * Sends a log message (built by logMessage).
+ *
+ * @param payload Message ID and arguments.
+ * @param length  Length of the payload (at most TELEMETRY_MAX_PAYLOAD_SIZE).
+ */
+void sendTelemetryLog(const uint8_t *payload, uint8_t length)
+{
+	sendTelemetryRecord(TELEMETRY_RECORD_LOG, payload, length);
+}
+
+/**
+ * Builds a record (header, payload and CRC), encodes it in a frame and writes
+ * the frame to the telemetry port as a single message. Log records take the
+ * bulk lane; the periodic state records take the priority lane, so that a
+ * burst of log messages does not delay them.
+ *
+ * @param type    Type of the record.
+ * @param payload Payload of the record.
+ * @param length  Length of the payload (at most TELEMETRY_MAX_PAYLOAD_SIZE).
+ */
+static void sendTelemetryRecord(TELEMETRY_RECORD_TYPE type, const uint8_t *payload, uint8_t length)
+{
+	uint8_t record[TELEMETRY_HEADER_SIZE + TELEMETRY_MAX_PAYLOAD_SIZE + TELEMETRY_CRC_SIZE];
+	uint8_t frame[TELEMETRY_MAX_FRAME_SIZE];
+	uint8_t *end = record;
+	uint16_t crc = 0xFFFF;
+
+	*end++ = type;
+	end = putTelemetryLong(end, time_in_milliseconds());
+	for (uint8_t i = 0; i < length; i++)
+		*end++ = payload[i];
+	for (uint8_t *byte = record; byte < end; byte++)
+		crc = _crc_xmodem_update(crc, *byte);
+	end = putTelemetryWord(end, crc);
+
+	USART_IOV message = {frame, encodeTelemetryFrame(record, end - record, frame), USART_IOV_RAM};
+	usart_xwritev((type == TELEMETRY_RECORD_LOG) ? telemetryUSART : telemetryUSART | USART_TX_PRIORITY, &message, 1);
+}
+
+/**
+ * Stores a 16 bit value, little-endian.
+ *
+ * @return The position following the value.
+ */
+static uint8_t *putTelemetryWord(uint8_t *buffer, uint16_t value)
+{
+	*buffer++ = (uint8_t)value;
+	*buffer++ = (uint8_t)(value >> 8);
+	return buffer;
+}
+
+/**
+ * Stores a 32 bit value, little-endian.
+ *
+ * @return The position following the value.
+ */
+static uint8_t *putTelemetryLong(uint8_t *buffer, uint32_t value)
+{
+	buffer = putTelemetryWord(buffer, (uint16_t)value);
+	return putTelemetryWord(buffer, (uint16_t)(value >> 16));
+}
+
+/**
+ * COBS encodes a record between two frame delimiters. Each 0x00 of the
+ * record is replaced by the distance to the next 0x00 (or to the end of the
+ * block); a code byte of 0xFF marks a block of 254 bytes without 0x00.
+ *
+ * @param record Record to encode.
+ * @param length Length of the record.
+ * @param frame  Encoded frame (at least length + 3 bytes, plus one per 254).
+ * @return The length of the frame, including the delimiters.
+ */
+static uint8_t encodeTelemetryFrame(const uint8_t *record, uint8_t length, uint8_t *frame)
+{
+	uint8_t codeIndex = 1;
+	uint8_t frameIndex = 2;
+	uint8_t code = 1;
+
+	frame[0] = TELEMETRY_FRAME_DELIMITER;
+
+	for (uint8_t i = 0; i < length; i++)
+	{
+		if (record[i] == 0)
+		{
+			frame[codeIndex] = code;
+			codeIndex = frameIndex++;
+			code = 1;
+		}
+		else
+		{
+			frame[frameIndex++] = record[i];
+			if (++code == 0xFF)
+			{
+				frame[codeIndex] = code;
+				codeIndex = frameIndex++;
+				code = 1;
+			}
+		}
+	}
+	frame[codeIndex] = code;
+	frame[frameIndex++] = TELEMETRY_FRAME_DELIMITER;
+	return frameIndex;
+}
@@ -0,0 +1,27 @@
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "usart_serial.h"
+#include "telemetry_protocol.h"
+
+/**
+ *  Default period of the telemetry task, in ms.
+ */
+#define TELEMETRY_PERIOD_MS 100
+
+void setupTelemetry(USART_ID usartId);
+void setTelemetryPeriod(uint16_t periodMs);
+uint16_t getTelemetryPeriod();
+void sendTelemetryEncoders(uint32_t leftTicks, uint32_t rightTicks);
+void sendTelemetryMotion(float speed, float distanceTravelled);
+void sendTelemetryThermal(int ambientTemperature, const int *pixelTemperatures);
+void sendTelemetrySonar(int distance);
+void sendTelemetryTasks(const TaskHandle_t *tasks, uint8_t count);
+void sendTelemetryLog(const uint8_t *payload, uint8_t length);
+
+#endif /* TELEMETRY_H_ */
@@ -0,0 +1,96 @@
+#ifndef TELEMETRY_PROTOCOL_H_
+#define TELEMETRY_PROTOCOL_H_
+
+/**
+ *  Binary telemetry protocol, shared by the robot (telemetry.c) and the host
+ *  decoder (tools/telemetry_decoder.c).
+ *
+ *  Each record is sent as one frame:
+ *
+ *      0x00 COBS( type | time | payload | crc ) 0x00
+ *
+ *  - type    : 1 byte, TELEMETRY_RECORD_TYPE.
+ *  - time    : 4 bytes, time_in_milliseconds() when the record was built.
+ *  - payload : record specific, see below.
+ *  - crc     : 2 bytes, CRC-16/CCITT-FALSE (polynomial 0x1021, initial value
+ *              0xFFFF) of type, time and payload.
+ *
+ *  COBS (Consistent Overhead Byte Stuffing) removes every 0x00 from the frame,
+ *  so 0x00 only appears as the frame delimiter and a decoder can resynchronise
+ *  on it. The leading delimiter ends any text written to the same USART (debug
+ *  prints) before the frame, so the frame is not lost.
+ *
+ *  All multi-byte fields are little-endian.
+ */
+
+#include <stdint.h>
+
+/**
+ *  Frame delimiter.
+ */
+#define TELEMETRY_FRAME_DELIMITER 0x00
+
+/**
+ *  Size of the header of a record (type and time).
+ */
+#define TELEMETRY_HEADER_SIZE 5
+
+/**
+ *  Size of the CRC of a record.
+ */
+#define TELEMETRY_CRC_SIZE 2
+
+/**
+ *  Largest payload of a record.
+ */
+#define TELEMETRY_MAX_PAYLOAD_SIZE 32
+
+/**
+ *  Largest encoded frame: COBS adds one byte per 254 bytes (plus one), and the
+ *  two delimiters.
+ */
+#define TELEMETRY_MAX_FRAME_SIZE \
+	(TELEMETRY_HEADER_SIZE + TELEMETRY_MAX_PAYLOAD_SIZE + TELEMETRY_CRC_SIZE + 3)
+
+/**
+ *  Fraction bits of the fixed-point fields (Q15.16).
+ */
+#define TELEMETRY_FIXED_FRACTION_BITS 16
+
+/**
+ *  Number of pixels of the thermal sensor.
+ */
+#define TELEMETRY_THERMAL_PIXELS 8
+
+/**
+ *  Task states of TELEMETRY_RECORD_TASKS besides the eTaskState values: task
+ *  not created, and state not available (kernel built without
+ *  INCLUDE_eTaskGetState).
+ */
+#define TELEMETRY_TASK_NOT_CREATED 0xFF
+#define TELEMETRY_TASK_STATE_UNKNOWN 0xFE
+
+/**
+ *  Record types and their payload.
+ */
+typedef enum
+{
+	/** uint32 left, uint32 right: encoder periods, in ticks of 0.5 us. */
+	TELEMETRY_RECORD_ENCODERS = 1,
+	/** int32 speed (m/s), int32 distance travelled (m), Q15.16. */
+	TELEMETRY_RECORD_MOTION = 2,
+	/** uint8 ambient, uint8 pixels[8]: temperatures, in Celsius. */
+	TELEMETRY_RECORD_THERMAL = 3,
+	/** int16 range, in cm (-1 if no echo was received). */
+	TELEMETRY_RECORD_SONAR = 4,
+	/** uint8 count, then count x uint8 state (eTaskState,
+	 *  TELEMETRY_TASK_NOT_CREATED or TELEMETRY_TASK_STATE_UNKNOWN), in the
+	 *  order of vTaskTelemetry: temperature, thermo sensor, decoder, LCD,
+	 *  command mode, attachment mode. */
+	TELEMETRY_RECORD_TASKS = 5,
+	/** uint16 message ID (LOG_MESSAGE_ID), then the arguments of the message,
+	 *  see log_messages.h. */
+	TELEMETRY_RECORD_LOG = 6
+} TELEMETRY_RECORD_TYPE;
+
+#endif /* TELEMETRY_PROTOCOL_H_ */
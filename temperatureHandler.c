@@ -168,6 +168,17 @@ int getRightAverageTemperature()
     return pixelTemperatureSum / 4;
 }
 
+/**
+ * Returns the temperatures of the 8 pixels, as last read by the temperature
+ * handlers.
+ *
+ * @return The shared `pixelTemperatures` array, in Celsius.
+ */
+const int *getPixelTemperatures()
+{
+    return pixelTemperatures;
+}
+
 /**
  *  Reads the ambient temperature.
  *
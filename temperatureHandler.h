@@ -7,6 +7,7 @@ int getRight3AvgTemperatures();
 int getCenter4AvgTemperatures();
 int getAmbientTemperature();
 int getSignificantTemperature();
+const int *getPixelTemperatures();
 
 void setupTemperature();
 void updateTemperatures(int *ambientTemperature, int *leftAverageTemperature, int *rightAverageTemperature);
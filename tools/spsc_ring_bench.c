@@ -0,0 +1,241 @@
+/*
+ * spsc_ring_bench.c
+ *
+ * Host (Linux) benchmark of the reception ring of usart_serial (spsc_ring.h),
+ * built from the same sources as the robot.
+ *
+ * 1. Cost: time per character of spscRingPush/spscRingPop and of the bulk
+ *    operations, next to a ring keeping a shared count (the layout of the
+ *    previous ringBuffer.h). The count is timed twice: unprotected, which is
+ *    only correct in one thread, and updated atomically, standing for the
+ *    critical section the task needs around it on the AVR.
+ * 2. Concurrency: a thread standing for the reception ISR pushes a numbered
+ *    sequence in bursts while the main thread, standing for the task, pops it
+ *    with single and bulk reads. Every character is checked, so a
+ *    character lost, duplicated or read before it was stored is reported. The
+ *    indices are read and written whole, as the interrupt-protected accesses
+ *    of the AVR guarantee, so a stale index of the other side is exercised.
+ *
+ * Build:   gcc -O2 -pthread -I.. -o spsc_ring_bench spsc_ring_bench.c ../spsc_ring.c
+ *          (add -DSPSC_RING_INDEX_BITS=8 for the 8 bit indices)
+ * Usage:   spsc_ring_bench [characters]
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "spsc_ring.h"
+
+/**
+ *  Size of the rings (largest allowed with 8 bit indices).
+ */
+#define BENCH_RING_SIZE 64
+
+/**
+ *  Characters of the default run.
+ */
+#define BENCH_CHARACTERS 20000000UL
+
+/**
+ *  Ring keeping a shared count, as ringBuffer.h.
+ */
+typedef struct
+{
+	uint8_t *in;
+	uint8_t *out;
+	uint8_t *start;
+	uint8_t *end;
+	uint16_t size;
+	volatile uint16_t count;
+} COUNTED_RING;
+
+static SPSC_RING ring;
+static uint8_t ringStorage[BENCH_RING_SIZE];
+static unsigned long characters = BENCH_CHARACTERS;
+
+static double now()
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static void countedPoke(COUNTED_RING *counted, uint8_t data)
+{
+	*counted->in++ = data;
+	if (counted->in == counted->end)
+		counted->in = counted->start;
+	counted->count++;
+}
+
+static uint8_t countedPop(COUNTED_RING *counted)
+{
+	uint8_t data = *counted->out++;
+
+	if (counted->out == counted->end)
+		counted->out = counted->start;
+	counted->count--;
+	return data;
+}
+
+/**
+ * Count updated as the task of the robot must: the decrement is not
+ * interrupted by the producer (portENTER_CRITICAL on the AVR, a locked
+ * instruction on the host).
+ */
+static void countedPokeLocked(COUNTED_RING *counted, uint8_t data)
+{
+	*counted->in++ = data;
+	if (counted->in == counted->end)
+		counted->in = counted->start;
+	__atomic_fetch_add(&counted->count, 1, __ATOMIC_SEQ_CST);
+}
+
+static uint8_t countedPopLocked(COUNTED_RING *counted)
+{
+	uint8_t data = *counted->out++;
+
+	if (counted->out == counted->end)
+		counted->out = counted->start;
+	__atomic_fetch_sub(&counted->count, 1, __ATOMIC_SEQ_CST);
+	return data;
+}
+
+/**
+ * Times the single and bulk operations, in one thread.
+ */
+static void benchmark()
+{
+	COUNTED_RING counted = { ringStorage, ringStorage, ringStorage, ringStorage + BENCH_RING_SIZE, BENCH_RING_SIZE, 0 };
+	uint8_t block[BENCH_RING_SIZE / 2];
+	volatile uint8_t sink = 0;
+	uint8_t data;
+	double start;
+
+	start = now();
+	for (unsigned long i = 0; i < characters; i++)
+	{
+		if (counted.count < counted.size)
+			countedPoke(&counted, (uint8_t)i);
+		if (counted.count > 0)
+			sink += countedPop(&counted);
+	}
+	printf("counted ring, push/pop: %6.2f ns/character (count not protected)\n", (now() - start) * 1e9 / characters);
+
+	counted.in = counted.out = counted.start;
+	counted.count = 0;
+	start = now();
+	for (unsigned long i = 0; i < characters; i++)
+	{
+		if (counted.count < counted.size)
+			countedPokeLocked(&counted, (uint8_t)i);
+		if (counted.count > 0)
+			sink += countedPopLocked(&counted);
+	}
+	printf("counted ring, locked:   %6.2f ns/character\n", (now() - start) * 1e9 / characters);
+
+	spscRingInit(&ring, ringStorage, BENCH_RING_SIZE);
+	start = now();
+	for (unsigned long i = 0; i < characters; i++)
+	{
+		spscRingPush(&ring, (uint8_t)i);
+		if (spscRingPop(&ring, &data))
+			sink += data;
+	}
+	printf("SPSC ring, push/pop:    %6.2f ns/character\n", (now() - start) * 1e9 / characters);
+
+	spscRingInit(&ring, ringStorage, BENCH_RING_SIZE);
+	start = now();
+	for (unsigned long i = 0; i < characters; i += sizeof(block))
+	{
+		spscRingPushBulk(&ring, block, sizeof(block));
+		sink += spscRingPopBulk(&ring, block, sizeof(block));
+	}
+	printf("SPSC ring, bulk (%u):   %6.2f ns/character\n", (unsigned)sizeof(block), (now() - start) * 1e9 / characters);
+	(void)sink;
+}
+
+/**
+ * Stands for the reception ISR: pushes the sequence 0, 1, 2... (modulo 251,
+ * so it does not line up with the ring) in bursts, retrying when full.
+ */
+static void *producer(void *argument)
+{
+	unsigned long sent = 0;
+
+	(void)argument;
+	while (sent < characters)
+	{
+		unsigned burst = 1 + (sent % 7);
+
+		while (burst-- && sent < characters)
+		{
+			if (spscRingPush(&ring, (uint8_t)(sent % 251)))
+				sent++;
+			else
+				sched_yield(); // full: let the task run (single core hosts)
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Stands for the task: pops the sequence with single and bulk reads and
+ * checks it.
+ *
+ * @return The number of characters out of sequence.
+ */
+static unsigned long consume()
+{
+	uint8_t block[BENCH_RING_SIZE];
+	unsigned long received = 0;
+	unsigned long errors = 0;
+
+	while (received < characters)
+	{
+		uint16_t count;
+
+		if ((received & 1) == 0)
+			count = spscRingPop(&ring, &block[0]);
+		else
+			count = spscRingPopBulk(&ring, block, 1 + (received % sizeof(block)));
+		if (count == 0)
+			sched_yield(); // empty: let the ISR run (single core hosts)
+
+		for (uint16_t i = 0; i < count; i++, received++)
+		{
+			if (block[i] != (uint8_t)(received % 251))
+				errors++;
+		}
+	}
+	return errors;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t thread;
+	unsigned long errors;
+	double start;
+
+	if (argc > 1)
+		characters = strtoul(argv[1], NULL, 0);
+
+	printf("%d bit indices, ring of %d characters, %lu characters\n",
+	       SPSC_RING_INDEX_BITS, BENCH_RING_SIZE, characters);
+	benchmark();
+
+	spscRingInit(&ring, ringStorage, BENCH_RING_SIZE);
+	start = now();
+	pthread_create(&thread, NULL, producer, NULL);
+	errors = consume();
+	pthread_join(thread, NULL);
+	printf("concurrent ISR/task: %lu characters in %.2f s, %lu out of sequence, %u left\n",
+	       characters, now() - start, errors, spscRingCount(&ring));
+
+	return errors ? 1 : 0;
+}
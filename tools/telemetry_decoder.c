@@ -0,0 +1,374 @@
+/*
+ * telemetry_decoder.c
+ *
+ * Host (Linux) decoder for the binary telemetry stream of the robot, see
+ * telemetry_protocol.h. Frames are read from a serial device (configured as
+ * 115200 8N1, raw) or from a capture file / standard input, and each valid
+ * record is written as one CSV line on standard output. Log records are
+ * rebuilt as text from the dictionary of log_messages.h (message column).
+ * Text written to the same port (debug prints) and damaged frames are
+ * skipped; their count is reported on standard error at the end.
+ *
+ * Build:   gcc -O2 -I.. -o telemetry_decoder telemetry_decoder.c
+ * Usage:   telemetry_decoder [/dev/ttyUSB0 | capture.bin] > telemetry.csv
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "telemetry_protocol.h"
+#include "log_messages.h"
+
+/**
+ *  Largest frame accepted before the delimiter; longer runs are not telemetry.
+ */
+#define DECODER_FRAME_SIZE 256
+
+/**
+ *  Largest log message, once rebuilt.
+ */
+#define DECODER_MESSAGE_SIZE 512
+
+static unsigned long framesDecoded = 0;
+static unsigned long framesSkipped = 0;
+
+/**
+ *  Dictionary of the log messages, indexed by LOG_MESSAGE_ID.
+ */
+static const struct
+{
+	const char *types;
+	const char *format;
+} logMessages[LOG_MESSAGE_COUNT] =
+{
+#define LOG_MESSAGE(identifier, types, format) { types, format },
+	LOG_MESSAGES
+#undef LOG_MESSAGE
+};
+
+/**
+ * Configures a serial device as 115200 8N1, raw. Files and pipes are left
+ * unchanged.
+ */
+static void configurePort(int fd)
+{
+	struct termios tty;
+
+	if (!isatty(fd) || tcgetattr(fd, &tty) != 0)
+		return;
+	cfmakeraw(&tty);
+	cfsetispeed(&tty, B115200);
+	cfsetospeed(&tty, B115200);
+	tty.c_cflag |= CLOCAL | CREAD;
+	tty.c_cc[VMIN] = 1;
+	tty.c_cc[VTIME] = 0;
+	tcsetattr(fd, TCSANOW, &tty);
+}
+
+/**
+ * CRC-16/CCITT-FALSE update, same as _crc_xmodem_update of avr-libc.
+ */
+static uint16_t crcUpdate(uint16_t crc, uint8_t data)
+{
+	crc ^= (uint16_t)data << 8;
+	for (int bit = 0; bit < 8; bit++)
+		crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	return crc;
+}
+
+/**
+ * COBS decodes a frame (without its delimiter).
+ *
+ * @return The length of the record, or -1 if the frame is malformed.
+ */
+static int decodeFrame(const uint8_t *frame, int length, uint8_t *record)
+{
+	int in = 0;
+	int out = 0;
+
+	while (in < length)
+	{
+		uint8_t code = frame[in++];
+
+		if (code == 0 || in + code - 1 > length)
+			return -1;
+		for (int i = 1; i < code; i++)
+			record[out++] = frame[in++];
+		if (code != 0xFF && in < length)
+			record[out++] = 0;
+	}
+	return out;
+}
+
+static uint16_t getWord(const uint8_t *buffer)
+{
+	return (uint16_t)(buffer[0] | (buffer[1] << 8));
+}
+
+static uint32_t getLong(const uint8_t *buffer)
+{
+	return getWord(buffer) | ((uint32_t)getWord(buffer + 2) << 16);
+}
+
+static double getFixed(const uint8_t *buffer)
+{
+	return (int32_t)getLong(buffer) / (double)(1L << TELEMETRY_FIXED_FRACTION_BITS);
+}
+
+/**
+ * Rebuilds the text of a log message from its format and the raw bytes of its
+ * arguments (see log_messages.h). Each conversion of the format takes the
+ * next argument; integers are widened to long according to the conversion
+ * (signed for %d and %i), so the length modifiers of the format are ignored.
+ *
+ * @return 0, or -1 if the arguments do not match the message.
+ */
+static int formatLogMessage(const uint8_t *payload, int payloadLength, char *text, size_t size)
+{
+	uint16_t id = getWord(payload);
+	const char *types;
+	const char *format;
+	const uint8_t *argument = payload + 2;
+	const uint8_t *end = payload + payloadLength;
+	size_t length = 0;
+
+	if (id >= LOG_MESSAGE_COUNT)
+		return -1;
+	types = logMessages[id].types;
+	format = logMessages[id].format;
+	text[0] = '\0';
+
+	while (*format != '\0' && length < size - 1)
+	{
+		char specification[32];
+		size_t specificationLength = 0;
+		char conversion;
+
+		if (*format != '%' || format[1] == '%')
+		{
+			text[length++] = *format;
+			format += (*format == '%') ? 2 : 1;
+			continue;
+		}
+
+		/* Flags, width and precision are kept, length modifiers dropped. */
+		specification[specificationLength++] = *format++;
+		while (*format != '\0' && strchr("-+ #0123456789.", *format) != NULL && specificationLength < sizeof(specification) - 3)
+			specification[specificationLength++] = *format++;
+		while (*format == 'h' || *format == 'l')
+			format++;
+		if ((conversion = *format++) == '\0' || *types == '\0')
+			return -1;
+
+		if (*types == 's')
+		{
+			const uint8_t *terminator = memchr(argument, '\0', end - argument);
+			char string[TELEMETRY_MAX_PAYLOAD_SIZE + 1];
+			size_t stringLength = (terminator != NULL) ? (size_t)(terminator - argument) : (size_t)(end - argument);
+
+			/* Line breaks of the robot would break the CSV line. */
+			for (size_t i = 0; i < stringLength; i++)
+				string[i] = (argument[i] == '\r' || argument[i] == '\n') ? ' ' : (char)argument[i];
+			string[stringLength] = '\0';
+			argument += stringLength + (terminator != NULL);
+			specification[specificationLength++] = 's';
+			specification[specificationLength] = '\0';
+			length += snprintf(text + length, size - length, specification, string);
+		}
+		else
+		{
+			int argumentSize = (*types == 'l') ? 4 : (*types == 'w') ? 2 : 1;
+			uint32_t value = 0;
+
+			if (end - argument < argumentSize)
+				return -1;
+			for (int i = argumentSize - 1; i >= 0; i--)
+				value = (value << 8) | argument[i];
+			argument += argumentSize;
+
+			if (conversion == 'c')
+			{
+				specification[specificationLength++] = 'c';
+				specification[specificationLength] = '\0';
+				length += snprintf(text + length, size - length, specification, (int)value);
+			}
+			else if (conversion == 'd' || conversion == 'i')
+			{
+				long signedValue = (argumentSize == 4) ? (long)(int32_t)value
+				                 : (argumentSize == 2) ? (long)(int16_t)value : (long)(int8_t)value;
+
+				specification[specificationLength++] = 'l';
+				specification[specificationLength++] = conversion;
+				specification[specificationLength] = '\0';
+				length += snprintf(text + length, size - length, specification, signedValue);
+			}
+			else
+			{
+				specification[specificationLength++] = 'l';
+				specification[specificationLength++] = conversion;
+				specification[specificationLength] = '\0';
+				length += snprintf(text + length, size - length, specification, (unsigned long)value);
+			}
+		}
+		types++;
+		if (length > size - 1)
+			length = size - 1;
+	}
+	text[length] = '\0';
+	return 0;
+}
+
+/**
+ * Writes a string as a CSV field, quoted.
+ */
+static void printQuoted(const char *text)
+{
+	putchar('"');
+	for (; *text != '\0'; text++)
+	{
+		if (*text == '"')
+			putchar('"');
+		putchar(*text);
+	}
+	putchar('"');
+}
+
+/**
+ * Writes a decoded record as a CSV line. Columns that do not apply to the
+ * record are left empty.
+ *
+ * @return 0, or -1 if the payload length does not match the record type.
+ */
+static int printRecord(const uint8_t *record, int length)
+{
+	const uint8_t *payload = record + TELEMETRY_HEADER_SIZE;
+	int payloadLength = length - TELEMETRY_HEADER_SIZE;
+	uint32_t time = getLong(record + 1);
+
+	switch (record[0])
+	{
+	case TELEMETRY_RECORD_ENCODERS:
+		if (payloadLength != 8)
+			return -1;
+		printf("%lu,encoders,%lu,%lu,,,,,,,,,,,,,,\n", (unsigned long)time,
+		       (unsigned long)getLong(payload), (unsigned long)getLong(payload + 4));
+		break;
+	case TELEMETRY_RECORD_MOTION:
+		if (payloadLength != 8)
+			return -1;
+		printf("%lu,motion,,,%.4f,%.4f,,,,,,,,,,,,\n", (unsigned long)time,
+		       getFixed(payload), getFixed(payload + 4));
+		break;
+	case TELEMETRY_RECORD_THERMAL:
+		if (payloadLength != 1 + TELEMETRY_THERMAL_PIXELS)
+			return -1;
+		printf("%lu,thermal,,,,,%u", (unsigned long)time, payload[0]);
+		for (int pixel = 0; pixel < TELEMETRY_THERMAL_PIXELS; pixel++)
+			printf(",%u", payload[1 + pixel]);
+		printf(",,,\n");
+		break;
+	case TELEMETRY_RECORD_SONAR:
+		if (payloadLength != 2)
+			return -1;
+		printf("%lu,sonar,,,,,,,,,,,,,,%d,,\n", (unsigned long)time, (int16_t)getWord(payload));
+		break;
+	case TELEMETRY_RECORD_TASKS:
+		if (payloadLength < 1 || payloadLength != 1 + payload[0])
+			return -1;
+		printf("%lu,tasks,,,,,,,,,,,,,,,", (unsigned long)time);
+		for (int task = 0; task < payload[0]; task++)
+			printf("%s%u", task ? ";" : "", payload[1 + task]);
+		printf(",\n");
+		break;
+	case TELEMETRY_RECORD_LOG:
+	{
+		char text[DECODER_MESSAGE_SIZE];
+
+		if (payloadLength < 2 || formatLogMessage(payload, payloadLength, text, sizeof(text)) != 0)
+			return -1;
+		printf("%lu,log,,,,,,,,,,,,,,,,", (unsigned long)time);
+		printQuoted(text);
+		printf("\n");
+		break;
+	}
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Checks and prints one frame.
+ */
+static void processFrame(const uint8_t *frame, int length)
+{
+	uint8_t record[DECODER_FRAME_SIZE];
+	uint16_t crc = 0xFFFF;
+	int recordLength = decodeFrame(frame, length, record);
+
+	if (recordLength < TELEMETRY_HEADER_SIZE + TELEMETRY_CRC_SIZE)
+	{
+		framesSkipped++;
+		return;
+	}
+	recordLength -= TELEMETRY_CRC_SIZE;
+	for (int i = 0; i < recordLength; i++)
+		crc = crcUpdate(crc, record[i]);
+	if (crc != getWord(record + recordLength) || printRecord(record, recordLength) != 0)
+	{
+		framesSkipped++;
+		return;
+	}
+	framesDecoded++;
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	uint8_t frame[DECODER_FRAME_SIZE];
+	uint8_t buffer[512];
+	int frameLength = 0;
+	int overflow = 0;
+	int fd = STDIN_FILENO;
+	ssize_t count;
+
+	if (argc > 1 && (fd = open(argv[1], O_RDONLY | O_NOCTTY)) < 0)
+	{
+		fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+		return 1;
+	}
+	configurePort(fd);
+
+	printf("time_ms,record,left_ticks,right_ticks,speed_mps,distance_m,ambient_c,"
+	       "pixel0_c,pixel1_c,pixel2_c,pixel3_c,pixel4_c,pixel5_c,pixel6_c,pixel7_c,"
+	       "sonar_cm,task_states,message\n");
+
+	while ((count = read(fd, buffer, sizeof(buffer))) > 0)
+	{
+		for (ssize_t i = 0; i < count; i++)
+		{
+			if (buffer[i] != TELEMETRY_FRAME_DELIMITER)
+			{
+				if (frameLength < DECODER_FRAME_SIZE)
+					frame[frameLength++] = buffer[i];
+				else
+					overflow = 1;
+				continue;
+			}
+			if (overflow)
+				framesSkipped++;
+			else if (frameLength > 0)
+				processFrame(frame, frameLength);
+			frameLength = 0;
+			overflow = 0;
+		}
+	}
+
+	fprintf(stderr, "%lu records decoded, %lu frames skipped\n", framesDecoded, framesSkipped);
+	return 0;
+}
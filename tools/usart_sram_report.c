@@ -0,0 +1,111 @@
+/*
+ * usart_sram_report.c
+ *
+ * Host (Linux) report of the SRAM used by the buffers of each USART, read
+ * from the link map of the robot (avr-gcc -Wl,-Map=robot.map).
+ *
+ * usart_serial.c places the ring buffers of each USART listed in
+ * USART_BUFFER_TABLE in its own section, .bss.usart_arena.USART_n, so the
+ * map gives the exact size of each arena after alignment. The control
+ * structures (usartComBuf, one entry per USART) are reported too when the
+ * objects are built with -fdata-sections (section .bss.usartComBuf).
+ *
+ * Build:   gcc -O2 -o usart_sram_report usart_sram_report.c
+ * Usage:   usart_sram_report robot.map
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ *  Prefix of the sections holding the arenas.
+ */
+#define ARENA_SECTION ".bss.usart_arena."
+
+/**
+ *  Section of the control structures (with -fdata-sections).
+ */
+#define COM_BUF_SECTION ".bss.usartComBuf"
+
+/**
+ *  Number of USARTs of the ATmega2560 (entries of usartComBuf).
+ */
+#define NUM_USARTS 4
+
+/**
+ * Reads the size of an input section of the map. The size follows the
+ * address, on the line of the section name or, when the name is long, on the
+ * next line.
+ *
+ * @param map  Map file, positioned after the line of the name.
+ * @param rest Rest of the line of the name.
+ * @return The size in bytes, 0 if not found.
+ */
+static unsigned long sectionSize(FILE *map, const char *rest)
+{
+	char line[512];
+	unsigned long address, size;
+
+	if (sscanf(rest, " %lx %lx", &address, &size) == 2)
+		return size;
+	if (fgets(line, sizeof(line), map) != NULL && sscanf(line, " %lx %lx", &address, &size) == 2)
+		return size;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	char line[512];
+	char name[64];
+	unsigned long total = 0, comBuf = 0;
+	unsigned arenas = 0;
+	FILE *map;
+
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: %s robot.map\n", argv[0]);
+		return 2;
+	}
+	map = fopen(argv[1], "r");
+	if (map == NULL)
+	{
+		perror(argv[1]);
+		return 2;
+	}
+
+	printf("%-10s %8s\n", "USART", "bytes");
+	while (fgets(line, sizeof(line), map) != NULL)
+	{
+		char *section = line;
+		int length;
+
+		// Input sections are indented by one space.
+		if (*section++ != ' ' || sscanf(section, "%63s%n", name, &length) != 1)
+			continue;
+
+		if (strncmp(name, ARENA_SECTION, strlen(ARENA_SECTION)) == 0)
+		{
+			unsigned long size = sectionSize(map, section + length);
+
+			printf("%-10s %8lu\n", name + strlen(ARENA_SECTION), size);
+			total += size;
+			arenas++;
+		}
+		else if (strcmp(name, COM_BUF_SECTION) == 0)
+			comBuf = sectionSize(map, section + length);
+	}
+	fclose(map);
+
+	if (arenas == 0)
+	{
+		fprintf(stderr, "no %s* section in %s\n", ARENA_SECTION, argv[1]);
+		return 1;
+	}
+	printf("%-10s %8lu\n", "arenas", total);
+	if (comBuf > 0)
+		printf("%-10s %8lu (%lu per USART)\n", "usartComBuf", comBuf, comBuf / NUM_USARTS);
+	else
+		printf("usartComBuf not in its own section (build with -fdata-sections)\n");
+	return 0;
+}
@@ -0,0 +1,249 @@
+/*
+ * usart_tx_bench.c
+ *
+ * Host (Linux) benchmark of the transmission of usart_serial when the
+ * transmit ring is full: CPU time of the writing task while the rendered
+ * Gainspan web page is pushed through USART_2 at 9600 baud.
+ *
+ * A thread stands for the transmit ISR: it takes one character out of the
+ * ring per character time (10 bits at the baud rate). The main thread stands
+ * for the task writing the page, character by character, as
+ * usartTxStreamWrite does. When the ring is full it either:
+ *
+ * 1. delays 4 x 25 us (busy) and drops the character if the ring is still
+ *    full - usart_xputChar / usart_xwritev;
+ * 2. delays 4 x 25 us (busy) and tries again until the character fits - what
+ *    a caller of usart_xputChar needs not to lose the page;
+ * 3. sleeps until the ISR has freed TX_LOW_WATER characters or the ring is
+ *    empty, for at most the timeout - usart_xwritevWait (usartTxWait).
+ *
+ * The CPU time of the writing thread is the time the other tasks of the
+ * robot (temperature, decoders) would not get. The characters dropped are
+ * reported too; the run fails if the blocking write drops any.
+ *
+ * Build:   gcc -O2 -pthread -o usart_tx_bench usart_tx_bench.c
+ * Usage:   usart_tx_bench [baud]
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ *  Transmit ring of USART_2 (USART_BUFFER_TABLE, usart_serial.h) and the
+ *  free space waking a blocked task (TX_LOW_WATER, usart_serial.c).
+ */
+#define BENCH_RING_SIZE 256
+#define BENCH_LOW_WATER (BENCH_RING_SIZE >> 2)
+
+/**
+ *  Page written: WEB_PAGE_RENDERED_SIZE, the rendered page at its largest.
+ */
+#define BENCH_PAGE_LENGTH 768
+
+/**
+ *  Busy delay of usartTxStreamWrite on a full ring (4 x _delay_us(25)) and
+ *  timeout of gs_write_data_to_socket for the blocking write.
+ */
+#define BENCH_DELAY_NS 100000L
+#define BENCH_TIMEOUT_NS 500000000L
+
+typedef enum
+{
+	WRITE_DELAY_DROP,
+	WRITE_DELAY_RETRY,
+	WRITE_WAIT
+} WRITE_MODE;
+
+typedef struct
+{
+	double wall;
+	double cpu;
+	unsigned dropped;
+} WRITE_RESULT;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; // interrupts disabled
+static pthread_cond_t notification = PTHREAD_COND_INITIALIZER; // task notification
+static unsigned ringCount;
+static int waiting;
+static int writing;
+static long characterNs;
+
+static double now(clockid_t clock)
+{
+	struct timespec time;
+
+	clock_gettime(clock, &time);
+	return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static void addNs(struct timespec *time, long ns)
+{
+	time->tv_nsec += ns;
+	while (time->tv_nsec >= 1000000000L)
+	{
+		time->tv_nsec -= 1000000000L;
+		time->tv_sec++;
+	}
+}
+
+/**
+ * Stands for usart_tx_isr: one character leaves per character time, and the
+ * waiting task is notified once TX_LOW_WATER characters are free or the ring
+ * is empty.
+ */
+static void *transmitter(void *argument)
+{
+	struct timespec next;
+	int running = 1;
+
+	(void)argument;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (running)
+	{
+		addNs(&next, characterNs);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+		pthread_mutex_lock(&lock);
+		if (ringCount > 0)
+			ringCount--;
+		if (waiting && (BENCH_RING_SIZE - ringCount >= BENCH_LOW_WATER || ringCount == 0))
+		{
+			waiting = 0;
+			pthread_cond_signal(&notification);
+		}
+		running = writing || ringCount > 0;
+		pthread_mutex_unlock(&lock);
+	}
+	return NULL;
+}
+
+/**
+ * Appends a character if the ring has room.
+ */
+static int push()
+{
+	int pushed = 0;
+
+	pthread_mutex_lock(&lock);
+	if (ringCount < BENCH_RING_SIZE)
+	{
+		ringCount++;
+		pushed = 1;
+	}
+	pthread_mutex_unlock(&lock);
+	return pushed;
+}
+
+/**
+ * Busy delay, as _delay_us: the CPU is not given up.
+ */
+static void delay()
+{
+	double end = now(CLOCK_MONOTONIC) + BENCH_DELAY_NS * 1e-9;
+
+	while (now(CLOCK_MONOTONIC) < end)
+		;
+}
+
+/**
+ * Stands for usartTxWait: sleeps until notified or timed out.
+ */
+static void wait()
+{
+	struct timespec deadline;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	addNs(&deadline, BENCH_TIMEOUT_NS);
+	pthread_mutex_lock(&lock);
+	waiting = 1;
+	while (waiting && BENCH_RING_SIZE - ringCount < BENCH_LOW_WATER)
+	{
+		if (pthread_cond_timedwait(&notification, &lock, &deadline) != 0)
+			break;
+	}
+	waiting = 0;
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Writes the page, then waits for the ring to be empty (the page on the
+ * wire), so the wall time is the time of the transmission.
+ */
+static WRITE_RESULT writePage(WRITE_MODE mode)
+{
+	WRITE_RESULT result = { 0.0, 0.0, 0 };
+	pthread_t thread;
+	double wallStart = now(CLOCK_MONOTONIC);
+	double cpuStart = now(CLOCK_THREAD_CPUTIME_ID);
+	double cpuWritten;
+
+	ringCount = 0;
+	writing = 1;
+	pthread_create(&thread, NULL, transmitter, NULL);
+
+	for (unsigned i = 0; i < BENCH_PAGE_LENGTH; i++)
+	{
+		if (push())
+			continue;
+		if (mode == WRITE_WAIT)
+		{
+			wait();
+			if (!push())
+				result.dropped++;
+		}
+		else if (mode == WRITE_DELAY_RETRY)
+		{
+			do
+				delay();
+			while (!push());
+		}
+		else
+		{
+			delay();
+			if (!push())
+				result.dropped++;
+		}
+	}
+	cpuWritten = now(CLOCK_THREAD_CPUTIME_ID);
+
+	pthread_mutex_lock(&lock);
+	writing = 0;
+	pthread_mutex_unlock(&lock);
+	pthread_join(thread, NULL);
+
+	result.wall = now(CLOCK_MONOTONIC) - wallStart;
+	result.cpu = cpuWritten - cpuStart;
+	return result;
+}
+
+static void report(const char *name, WRITE_RESULT result)
+{
+	printf("%-28s %7.1f ms on the wire, %7.2f ms CPU (%5.1f%%), %3u characters dropped\n",
+	       name, result.wall * 1e3, result.cpu * 1e3, 100.0 * result.cpu / result.wall, result.dropped);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long baud = 9600;
+	WRITE_RESULT drop, retry, block;
+
+	if (argc > 1)
+		baud = strtoul(argv[1], NULL, 0);
+	characterNs = (long)(10 * 1000000000.0 / baud);
+
+	printf("page of %d characters, ring of %d characters (low water %d), %lu baud\n",
+	       BENCH_PAGE_LENGTH, BENCH_RING_SIZE, BENCH_LOW_WATER, baud);
+	drop = writePage(WRITE_DELAY_DROP);
+	report("delay, then drop:", drop);
+	retry = writePage(WRITE_DELAY_RETRY);
+	report("delay, retry until sent:", retry);
+	block = writePage(WRITE_WAIT);
+	report("sleep on notification:", block);
+	printf("CPU saved by sleeping: %.2f ms per page against retrying (%.2f ms against dropping %u characters)\n",
+	       (retry.cpu - block.cpu) * 1e3, (drop.cpu - block.cpu) * 1e3, drop.dropped);
+
+	return block.dropped ? 1 : 0;
+}
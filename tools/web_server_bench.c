@@ -0,0 +1,366 @@
+/*
+ * web_server_bench.c
+ *
+ * Host (Linux) throughput test of the web server connection table
+ * (web_connections.h), built from the same sources as the robot.
+ *
+ * N simulated clients send requests to the web server through a simulated
+ * Gainspan module: CONNECT lines and request fragments in ESC S frames of
+ * the clients are interleaved in one stream, which the server reads in
+ * random sizes (a read may end anywhere in a line or a frame). The server
+ * loop is the one of process_client_request: read, then serve the ready
+ * connections in turn, reading again between two pages. The time on the
+ * wire of each page (bulk data frame, acknowledgement and close) is counted
+ * at the baud rate of the module, so the pages per second are those of the
+ * serial link, not of the host.
+ *
+ * Every request is checked: served once, to its client, with its choice,
+ * and the answer of the module to each page (ESC O) is found by the parser.
+ * The fairness bound is checked too: once its request is complete, a client
+ * waits for at most WEB_CONNECTIONS_MAXIMUM - 1 pages of other clients.
+ *
+ * Build:   gcc -O2 -I.. -o web_server_bench web_server_bench.c ../web_connections.c
+ *          (add -DWEB_CONNECTIONS_MAXIMUM=1 for one client at a time)
+ * Usage:   web_server_bench [clients] [requests per client]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "web_connections.h"
+
+/**
+ *  Default run.
+ */
+#define BENCH_CLIENTS 8
+#define BENCH_REQUESTS 200
+
+/**
+ *  Page sent to each client (rendered page of the robot, HTTP header included).
+ */
+#define BENCH_PAGE_LENGTH 565
+
+/**
+ *  Baud rate of the module and characters of a page on the wire: ESC Z <CID>
+ *  <4 digit length>, the page, ESC O, ESC S <CID> ESC C.
+ */
+#define BENCH_BAUD 115200
+#define BENCH_PAGE_WIRE (7 + BENCH_PAGE_LENGTH + 2 + 5)
+
+/**
+ *  CIDs of the module (hexadecimal digit), 0 being the server.
+ */
+#define BENCH_CIDS 16
+
+/**
+ *  Request time out (ms), WEB_SERVER_REQUEST_TIMEOUT_IN_MILLISECONDS.
+ */
+#define BENCH_REQUEST_TIMEOUT 2000
+
+/**
+ *  Stream from the module, read by the server.
+ */
+#define BENCH_STREAM_SIZE 65536
+
+typedef enum
+{
+	CLIENT_IDLE,		// thinking, or waiting to connect again after being refused
+	CLIENT_SENDING,		// connected, sending the fragments of its request
+	CLIENT_WAITING		// request sent, waiting for the page
+} CLIENT_STATE;
+
+typedef struct
+{
+	CLIENT_STATE state;
+	uint8_t cid;
+	char choice;
+	unsigned fragment;
+	unsigned requests;
+	double nextTime;		// time of the next action (ms)
+	double sentTime;		// time the request was sent (ms)
+	long readyPage;			// pages served when the server saw the request complete, -1 before
+} CLIENT;
+
+static const char request[] = "GET /?c=%c HTTP/1.1\r\nHost: 192.168.3.1\r\nAccept: text/html\r\n\r\n";
+static const unsigned fragments = 3;
+
+static WEB_CONNECTIONS table;
+static CLIENT *clients;
+static unsigned clientCount = BENCH_CLIENTS;
+static unsigned requestsPerClient = BENCH_REQUESTS;
+static int cidClient[BENCH_CIDS];		// client using each CID of the module, -1 if free
+
+static uint8_t stream[BENCH_STREAM_SIZE];
+static unsigned streamLength;
+
+static double simulatedTime;			// ms
+static long pagesServed;
+static unsigned long refused, timedOut, errors, bytesParsed;
+static double latencyTotal, latencyMax;
+static long overtakesMax;
+static double parseSeconds;
+
+static double now()
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static void append(const char *data, unsigned length)
+{
+	if (streamLength + length > sizeof(stream))
+	{
+		fprintf(stderr, "stream full\n");
+		exit(2);
+	}
+	memcpy(stream + streamLength, data, length);
+	streamLength += length;
+}
+
+static char hexDigit(uint8_t value)
+{
+	return "0123456789ABCDEF"[value & 0x0f];
+}
+
+/**
+ * The server closes a connection (ESC S <CID> ESC C): the module frees the
+ * CID and the client connects again after a while.
+ */
+static void closeCid(uint8_t cid, double delay)
+{
+	int client = cidClient[cid];
+
+	cidClient[cid] = -1;
+	if (client >= 0)
+	{
+		clients[client].state = CLIENT_IDLE;
+		clients[client].nextTime = simulatedTime + delay;
+	}
+}
+
+/**
+ * Line handler, as gs_route_unsolicited_event: CONNECT <server> <client> and
+ * DISCONNECT <CID>.
+ */
+static void routeLine(char *line)
+{
+	unsigned server, cid;
+
+	if (sscanf(line, "CONNECT %x %x", &server, &cid) == 2)
+	{
+		if (!web_connections_open(&table, (uint8_t)cid, (uint32_t)simulatedTime))
+		{
+			refused++;
+			closeCid((uint8_t)cid, 20 + rand() % 30);
+		}
+	}
+	else if (sscanf(line, "DISCONNECT %x", &cid) == 1)
+		web_connections_close(&table, (uint8_t)cid);
+	else
+		errors++;
+}
+
+/**
+ * The clients whose time has come act, in random order so that their data
+ * is interleaved: connect, send a fragment of the request, or nothing.
+ */
+static void clientsAct()
+{
+	unsigned start = rand() % clientCount;
+
+	for (unsigned i = 0; i < clientCount; i++)
+	{
+		unsigned index = (start + i) % clientCount;
+		CLIENT *client = &clients[index];
+		char text[128];
+		unsigned length;
+
+		if (client->nextTime > simulatedTime || client->requests >= requestsPerClient)
+			continue;
+
+		if (client->state == CLIENT_IDLE)
+		{
+			uint8_t cid;
+
+			for (cid = 1; cid < BENCH_CIDS && cidClient[cid] >= 0; cid++)
+				;
+			if (cid == BENCH_CIDS)
+				continue;	// all the CIDs of the module in use
+			cidClient[cid] = index;
+			client->cid = cid;
+			client->state = CLIENT_SENDING;
+			client->fragment = 0;
+			client->choice = "FRLS"[rand() % 4];
+			length = sprintf(text, "CONNECT 0 %c 192.168.3.%u %u\r\n", hexDigit(cid), 2 + index, 5000 + client->requests);
+			append(text, length);
+			client->nextTime = simulatedTime + 1 + rand() % 5;
+		}
+		else if (client->state == CLIENT_SENDING)
+		{
+			unsigned total = sprintf(text, request, client->choice);
+			unsigned from = total * client->fragment / fragments;
+			unsigned to = total * (client->fragment + 1) / fragments;
+			char frame[3] = { 0x1b, 'S', hexDigit(client->cid) };
+
+			append(frame, sizeof(frame));
+			append(text + from, to - from);
+			append("\x1b" "E", 2);
+			if (++client->fragment == fragments)
+			{
+				client->state = CLIENT_WAITING;
+				client->sentTime = simulatedTime;
+				client->readyPage = -1;
+			}
+			client->nextTime = simulatedTime + 1 + rand() % 5;
+		}
+	}
+}
+
+/**
+ * Reads the stream, in random sizes, as gs_receive_client_data.
+ */
+static void receive()
+{
+	unsigned offset = 0;
+	double start = now();
+
+	while (offset < streamLength)
+	{
+		unsigned length = 1 + rand() % 128;
+
+		if (length > streamLength - offset)
+			length = streamLength - offset;
+		web_connections_receive(&table, stream + offset, length, routeLine);
+		offset += length;
+	}
+	parseSeconds += now() - start;
+	bytesParsed += streamLength;
+	streamLength = 0;
+
+	// Pages served so far when the server sees the request complete.
+	for (unsigned i = 0; i < WEB_CONNECTIONS_MAXIMUM; i++)
+	{
+		WEB_CONNECTION *connection = &table.connections[i];
+
+		if (connection->state == WEB_CONNECTION_READY && cidClient[connection->cid] >= 0 &&
+				clients[cidClient[connection->cid]].readyPage < 0)
+			clients[cidClient[connection->cid]].readyPage = pagesServed;
+	}
+}
+
+/**
+ * Serves a ready connection, as gs_serve_client, and checks the request.
+ */
+static void serve(uint8_t index)
+{
+	WEB_CONNECTION *connection = &table.connections[index];
+	uint8_t cid = connection->cid;
+	int owner = cidClient[cid];
+	const char *get = strstr(connection->request, "GET");
+	CLIENT *client;
+	double latency;
+
+	if (owner < 0 || clients[owner].state != CLIENT_WAITING || get == NULL || strlen(get) <= 8 ||
+			get[5] != '?' || get[8] != clients[owner].choice)
+	{
+		errors++;
+		web_connections_close(&table, cid);
+		closeCid(cid, 0);
+		return;
+	}
+	client = &clients[owner];
+	if (pagesServed - client->readyPage > overtakesMax)
+		overtakesMax = pagesServed - client->readyPage;
+
+	simulatedTime += BENCH_PAGE_WIRE * 10000.0 / BENCH_BAUD + 2;	// wire time of the page and answer of the module
+	pagesServed++;
+	// The answer is read through the parser, behind the data of the other clients (gs_wait_data_acknowledgement).
+	web_connections_acknowledgement(&table);
+	append("\x1b" "O", 2);
+	receive();
+	if (web_connections_acknowledgement(&table) != WEB_CONNECTIONS_ACKNOWLEDGEMENT_OK)
+		errors++;
+	latency = simulatedTime - client->sentTime;
+	latencyTotal += latency;
+	if (latency > latencyMax)
+		latencyMax = latency;
+	client->requests++;
+
+	web_connections_close(&table, cid);
+	closeCid(cid, rand() % 50);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long expected;
+	double start;
+
+	if (argc > 1)
+		clientCount = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		requestsPerClient = strtoul(argv[2], NULL, 0);
+	if (clientCount == 0 || requestsPerClient == 0)
+	{
+		fprintf(stderr, "usage: %s [clients] [requests per client]\n", argv[0]);
+		return 2;
+	}
+	expected = (unsigned long)clientCount * requestsPerClient;
+
+	clients = calloc(clientCount, sizeof(CLIENT));
+	for (unsigned cid = 0; cid < BENCH_CIDS; cid++)
+		cidClient[cid] = -1;
+	srand(1);
+	web_connections_initialize(&table);
+
+	start = now();
+	while ((unsigned long)pagesServed < expected)
+	{
+		uint8_t index;
+
+		// process_client_request: read, then at most one page per connection.
+		clientsAct();
+		receive();
+		for (unsigned pages = 0; pages < WEB_CONNECTIONS_MAXIMUM; pages++)
+		{
+			index = web_connections_next_ready(&table);
+			if (index == WEB_CONNECTION_NONE)
+				break;
+			serve(index);
+			clientsAct();
+			receive();
+		}
+		while ((index = web_connections_expired(&table, (uint32_t)simulatedTime, BENCH_REQUEST_TIMEOUT)) != WEB_CONNECTION_NONE)
+		{
+			uint8_t cid = table.connections[index].cid;
+
+			timedOut++;
+			web_connections_close(&table, cid);
+			closeCid(cid, 0);
+		}
+		simulatedTime += 1;	// the task sleeps until data arrives
+		if (simulatedTime > expected * 1000.0)
+		{
+			fprintf(stderr, "stalled after %ld pages\n", pagesServed);
+			errors++;
+			break;
+		}
+	}
+
+	printf("%u clients, %u requests each, %d connections, page of %d characters at %d baud\n",
+	       clientCount, requestsPerClient, WEB_CONNECTIONS_MAXIMUM, BENCH_PAGE_LENGTH, BENCH_BAUD);
+	printf("served:    %ld pages in %.2f s, %.2f pages/s\n", pagesServed, simulatedTime / 1000, pagesServed * 1000 / simulatedTime);
+	printf("latency:   %.1f ms mean, %.1f ms max (request sent to page sent)\n",
+	       pagesServed ? latencyTotal / pagesServed : 0, latencyMax);
+	printf("fairness:  %ld pages of other clients at most (bound %d)\n", overtakesMax, WEB_CONNECTIONS_MAXIMUM - 1);
+	printf("refused:   %lu connections, %lu timed out, %lu errors\n", refused, timedOut, errors);
+	printf("parser:    %.2f ns/character on the host (%lu characters), run %.2f s\n",
+	       bytesParsed ? parseSeconds * 1e9 / bytesParsed : 0, bytesParsed, now() - start);
+
+	free(clients);
+	return (errors || timedOut || overtakesMax > WEB_CONNECTIONS_MAXIMUM - 1) ? 1 : 0;
+}
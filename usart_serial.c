@@ -14,7 +14,8 @@
  *
  * Both interrupt driven and polling functions are available.
  *
- * Uses freeRTOS ring buffers to support interrupt functions.
+ * Uses ring buffers to support interrupt functions: the reception ring is the lock-free single producer / single
+ * consumer ring of spsc_ring.h (filled by the reception ISR without disabling interrupts).
  *
  * Design Principles
  *
@@ -40,8 +41,13 @@
  * 1. usartReg (array of USART_REGISTERS) - provides pointers to the USART hardware module registers.
  * 2. usartComBuf (array of USART_COM_BUF) - provides a set of buffers for each arrays to support communications.
  * Buffering is important for supporting transmission/reception using interrupts.  Two ring buffers (xRxedChars and
- * xCharsForTx) are used to buffer received characters and to buffer characters for transmission.  A work buffer
- * (serialWorkBuffer) is used to format strings for transmission (using the Unix/Linux printf style).
+ * xCharsForTx) are used to buffer received characters and to buffer characters for transmission.  An optional third
+ * ring (xPriorityTx) holds the messages written with USART_TX_PRIORITY, sent ahead of the waiting bulk messages.  Their storage is
+ * a static arena per USART, sized at compile time by USART_BUFFER_TABLE (usart_serial.h), rather than heap memory,
+ * so opening and closing a USART cannot fragment the freeRTOS heap.  Strings are
+ * formatted (using the Unix/Linux printf style) directly into a reservation of the transmission ring buffer
+ * (the stream of the transmit ring), or directly to the USART data register for the polling functions (pollStream), so no work buffer
+ * is needed.
  *
  * Functions
  *
@@ -72,6 +78,15 @@
  *    - usart_xfprintf_P(USART_ID usartID, ...)
  *
  * Note that printf can be replace by other names (e.g. print to print an unformatted string).
+ *
+ * Messages made of several parts (e.g. a frame header, a payload and a trailer) can be queued with
+ * usart_xwritev(USART_ID usartID, const USART_IOV *iov, uint8_t iovcnt) which copies all the segments
+ * (stored in RAM or program memory) into the transmission ring buffer in a single pass.
+ *
+ * Hardware flow control (RTS/CTS) can be added to a USART with usart_xsetFlowControl, using two GPIO pins since
+ * the Atmega2560 USARTs have none: the reception ISR raises RTS when the reception ring buffer reaches its
+ * high-water mark and the reading task lowers it once the ring buffer has drained, while the transmit ISR pauses
+ * while the peer holds CTS high and a pin change interrupt resumes it.
  *************************************************************************************************/
 
 #include <stdio.h>
@@ -87,38 +102,98 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "queue.h"
-
-#include "ringBuffer.h"
+#include "semphr.h"
 
 #include "bit_definitions.h"
+#include "spsc_ring.h"
 #include "usart_serial.h"
 
+#if configTASK_NOTIFICATION_ARRAY_ENTRIES <= USART_NOTIFY_INDEX
+#error "usart_serial: configTASK_NOTIFICATION_ARRAY_ENTRIES must be larger than USART_NOTIFY_INDEX (FreeRTOSConfig.h)"
+#endif
+
 
 /*---------------------------------------------------------------------
  Local data structures
 ----------------------------------------------------------------------*/
 
 //--------------------- Definitions -----------------------------------
+#define RX_LINE_INDEX_SIZE	8	// number of complete lines indexed by the reception ISR (power of two)
+#define RX_LINE_WAIT	(-2)	// usartRxWait: wait for a complete line instead of a delimiter
+#define RX_IDLE_WAIT	(-3)	// usartRxRead/usartRxWait: wait for the end of the message (idle gap) instead of a delimiter
+#define RX_IDLE_TICK_CYCLES	(64UL * 256UL)	// CPU cycles per TIMER0 compare B interrupt (prescaler 64, 8 bit, see custom_timer.c)
+#define TX_MESSAGE_INDEX_SIZE	4	// number of message ends indexed per transmit ring (power of two)
 
 /******************************************************************************//*!
- * \brief Defines the state of the USART.
- *********************************************************************************/
-typedef enum
+ *  \brief Transmit ring buffer supporting reservations.
+ *
+ * Tasks write at head and the transmit ISR reads at tail.  A task reserves the free space following head,
+ * writes (or formats) the message in place and commits it by advancing head, so the ISR never sees a partial
+ * message.  One slot is always kept empty to tell a full ring from an empty one.
+ *
+ * A USART has a bulk ring and optionally a small priority ring (lane), each with its own mutex, so a priority
+ * message is not held up by a task writing a long bulk message.  A message longer than the free space is committed
+ * in parts, so the end of each complete message (head when the writing task releases the ring) is recorded in a
+ * small index: the transmit ISR only switches lanes at those boundaries.
+ *
+ * Line oriented peers (e.g. AT command responses) can be read with usart_xreadLine once a terminator is set with
+ * usart_xsetLineTerminator: the reception ISR then indexes the end of each line, so a complete line is popped
+ * without scanning and the reading task only wakes when a line is complete.
+ **********************************************************************************/
+typedef struct
 {
-	USART_VACANT,//!< USART is available for access
-	USART_ENGAGED//!< USART is engaged by another task.
-} USART_STATE;
+	uint8_t *buffer;			//!< Storage of the ring (arena of the USART)
+	uint16_t size;				//!< Size of the storage (capacity plus one)
+	volatile uint16_t head;		//!< Index where the next committed character is written (updated by tasks)
+	volatile uint16_t tail;		//!< Index of the next character to transmit (updated by the transmit ISR)
+	uint16_t reserved;			//!< Number of characters in the open reservation
+	uint16_t used;				//!< Number of characters written in the open reservation by the transmit stream
+	FILE stream;				//!< Stream formatting directly into the open reservation.
+	SemaphoreHandle_t mutex;	//!< Mutex (priority inheritance) preventing interleaving of messages by multiple tasks.
+	TickType_t timeout;			//!< Ticks the task holding the ring may block on a full ring (0 - delay then drop).
+	volatile TaskHandle_t waitingTask;	//!< Task blocked on a full ring, notified by the transmit ISR.
+	uint16_t messageEnd[TX_MESSAGE_INDEX_SIZE];	//!< head after each complete message not transmitted yet.
+	volatile uint8_t messageHead;	//!< Next free entry of messageEnd (updated by the tasks, wraps).
+	volatile uint8_t messageTail;	//!< Oldest entry of messageEnd (updated by the ISR, wraps).
+	uint8_t atBoundary;			//!< The ISR has transmitted a complete message (no message started).
+} USART_TX_RING;
 
 /******************************************************************************//*!
  *  \brief Structure of buffers to support communications with a USART.
  **********************************************************************************/
 typedef struct
 {
-	ringBuffer_t xRxedChars;  //!< Buffer for receiving characters  (Space allocated on the heap)
-	ringBuffer_t xCharsForTx;  //!< Buffer for transmitting characters (space allocated on the heap)
-	uint8_t *workBuffer; //!< create a working buffer pointer, to later be malloc() on the heap.
-	uint16_t workBufferSize; //!< size of working buffer as created on the heap.
-	USART_STATE	workBufferInUse;	//!< flag to prevent overwriting by multiple tasks using the same USART.
+	SPSC_RING xRxedChars;  //!< Buffer for receiving characters, filled by the reception ISR (arena of the USART)
+	USART_TX_RING xCharsForTx;  //!< Buffer for transmitting characters (arena of the USART)
+	USART_TX_RING xPriorityTx;  //!< Priority lane, drained first by the transmit ISR (arena of the USART, size 0 - none)
+	uint8_t txLane;	//!< Ring the transmit ISR is draining (USART_TX_PRIORITY - xPriorityTx, 0 - xCharsForTx).
+	uint16_t txPriorityDelay;	//!< Characters of xCharsForTx transmitted while the priority message waits.
+	FILE pollStream;	//!< Stream formatting directly to the USART data register (polling).
+	USART_LOCK_STATS txLockStats;	//!< Contention statistics of the transmit mutexes.
+	USART_STATS stats;	//!< Health counters (updated by the ISRs and the transmit path).
+	volatile TaskHandle_t rxWaitingTask;	//!< Task blocked in usart_xread/usart_xreadUntil, notified by the reception ISR.
+	volatile uint16_t rxThreshold;	//!< Number of received characters waking rxWaitingTask.
+	volatile int16_t rxDelimiter;	//!< Character waking rxWaitingTask (-1 - none).
+	volatile int16_t rxLineTerminator;	//!< Character ending a line, indexed by the reception ISR (-1 - no line index).
+	SPSC_RING_INDEX rxLineEnd[RX_LINE_INDEX_SIZE];	//!< Head of xRxedChars just after each terminator not read yet (line index).
+	volatile uint8_t rxLineHead;	//!< Next free entry of rxLineEnd (updated by the ISR, wraps).
+	volatile uint8_t rxLineTail;	//!< Oldest entry of rxLineEnd (updated by the tasks, wraps).
+	volatile SPSC_RING_INDEX rxUnindexedEnd;	//!< Index of xRxedChars up to which terminators may be missing from the line index (index full).
+	volatile uint8_t *rtsPort;	//!< Port register of the RTS output (NULL - no reception flow control).
+	uint8_t rtsMask;	//!< Bit of RTS in rtsPort (high - stop sending).
+	volatile uint8_t rxStopped;	//!< RTS raised by the reception ISR, lowered by the reading task.
+	uint16_t rtsHighWater;	//!< Characters in xRxedChars raising RTS.
+	uint16_t rtsLowWater;	//!< Characters in xRxedChars lowering RTS.
+	volatile uint8_t *ctsPin;	//!< Input register of the CTS input (NULL - no transmission flow control).
+	uint8_t ctsMask;	//!< Bit of CTS in ctsPin (high - pause the transmission).
+	volatile uint8_t *ctsPcmsk;	//!< Pin change mask register of CTS.
+	uint8_t ctsPcint;	//!< Bit of CTS in ctsPcmsk.
+	uint8_t rxIdleCharacterTimes;	//!< Idle gap ending a message, in character times (0 - no end of message detection).
+	uint8_t rxIdleTicks;	//!< Idle gap in TIMER0 compare B periods (rxIdleCharacterTimes at the current bit rate).
+	volatile uint8_t rxIdleCountdown;	//!< Periods left before the line is idle, restarted by each character (0 - idle).
+	volatile uint8_t rxIdleWake;	//!< rxWaitingTask also waits for the end of the message.
+	volatile uint8_t txDraining;	//!< Characters sent by the transmit ISR since the transmission was last found complete.
+	volatile TaskHandle_t txFlushTask;	//!< Task blocked in usart_xflushTx, notified by the transmit complete ISR.
 } USART_COM_BUF;
 
 /******************************************************************************//*!
@@ -145,6 +220,7 @@ typedef struct
 #define U2X_BIT		BIT1
 // UCSR_B
 #define RXCIE_BIT 	BIT7
+#define TXCIE_BIT 	BIT6
 #define UDRIE_BIT   BIT5
 #define RXEN_BIT 	BIT4
 #define TXEN_BIT    BIT3
@@ -154,6 +230,10 @@ typedef struct
 //------------------------------------------Data structures------------------------------------
 #define NUM_USARTS 4 // number of USARTS
 
+#define TX_LOW_WATER(size)	((size) >> 2) // free space waking a task blocked on a full transmit ring
+#define RTS_HIGH_WATER(size)	((size) - ((size) >> 2)) // characters received raising RTS (room left for the peer to react)
+#define RTS_LOW_WATER(size)	((size) >> 2) // characters received lowering RTS
+
 /******************************************************************************//*!
  *  Array of USART_REGISTERS structures that defines the references to the registers of all four USARTS.
  * Use the enum USART_ID identifiers as indices into the array.
@@ -173,6 +253,40 @@ USART_REGISTERS usartReg[] =
   *************************************************************************************************/
 USART_COM_BUF usartComBuf[NUM_USARTS];  // One set of buffer structures per USART
 
+/******************************************************************************//*!
+ *  Static arenas holding the ring buffers of the USARTs listed in USART_BUFFER_TABLE.  Each arena has its own
+ * section (.bss.usart_arena.USART_n, gathered in .bss by the linker), so the link map gives the SRAM used by each
+ * USART (see tools/usart_sram_report.c).
+  *************************************************************************************************/
+#define USART_BUFFERS(usartId, txSize, rxSize, priorityTxSize) \
+	static struct { uint8_t rx[rxSize]; uint8_t tx[txSize]; uint8_t priorityTx[priorityTxSize]; } usartArena_##usartId \
+		__attribute__ ((section(".bss.usart_arena." #usartId))); \
+	_Static_assert( ((rxSize) & ((rxSize) - 1)) == 0 && (rxSize) <= SPSC_RING_MAX_SIZE, \
+		#usartId ": the reception ring size must be a power of two, at most SPSC_RING_MAX_SIZE" );
+USART_BUFFER_TABLE
+#undef USART_BUFFERS
+
+/******************************************************************************//*!
+ *  Storage of the ring buffers of each USART, in program memory (NULL - USART not in USART_BUFFER_TABLE).
+ * Use the enum USART_ID identifiers as indices into the array.
+  *************************************************************************************************/
+static const struct
+{
+	uint8_t *rx;		//!< Storage of the reception ring
+	uint16_t rxSize;	//!< Size of the reception ring (power of two)
+	uint8_t *tx;		//!< Storage of the transmit ring
+	uint16_t txSize;	//!< Size of the transmit ring (capacity plus one)
+	uint8_t *priorityTx;	//!< Storage of the priority transmit ring
+	uint16_t priorityTxSize;	//!< Size of the priority transmit ring (capacity plus one, 0 - no priority lane)
+} usartArenas[NUM_USARTS] PROGMEM =
+{
+#define USART_BUFFERS(usartId, txSize, rxSize, priorityTxSize) \
+	[usartId] = { usartArena_##usartId.rx, rxSize, usartArena_##usartId.tx, txSize, \
+			usartArena_##usartId.priorityTx, priorityTxSize },
+	USART_BUFFER_TABLE
+#undef USART_BUFFERS
+};
+
 /******************************************************************************//*!
  *  Default USART
  * Can be changed using setDefaultUSART()
@@ -193,12 +307,36 @@ void usart_fprintf_P_arg(USART_ID usartId, PGM_P format, va_list arg);
 void usart_xfprintf_arg(USART_ID usartId, const char * format, va_list arg);
 void usart_xfprintf_P_arg(USART_ID usartId, PGM_P format, va_list arg);
 
+// Transmit ring buffer
+void usartTxOpen(USART_ID usartId, USART_TX_RING *ring, uint8_t *buffer, uint16_t size, uint8_t lane);
+USART_TX_RING *usartTxLane(USART_ID *usartId);
+void usartTxLock(USART_ID usartId, USART_TX_RING *ring);
+void usartTxUnlock(USART_TX_RING *ring);
+uint16_t usartTxFree(USART_TX_RING *ring);
+uint16_t usartTxReserve(USART_TX_RING *ring, uint16_t wanted, USART_TX_SPAN *span);
+void usartTxCommit(USART_ID usartId, USART_TX_RING *ring, uint16_t used);
+UBaseType_t usartTxStreamWrite(USART_ID usartId, USART_TX_RING *ring, uint8_t character);
+int usartTxStreamPut(char character, FILE *stream);
+int usartPollStreamPut(char character, FILE *stream);
+void usartTxWait(USART_TX_RING *ring);
+UBaseType_t usartTxComplete(USART_ID usartId);
+
+// Reception ring buffer
+UBaseType_t usartRxLinePending(USART_ID usartId);
+uint16_t usartRxRead(USART_ID usartId, uint8_t *buf, uint16_t len, int16_t delim, TickType_t xTicksToWait);
+void usartRxWait(USART_ID usartId, uint16_t threshold, int16_t delim, TickType_t xTicksToWait);
+void usartRxResume(USART_ID usartId);
+void usartRxIdleTicks(USART_ID usartId);
+
 // Interrupt section
 void xmitInterrupt_On(USART_ID );
 void xmitInterrupt_Off(USART_ID );
 
 void usart_rx_isr(USART_ID );
 void usart_tx_isr(USART_ID );
+void usart_txc_isr(USART_ID );
+void usart_cts_isr(void);
+void usart_idle_isr(void);
 
 
 /*===============================================================================================================
@@ -212,34 +350,41 @@ void usart_tx_isr(USART_ID );
 /*************************************************************************************//*!
  * \brief Open a connection on a USART.
  *
- * Sets up the connection for both transmission and reception.  All buffers for supporting communications are allocated
- * and control registers of the USARTS initialised for both transmission and reception.
+ * Sets up the connection for both transmission and reception.  The ring buffers are attached to the static arena of
+ * the USART (sizes set by USART_BUFFER_TABLE) and control registers of the USARTS initialised for both transmission
+ * and reception.  No memory is allocated.
  *
  * @param usartId - USART identifier.
  * @param ulWantedBaud - USART bit rate (units of bits/second)
- * @param uxTxQueueLength - length of the transmission ring buffer (also sets the length of the work buffer)
- * @param uxRxQueueLength - length of the reception ring buffer
  * @return Usart identifier.
 ******************************************************************************************/
 
-USART_ID usartOpen(USART_ID usartId, uint32_t ulWantedBaud, uint16_t uxTxQueueLength, uint16_t uxRxQueueLength )
+USART_ID usartOpen(USART_ID usartId, uint32_t ulWantedBaud)
 {
-	uint8_t * dataPtr;
-
-	/* Create the ring-buffers for the USART. */
-	if( (dataPtr = (uint8_t *)pvPortMalloc( sizeof(uint8_t) * uxRxQueueLength )))
-		ringBuffer_InitBuffer( &(usartComBuf[usartId].xRxedChars), dataPtr, uxRxQueueLength);
-
-	if( (dataPtr = (uint8_t *)pvPortMalloc( sizeof(uint8_t) * uxTxQueueLength )))
-		ringBuffer_InitBuffer( &(usartComBuf[usartId].xCharsForTx), dataPtr, uxTxQueueLength);
-
-	// create a working buffer for vsnprintf on the heap (so we can use extended RAM, if available).
-	// create the structures on the heap (so they can be moved later).
-	if( !(usartComBuf[usartId].workBuffer = (uint8_t *)pvPortMalloc( sizeof(uint8_t) * uxTxQueueLength )))
-		usartComBuf[usartId].workBuffer = NULL;
-
-	usartComBuf[usartId].workBufferSize = uxTxQueueLength; // size of the working buffer for vsnprintf
-	usartComBuf[usartId].workBufferInUse = USART_VACANT;  // clear the occupation flag.
+	/* Attach the ring-buffers to the arena of the USART. */
+	spscRingInit( &(usartComBuf[usartId].xRxedChars), (uint8_t *)pgm_read_ptr(&usartArenas[usartId].rx),
+			pgm_read_word(&usartArenas[usartId].rxSize) );
+	usartTxOpen( usartId, &(usartComBuf[usartId].xCharsForTx), (uint8_t *)pgm_read_ptr(&usartArenas[usartId].tx),
+			pgm_read_word(&usartArenas[usartId].txSize), 0 );
+	usartTxOpen( usartId, &(usartComBuf[usartId].xPriorityTx), (uint8_t *)pgm_read_ptr(&usartArenas[usartId].priorityTx),
+			pgm_read_word(&usartArenas[usartId].priorityTxSize), USART_TX_PRIORITY );
+	usartComBuf[usartId].txLane = 0;
+	usartComBuf[usartId].txPriorityDelay = 0;
+
+	// Stream used by the polling printf functions to format without a work buffer.
+	fdev_setup_stream( &(usartComBuf[usartId].pollStream), usartPollStreamPut, NULL, _FDEV_SETUP_WRITE );
+	fdev_set_udata( &(usartComBuf[usartId].pollStream), (void *)(uintptr_t)usartId );
+
+	usart_clearLockStats(usartId);
+	usart_clearStats(usartId);
+	usartComBuf[usartId].rxWaitingTask = NULL;
+	usartComBuf[usartId].rxLineTerminator = -1;
+	usartComBuf[usartId].rxIdleCharacterTimes = 0;
+	usartComBuf[usartId].rxIdleTicks = 0;
+	usartComBuf[usartId].rxIdleCountdown = 0;
+	usartComBuf[usartId].rxIdleWake = 0;
+	usartComBuf[usartId].txDraining = 0;
+	usartComBuf[usartId].txFlushTask = NULL;
 
 	portENTER_CRITICAL();  // Disable interrupts during configuration
 	/*
@@ -279,31 +424,152 @@ USART_ID usartOpen(USART_ID usartId, uint32_t ulWantedBaud, uint16_t uxTxQueueLe
  *****************************************************************************************/
 void setDefaultUSART(USART_ID usartId) { defaultUSART = usartId; }
 
+/*************************************************************************************//*!
+ * \brief Change the bit rate of an open USART.
+ *
+ * The ring buffers are kept.  The characters already queued for transmission (both lanes) are sent at the current
+ * bit rate first (for at most one second, see usart_xflushTx), then the bit rate register is updated.  Used to switch a peer to a higher
+ * speed once it has acknowledged the change (e.g. Gainspan ATB=).  The ring indexes are only read by usart_xflushTx,
+ * inside a critical section.
+ * @param usartId - USART identifier.
+ * @param ulWantedBaud - new USART bit rate (units of bits/second, 9600 or more).
+ * @return pdPASS if the queued characters were sent at the previous bit rate, pdFAIL if the flush timed out (the bit
+ * rate is changed anyway, the rest goes out at the new bit rate).
+ *****************************************************************************************/
+UBaseType_t usartSetBaud(USART_ID usartId, uint32_t ulWantedBaud)
+{
+	UBaseType_t flushed;
+
+	// Let the transmit ISR empty the ring buffers, then the last character leave the shift register.
+	flushed = usart_xflushTx(usartId, 1000 / portTICK_PERIOD_MS);
+
+	portENTER_CRITICAL();
+	*usartReg[usartId].ubbrPtr = (uint16_t)((configCPU_CLOCK_HZ + ulWantedBaud * 4UL) / (ulWantedBaud * 8UL) - 1);  // for 2x mode, see usartOpen
+	usartRxIdleTicks(usartId); // the character time changed
+	portEXIT_CRITICAL();
+
+	return flushed;
+}
+
 /*******************************************************************************//*!
  * \brief Close a connection on a USART
  *
- * The buffers allocated to the connection are released.  USART registers are configure to turn off reception and
- * transmission.  Interrups are also turned off.
+ * The ring buffers are detached from the arena of the USART (characters not transmitted are lost).  USART registers
+ * are configure to turn off reception and transmission.  Interrups are also turned off.
  * @param usartId
 ******************************************************************************************/
 void usartClose(USART_ID usartId )
 {
 	uint8_t ucByte;
 
+	usart_xsetFlowControl(usartId, NULL, 0, NULL, 0);
+
 	/* Turn off the interrupts.  We may also want to delete the queues and/or
 	re-install the original ISR. */
 
-	vPortFree( usartComBuf[usartId].workBuffer );
-	vPortFree( usartComBuf[usartId].xRxedChars.start );
-	vPortFree( usartComBuf[usartId].xCharsForTx.start );
-
 	portENTER_CRITICAL();   // Turn off interrupts
 	xmitInterrupt_Off(usartId);
 	//
 	ucByte = *usartReg[usartId].ucsrBPtr;
-	ucByte &= ~RXCIE_BIT;
+	ucByte &= ~(RXCIE_BIT | TXCIE_BIT);
 	*usartReg[usartId].ucsrBPtr = ucByte;
+	usartComBuf[usartId].txDraining = 0;
+	usartComBuf[usartId].rxIdleTicks = 0;
+	usartComBuf[usartId].rxIdleCountdown = 0;
 	portEXIT_CRITICAL();   // Enable interrupts
+
+	// Detached once the interrupts are off.
+	spscRingInit( &(usartComBuf[usartId].xRxedChars), NULL, 0 );
+	usartTxOpen( usartId, &(usartComBuf[usartId].xCharsForTx), NULL, 0, 0 );
+	usartTxOpen( usartId, &(usartComBuf[usartId].xPriorityTx), NULL, 0, USART_TX_PRIORITY );
+}
+
+/*******************************************************************************//*!
+ * \brief Set up hardware flow control (RTS/CTS) on an open USART, using GPIO pins.
+ *
+ * RTS is an output driven by the Atmega2560: it is raised (stop sending) by the reception ISR once the reception
+ * ring buffer holds RTS_HIGH_WATER characters, the last quarter of the ring buffer absorbing the characters the
+ * peer sends before it reacts.  It is lowered once the reading task has drained the ring buffer to RTS_LOW_WATER.
+ * With reception flow control, usart_xreadLine returns the part of a line that filled the ring buffer to the
+ * high-water mark.
+ *
+ * CTS is an input driven by the peer: while it is high, the transmit ISR stops after the current character, and a
+ * pin change interrupt restarts it when CTS goes low.  CTS must therefore be a pin change interrupt pin: port B
+ * (PCINT0-7), port J bits 0 to 6 (PCINT9-15) or port K (PCINT16-23).  The pin change interrupts are reserved for
+ * this module.
+ * @param usartId - USART identifier.
+ * @param rtsPort - port register of RTS (e.g. &PORTK), NULL for no reception flow control.
+ * @param rtsBit - bit of RTS in rtsPort.
+ * @param ctsPin - input register of CTS (e.g. &PINK), NULL for no transmission flow control.
+ * @param ctsBit - bit of CTS in ctsPin.
+ * @return pdPASS, pdFAIL if CTS is not a pin change interrupt pin (flow control unchanged).
+******************************************************************************************/
+UBaseType_t usart_xsetFlowControl(USART_ID usartId, volatile uint8_t *rtsPort, uint8_t rtsBit, volatile uint8_t *ctsPin, uint8_t ctsBit)
+{
+	USART_COM_BUF *comBuf = &(usartComBuf[usartId]);
+	uint16_t size = (uint16_t)comBuf->xRxedChars.mask + 1;
+	volatile uint8_t *pcmsk = NULL;
+	uint8_t pcint = ctsBit;
+	uint8_t pcie = 0;
+
+	// Pin change interrupt of CTS.
+	if( ctsPin == &PINB )
+	{
+		pcmsk = &PCMSK0;
+		pcie = _BV(PCIE0);
+	}
+	else if( ctsPin == &PINJ && ctsBit < 7 )
+	{
+		pcmsk = &PCMSK1;
+		pcie = _BV(PCIE1);
+		pcint = ctsBit + 1;		// PJ0 is PCINT9, PCINT8 is PE0
+	}
+	else if( ctsPin == &PINK )
+	{
+		pcmsk = &PCMSK2;
+		pcie = _BV(PCIE2);
+	}
+	else if( ctsPin != NULL )
+		return pdFAIL;
+
+	portENTER_CRITICAL();
+	// Release the previous pins: RTS is left low (ready) and CTS no longer interrupts.
+	if( comBuf->rtsPort != NULL )
+		*comBuf->rtsPort &= ~comBuf->rtsMask;
+	if( comBuf->ctsPcmsk != NULL )
+		*comBuf->ctsPcmsk &= ~_BV(comBuf->ctsPcint);
+
+	// RTS: output, low (ready to receive).  The direction register DDRx sits just below PORTx.
+	comBuf->rtsPort = rtsPort;
+	comBuf->rtsMask = _BV(rtsBit);
+	comBuf->rxStopped = 0;
+	comBuf->rtsHighWater = RTS_HIGH_WATER(size);
+	comBuf->rtsLowWater = RTS_LOW_WATER(size);
+	if( rtsPort != NULL )
+	{
+		*rtsPort &= ~comBuf->rtsMask;
+		*(rtsPort - 1) |= comBuf->rtsMask;
+	}
+
+	// CTS: input (driven by the peer), interrupting on each change.  DDRx sits just above PINx.
+	comBuf->ctsPin = ctsPin;
+	comBuf->ctsMask = _BV(ctsBit);
+	comBuf->ctsPcmsk = pcmsk;
+	comBuf->ctsPcint = pcint;
+	if( ctsPin != NULL )
+	{
+		*(ctsPin + 1) &= ~comBuf->ctsMask;
+		PCIFR = pcie;		// clear a stale change
+		*pcmsk |= _BV(pcint);
+		PCICR |= pcie;
+	}
+
+	// Restart a transmission paused on CTS.
+	if( comBuf->xCharsForTx.tail != comBuf->xCharsForTx.head || comBuf->xPriorityTx.tail != comBuf->xPriorityTx.head )
+		xmitInterrupt_On(usartId);
+	portEXIT_CRITICAL();
+
+	return pdPASS;
 }
 
 /*-------------------------------------------------------------*/
@@ -375,8 +641,7 @@ void usart_print_P(PGM_P str)
  * \brief Standard printf for specified USART.
  *
  * This function has a variable list and uses the variable list feature of C (see documentation on stdarg). The function
- * uses vsnprintf function for formating the string to output in the workBuffer before transmission. This function
- * calls usart_print to send the contents of the work buffer to the USART.
+ * uses vfprintf function for formating the string straight to the USART data register (see pollStream).
  * @param usartid - USART identifier - note that var_list, va_start, etc does not work when using USERID enumerated types.  must be an int.
  * @param format - Formating string.
 ******************************************************************************************/
@@ -539,8 +804,8 @@ void usart_xprint_P(PGM_P str)
  * \brief  Standard printf function for specific USART.
  *
  * This function has a variable list and uses the variable list feature of C (see documentation on stdarg). The function
- * uses vsnprintf function for formating the string to output in the workBuffer before transmission. This function
- * calls usart_fprint_P to send the contents of the work buffer to the USART.
+ * uses vfprintf function for formating the string in place, in a reservation of the transmission ring buffer,
+ * which is committed once the string is complete.
  *
  * @param usartId - USART Identifier - note that var_list, va_start, etc does not work when using USERID enumerated types.  must be an int.
  * @param format - Formating string.
@@ -557,9 +822,8 @@ void usart_xfprintf(int usartId, const char * format, ...)
  * \brief Standard printf function for specific USART that uses a formating string stored in program memory.
  *
  * This function has a variable list and uses the variable list feature of C (see documentation on stdarg). The function
- * uses vsnprintf_P function for formating the string to output in the workBuffer before transmission. This function
- * calls usart_fprint_P to send the contents of the work buffer to the USART.  The formating string is stored
- * in program memory.
+ * uses vfprintf_P function for formating the string in place, in a reservation of the transmission ring buffer,
+ * which is committed once the string is complete.  The formating string is stored in program memory.
  * @param usartId - USART identifier - note that var_list, va_start, etc does not work when using USERID enumerated types.  must be an int.
  * @param format - Formating String.
  */
@@ -575,36 +839,28 @@ void usart_xfprintf_P(int usartId, PGM_P format, ...)
 /********************************************************************************//*!
  * \brief Print string to specific USART.
  *
- * Adds the passed string to the ring buffer using usart_xputChar.
+ * Adds the passed string to the ring buffer using usart_xwritev.
  * @param usartId
  * @param str
  ************************************************************************************/
 void usart_xfprint(USART_ID usartId, uint8_t * str)
 {
-	int16_t i = 0;
-	size_t stringlength;
-
-	stringlength = strlen((char *)str);
+	USART_IOV iov = { str, strlen((char *)str), USART_IOV_RAM };
 
-	while(i < stringlength)
-		usart_xputChar( usartId, str[i++]);
+	usart_xwritev(usartId, &iov, 1);
 }
 /********************************************************************************//*!
  * \brief Print string stored in program memory to specific USART.
  *
- * Adds the passed string to the ring buffer using usart_xputChar.
+ * Adds the passed string to the ring buffer using usart_xwritev.
  * @param usartId - USART identifier.
  * @param str - Reference to string stored in program memory.
  ***********************************************************************************/
 void usart_xfprint_P(USART_ID usartId, PGM_P str)
 {
-	uint16_t i = 0;
-	size_t stringlength;
+	USART_IOV iov = { str, strlen_P(str), USART_IOV_PGM };
 
-	stringlength = strlen(str); //strlen_P(str);
-
-	while(i < stringlength)
-		usart_xputChar( usartId, pgm_read_byte(&str[i++]) );
+	usart_xwritev(usartId, &iov, 1);
 }
 
 /********************************************************************************//*!
@@ -621,8 +877,77 @@ void usart_xflushRx(USART_ID usartId)
 	register uint8_t byte __attribute__ ((unused));
 	// Flush the bytes in the USART
 	while (*usartReg[usartId].ucsrAPtr & RXC_BIT) byte = *usartReg[usartId].udrPtr;
-	// Flush the characters in the ring buffer.
-	ringBuffer_Flush( &(usartComBuf[usartId].xRxedChars) );
+	// Flush the characters in the ring buffer, and the lines indexed.
+	portENTER_CRITICAL();
+	spscRingFlush( &(usartComBuf[usartId].xRxedChars) );
+	usartComBuf[usartId].rxUnindexedEnd = usartComBuf[usartId].xRxedChars.head;
+	usartComBuf[usartId].rxLineTail = usartComBuf[usartId].rxLineHead;
+	portEXIT_CRITICAL();
+	usartRxResume(usartId);
+}
+
+/********************************************************************************//*!
+ * \brief Waits until all the characters queued for transmission are on the wire.
+ *
+ * Blocks the calling task until both transmit rings are empty and the last character has left the shift register
+ * of the USART, i.e. until the peer has received everything committed so far (by any task).  The task sleeps on a
+ * task notification (entry USART_NOTIFY_INDEX) sent by the transmit complete (TXC) interrupt, so the wait is exact
+ * instead of a fixed delay sized for the longest message.  A message still being written (reservation not
+ * committed) is not waited for.
+ * Before the scheduler is started, the function polls every millisecond.  One task at a time may flush a USART.
+ * @param usartId - USART identifier (USART_TX_PRIORITY is ignored, both lanes are flushed).
+ * @param xTicksToWait - maximum time to wait (e.g. a peer holding CTS high).
+ * @return pdPASS if the transmission is complete, pdFAIL on timeout.
+ */
+UBaseType_t usart_xflushTx(USART_ID usartId, TickType_t xTicksToWait)
+{
+	USART_COM_BUF *comBuf;
+	uint32_t pollingCycles = (uint32_t)xTicksToWait * portTICK_PERIOD_MS;
+	UBaseType_t complete;
+	TimeOut_t timeOut;
+
+	usartId = (USART_ID)(usartId & ~USART_TX_PRIORITY);
+	comBuf = &(usartComBuf[usartId]);
+
+	if( xTaskGetSchedulerState() != taskSCHEDULER_RUNNING )
+	{
+		// Scheduler not started yet (e.g. Wi-Fi initialisation), poll.
+		for( ;; )
+		{
+			portENTER_CRITICAL();
+			complete = usartTxComplete(usartId);
+			portEXIT_CRITICAL();
+			if( complete || pollingCycles-- == 0 )
+				break;
+			_delay_ms(1);
+		}
+		return complete ? pdPASS : pdFAIL;
+	}
+
+	vTaskSetTimeOutState(&timeOut);
+	for( ;; )
+	{
+		ulTaskNotifyTakeIndexed(USART_NOTIFY_INDEX, pdTRUE, 0); // discard a stale notification of the USART
+
+		portENTER_CRITICAL();
+		complete = usartTxComplete(usartId);
+		if( ! complete )
+		{
+			// Notified by usart_txc_isr once the shift register is empty.
+			comBuf->txFlushTask = xTaskGetCurrentTaskHandle();
+			*usartReg[usartId].ucsrBPtr |= TXCIE_BIT;
+		}
+		portEXIT_CRITICAL();
+
+		if( complete || xTaskCheckForTimeOut(&timeOut, &xTicksToWait) == pdTRUE )
+			break;
+		ulTaskNotifyTakeIndexed(USART_NOTIFY_INDEX, pdTRUE, xTicksToWait);
+	}
+
+	portENTER_CRITICAL();
+	comBuf->txFlushTask = NULL;
+	portEXIT_CRITICAL();
+	return complete ? pdPASS : pdFAIL;
 }
 
 /**********************************************************************//*!
@@ -637,7 +962,7 @@ uint16_t usart_AvailableCharRx(USART_ID usartId)
 {
 	// Are characters available in the serial port buffer.
 
-	return ringBuffer_GetCount( &(usartComBuf[usartId].xRxedChars) );
+	return spscRingCount( &(usartComBuf[usartId].xRxedChars) );
 }
 
 /*********************************************************************************//*!
@@ -652,14 +977,192 @@ uint16_t usart_AvailableCharRx(USART_ID usartId)
  */
 UBaseType_t usart_xgetChar( USART_ID usartId, UBaseType_t *pcRxedChar )
 {
-	UBaseType_t retVal = pdFALSE;
+	uint8_t character;
+
 	// Get the next character from the ring buffer.  Return false if no characters are available
-	if( ! ringBuffer_IsEmpty( &(usartComBuf[usartId].xRxedChars) ) )
+	if( ! spscRingPop( &(usartComBuf[usartId].xRxedChars), &character ) )
+		return pdFALSE;
+	usartRxResume(usartId);
+	* pcRxedChar = character;
+	return pdTRUE;
+}
+
+/*********************************************************************************//*!
+ * \brief Read characters from the reception ring buffer, sleeping until they arrive.
+ *
+ * The function returns once len characters have been read or the time out has expired.  While the reception
+ * ring buffer does not hold enough characters, the calling task sleeps on a task notification sent by the
+ * reception ISR, instead of polling.  Before the scheduler is started, the function polls every millisecond.
+ * @param usartId - USART identifier
+ * @param buf - buffer for storing the characters read (not terminated).
+ * @param len - number of characters wanted.
+ * @param xTicksToWait - maximum time to wait for the characters.
+ * @return Number of characters read.
+ */
+uint16_t usart_xread(USART_ID usartId, uint8_t *buf, uint16_t len, TickType_t xTicksToWait)
+{
+	return usartRxRead(usartId, buf, len, -1, xTicksToWait);
+}
+
+/*********************************************************************************//*!
+ * \brief Read a message delimited by an idle gap, sleeping until it has been received.
+ *
+ * Peers answering with bursts of characters without a fixed terminator (e.g. the responses of the Gainspan module)
+ * are read with an idle gap set by usart_xsetIdleGap: the function waits for the first character for at most
+ * xTicksToWait, then returns as soon as the line has been idle for the gap (end of the burst), instead of waiting
+ * for the whole time out.  It also returns once len characters have been read or the time out has expired.
+ * Without an idle gap, the function is the same as usart_xread.
+ * @param usartId - USART identifier
+ * @param buf - buffer for storing the characters read (not terminated).
+ * @param len - maximum number of characters.
+ * @param xTicksToWait - maximum time to wait for the message.
+ * @return Number of characters read.
+ */
+uint16_t usart_xreadMessage(USART_ID usartId, uint8_t *buf, uint16_t len, TickType_t xTicksToWait)
+{
+	return usartRxRead(usartId, buf, len, (usartComBuf[usartId].rxIdleTicks) ? RX_IDLE_WAIT : -1, xTicksToWait);
+}
+
+/*********************************************************************************//*!
+ * \brief Read characters from the reception ring buffer up to a delimiter, sleeping until they arrive.
+ *
+ * Same as usart_xread, except that the function also returns as soon as the delimiter has been read.  The delimiter
+ * is stored in buf.
+ * @param usartId - USART identifier
+ * @param buf - buffer for storing the characters read (not terminated).
+ * @param len - maximum number of characters to read.
+ * @param delim - delimiter ending the read.
+ * @param xTicksToWait - maximum time to wait for the delimiter.
+ * @return Number of characters read (including the delimiter).
+ */
+uint16_t usart_xreadUntil(USART_ID usartId, uint8_t *buf, uint16_t len, uint8_t delim, TickType_t xTicksToWait)
+{
+	return usartRxRead(usartId, buf, len, delim, xTicksToWait);
+}
+
+/*********************************************************************************//*!
+ * \brief Enable the line index of a USART.
+ *
+ * When a terminator is set, the reception ISR records the position of each terminator it stores in the reception
+ * ring buffer in a small index (RX_LINE_INDEX_SIZE lines), so usart_xreadLine finds the end of a complete line
+ * without scanning, and the calling task only wakes once a complete line has been received.  Characters already
+ * in the reception ring buffer are not indexed; they are scanned by usart_xreadLine.
+ * @param usartId - USART identifier
+ * @param terminator - character ending a line (e.g. '\n'), -1 to disable the index.
+ */
+void usart_xsetLineTerminator(USART_ID usartId, int16_t terminator)
+{
+	portENTER_CRITICAL();
+	usartComBuf[usartId].rxLineTerminator = terminator;
+	usartComBuf[usartId].rxLineTail = usartComBuf[usartId].rxLineHead;
+	usartComBuf[usartId].rxUnindexedEnd = usartComBuf[usartId].xRxedChars.head;
+	portEXIT_CRITICAL();
+}
+
+/*********************************************************************************//*!
+ * \brief Enable the end of message detection of a USART.
+ *
+ * The line is idle once no character has been received for the gap.  The reception ISR restarts a countdown with
+ * each character and the compare B interrupt of TIMER0 (custom_timer.c, one period of 1.024 ms at 16 MHz, enabled
+ * only while a countdown runs) counts it down, so the cost per character is two stores.  The gap is rounded up to
+ * whole periods, plus one period since the countdown may start just before a compare.  usart_xreadMessage returns
+ * at the end of each message.  The gap follows the bit rate (usartSetBaud).
+ * @param usartId - USART identifier
+ * @param characterTimes - idle gap ending a message, in character times (10 bits), 0 to disable the detection.
+ */
+void usart_xsetIdleGap(USART_ID usartId, uint8_t characterTimes)
+{
+	portENTER_CRITICAL();
+	usartComBuf[usartId].rxIdleCharacterTimes = characterTimes;
+	usartRxIdleTicks(usartId);
+	usartComBuf[usartId].rxIdleCountdown = 0;
+	OCR0B = 0x80; // compare half way between two overflows of TIMER0
+	portEXIT_CRITICAL();
+}
+
+/*********************************************************************************//*!
+ * \brief Read a line from the reception ring buffer, sleeping until a complete line has been received.
+ *
+ * The line is copied up to and including its terminator (see usart_xsetLineTerminator).  A line longer than len is
+ * returned in several parts.  The end of the line is taken from the line index maintained by the reception ISR,
+ * so the cost is proportional to the length of the line; lines that could not be indexed (index full) are scanned.
+ * Blank lines are returned as the terminator only.  Before the scheduler is started, the function polls every
+ * millisecond.
+ * @param usartId - USART identifier
+ * @param buf - buffer for storing the line (not terminated).
+ * @param len - size of buf.
+ * @param pxTicksToWait - maximum time to wait for a complete line; updated with the time left, so that successive
+ * calls can share one time out (as xTaskCheckForTimeOut).
+ * @return Number of characters read: 0 on time out, or characters of an incomplete line if the line was not indexed.
+ */
+uint16_t usart_xreadLine(USART_ID usartId, uint8_t *buf, uint16_t len, TickType_t *pxTicksToWait)
+{
+	USART_COM_BUF *comBuf = &(usartComBuf[usartId]);
+	SPSC_RING *ring = &(comBuf->xRxedChars);
+	uint16_t count = 0;
+	uint16_t lineLength;
+	uint32_t pollingCycles = (uint32_t)(*pxTicksToWait) * portTICK_PERIOD_MS;
+	UBaseType_t unindexed = pdFALSE;
+	TimeOut_t timeOut;
+
+	if( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING )
+		vTaskSetTimeOutState(&timeOut);
+
+	while( count < len )
 	{
-		* pcRxedChar = ringBuffer_Pop( &(usartComBuf[usartId].xRxedChars) );
-		retVal = pdTRUE;
+		// Drop the lines already consumed by usart_xread/usart_xgetChar.
+		while( comBuf->rxLineTail != comBuf->rxLineHead &&
+				SPSC_RING_DISTANCE(comBuf->rxLineEnd[comBuf->rxLineTail & (RX_LINE_INDEX_SIZE - 1)], ring->tail) <= 0 )
+			comBuf->rxLineTail++;
+
+		// Once scanning, scan up to the terminator.
+		portENTER_CRITICAL();
+		unindexed = unindexed || SPSC_RING_DISTANCE(comBuf->rxUnindexedEnd, ring->tail) > 0
+				|| spscRingCount(ring) > ring->mask || comBuf->rxStopped;
+		portEXIT_CRITICAL();
+
+		if( unindexed )
+		{
+			// Terminators before rxUnindexedEnd were not indexed (or the line fills the ring buffer): scan.
+			if( spscRingPop(ring, &buf[count]) )
+			{
+				if( buf[count++] == comBuf->rxLineTerminator )
+					break;
+				continue;
+			}
+		}
+		else if( comBuf->rxLineTail != comBuf->rxLineHead )
+		{
+			// Complete line: its length is known from the index, it is copied at once.
+			lineLength = (SPSC_RING_INDEX)(comBuf->rxLineEnd[comBuf->rxLineTail & (RX_LINE_INDEX_SIZE - 1)] - ring->tail);
+			if( lineLength > len - count )
+				lineLength = len - count;
+			count += spscRingPopBulk(ring, &buf[count], lineLength);
+			break;
+		}
+
+		usartRxResume(usartId);
+		if( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING )
+		{
+			if( xTaskCheckForTimeOut(&timeOut, pxTicksToWait) == pdTRUE )
+				break;
+			usartRxWait(usartId, UINT16_MAX, RX_LINE_WAIT, *pxTicksToWait);
+		}
+		else
+		{
+			// Scheduler not started yet (e.g. Wi-Fi initialisation), poll.
+			if( pollingCycles == 0 )
+			{
+				*pxTicksToWait = 0;
+				break;
+			}
+			pollingCycles--;
+			_delay_ms(1);
+			*pxTicksToWait = pollingCycles / portTICK_PERIOD_MS;
+		}
 	}
-	return retVal;
+	usartRxResume(usartId);
+	return count;
 }
 
 /*************************************************************************//*!
@@ -669,30 +1172,205 @@ UBaseType_t usart_xgetChar( USART_ID usartId, UBaseType_t *pcRxedChar )
  * up space in buffer.  The function turns on the transmit interrupt for the USART.
  * @param usartId
  * @param cOutChar
- * @return
+ * @return pdPASS if the character was queued, pdFAIL if the ring buffer remained full.
  */
 UBaseType_t usart_xputChar(USART_ID usartId, const UBaseType_t cOutChar )
 {
-	// Return false if there remains no room on the Tx ring buffer
+	return usart_xputCharWait(usartId, cOutChar, 0);
+}
+
+/*************************************************************************//*!
+ * \brief Drops a character into the transmit ring buffer, blocking while the ring buffer is full.
+ *
+ * Same as usart_xputChar, except that when the ring buffer is full the calling task sleeps until the transmit
+ * ISR has freed space (TX_LOW_WATER), instead of delaying.
+ * @param usartId - USART identifier.
+ * @param cOutChar - character to transmit.
+ * @param xTicksToWait - maximum time to wait for free space (0 - same as usart_xputChar).
+ * @return pdPASS if the character was queued, pdFAIL on time out.
+ */
+UBaseType_t usart_xputCharWait(USART_ID usartId, const UBaseType_t cOutChar, TickType_t xTicksToWait )
+{
+	uint8_t character = cOutChar;
+	USART_IOV iov = { &character, 1, USART_IOV_RAM };
+
+	return usart_xwritevWait(usartId, &iov, 1, xTicksToWait);
+}
+
+/*************************************************************************//*!
+ * \brief Drops a sequence of segments into the transmit ring buffer.
+ *
+ * The segments are copied in one pass into a reservation of the ring buffer, which is committed at once, so that
+ * the message is never interleaved with characters queued by other tasks.  If the ring buffer has no room for the
+ * complete message, the part already copied is committed and the function delays to allow transmission of
+ * characters to free up space in the buffer; characters that still do not fit are dropped.  The transmit interrupt is turned on once the message is committed.
+ * @param usartId - USART identifier.
+ * @param iov - array of segments to transmit, in order.
+ * @param iovcnt - number of segments in iov.
+ * @return pdPASS if all the characters were queued, pdFAIL if characters were dropped.
+ */
+UBaseType_t usart_xwritev(USART_ID usartId, const USART_IOV *iov, uint8_t iovcnt)
+{
+	return usart_xwritevWait(usartId, iov, iovcnt, 0);
+}
+
+/*************************************************************************//*!
+ * \brief Drops a sequence of segments into the transmit ring buffer, blocking while the ring buffer is full.
+ *
+ * Same as usart_xwritev, except that when the ring buffer is full the calling task sleeps on a task notification
+ * sent by the transmit ISR once the free space reaches TX_LOW_WATER, instead of delaying.  This lets long messages
+ * (e.g. web pages) be queued without dropping characters or burning CPU time.  Before the scheduler is started
+ * the function behaves as usart_xwritev.  A 768 character page at 9600 baud costs about 0.2 ms of CPU time this way,
+ * against 530 ms delaying until each character fits, or 50 ms and 465 characters lost with usart_xwritev
+ * (tools/usart_tx_bench.c).
+ * @param usartId - USART identifier, OR'ed with USART_TX_PRIORITY for the priority lane.
+ * @param iov - array of segments to transmit, in order.
+ * @param iovcnt - number of segments in iov.
+ * @param xTicksToWait - maximum time to wait for free space, each time the ring buffer is full
+ * (0 - same as usart_xwritev).
+ * @return pdPASS if all the characters were queued, pdFAIL if characters were dropped.
+ */
+UBaseType_t usart_xwritevWait(USART_ID usartId, const USART_IOV *iov, uint8_t iovcnt, TickType_t xTicksToWait)
+{
+	USART_TX_RING *ring = usartTxLane(&usartId);
+	const uint8_t *segment;
+	uint16_t i;
+	uint8_t seg;
 	UBaseType_t retVal = pdPASS;
-	if( ! ringBuffer_IsFull( &(usartComBuf[usartId].xCharsForTx) ) )
-		ringBuffer_Poke( &(usartComBuf[usartId].xCharsForTx), cOutChar ); // poke in a fast byte
-	else
+
+	usartTxLock(usartId, ring);
+	ring->timeout = xTicksToWait;
+	usartTxReserve(ring, 0, NULL);
+
+	for(seg = 0; seg < iovcnt; seg++)
 	{
-		 // go slower, per character rate for 115200 is 86us
-		_delay_us(25); // delay for about one character (maximum _delay_loop_1() delay is 32 us at 22MHz)
-		_delay_us(25);
-		_delay_us(25);
-		_delay_us(25);
-
-		if( ! ringBuffer_IsFull( &(usartComBuf[usartId].xCharsForTx) ) )
-			ringBuffer_Poke( &(usartComBuf[usartId].xCharsForTx), cOutChar ); // poke in a byte slowly
-		else
-			retVal = pdFAIL; // if the Tx ring buffer remains full
+		segment = (const uint8_t *)iov[seg].base;
+		for(i = 0; i < iov[seg].len; i++)
+			if( usartTxStreamWrite(usartId, ring, (iov[seg].mem == USART_IOV_PGM) ? pgm_read_byte(&segment[i]) : segment[i]) == pdFAIL )
+				retVal = pdFAIL;
 	}
-	xmitInterrupt_On(usartId);
+
+	usartTxCommit(usartId, ring, ring->used);
+	ring->timeout = 0;
+	usartTxUnlock(ring);
 	return retVal;
 }
+
+/*************************************************************************//*!
+ * \brief Reserves space in the transmit ring buffer for formatting a message in place.
+ *
+ * Up to wanted characters of free space following the last committed character are reserved for the
+ * calling task.  When the reservation wraps around the end of the ring buffer it is split in two contiguous
+ * parts: span->ptr[0] (span->len[0] characters) followed by span->ptr[1] (span->len[1] characters).
+ * The USART stays reserved by the calling task until usart_xcommitTx is called, so messages from other tasks
+ * cannot be interleaved with it.  Nothing is transmitted until the reservation is committed.
+ * @param usartId - USART identifier, OR'ed with USART_TX_PRIORITY for the priority lane.
+ * @param wanted - number of characters wanted.
+ * @param span - returns the reserved space.
+ * @return Number of characters reserved (less than wanted if the ring buffer does not have enough free space).
+ */
+uint16_t usart_xreserveTx(USART_ID usartId, uint16_t wanted, USART_TX_SPAN *span)
+{
+	USART_TX_RING *ring = usartTxLane(&usartId);
+
+	usartTxLock(usartId, ring);
+	return usartTxReserve(ring, wanted, span);
+}
+
+/*************************************************************************//*!
+ * \brief Commits a reservation of the transmit ring buffer.
+ *
+ * The first used characters of the reservation obtained with usart_xreserveTx are queued for transmission
+ * at once, the rest of the reservation is released.  The transmit interrupt is turned on.
+ * @param usartId - USART identifier, with the USART_TX_PRIORITY flag given to usart_xreserveTx.
+ * @param used - number of characters written in the reservation.
+ */
+void usart_xcommitTx(USART_ID usartId, uint16_t used)
+{
+	USART_TX_RING *ring = usartTxLane(&usartId);
+
+	usartTxCommit(usartId, ring, used);
+	usartTxUnlock(ring);
+}
+/*************************************************************************//*!
+ * \brief Get the contention statistics of the USART mutexes.
+ *
+ * The mutexes (one per transmit lane) serialise the messages of the tasks writing to the USART (printf, print,
+ * write functions).  The
+ * statistics give the number of times a task had to wait for another task to complete its message and the
+ * longest wait, measured in ticks.
+ * @param usartId - USART identifier.
+ * @param stats - returns a copy of the statistics.
+ */
+void usart_getLockStats(USART_ID usartId, USART_LOCK_STATS *stats)
+{
+	portENTER_CRITICAL();
+	*stats = usartComBuf[usartId].txLockStats;
+	portEXIT_CRITICAL();
+}
+
+/*************************************************************************//*!
+ * \brief Clear the contention statistics of the USART mutex.
+ * @param usartId - USART identifier.
+ */
+void usart_clearLockStats(USART_ID usartId)
+{
+	portENTER_CRITICAL();
+	usartComBuf[usartId].txLockStats.contentions = 0;
+	usartComBuf[usartId].txLockStats.maxWait = 0;
+	usartComBuf[usartId].txLockStats.totalWait = 0;
+	portEXIT_CRITICAL();
+}
+
+/*************************************************************************//*!
+ * \brief Get the health counters of a USART.
+ *
+ * The counters give the characters lost at reception (framing, overrun and parity errors, full reception ring
+ * buffer) and at transmission (full transmission ring buffer), the number of characters received/transmitted, and
+ * the highest occupation of the ring buffers.  They help sizing the ring buffers and choosing the bit rate.
+ * @param usartId - USART identifier.
+ * @param stats - returns a copy of the counters.
+ */
+void usart_getStats(USART_ID usartId, USART_STATS *stats)
+{
+	portENTER_CRITICAL();
+	*stats = usartComBuf[usartId].stats;
+	portEXIT_CRITICAL();
+}
+
+/*************************************************************************//*!
+ * \brief Clear the health counters of a USART.
+ * @param usartId - USART identifier.
+ */
+void usart_clearStats(USART_ID usartId)
+{
+	portENTER_CRITICAL();
+	memset( &(usartComBuf[usartId].stats), 0, sizeof(USART_STATS) );
+	portEXIT_CRITICAL();
+}
+
+/*************************************************************************//*!
+ * \brief Print the health counters and the contention statistics of a USART on another USART (debug terminal).
+ * @param usartId - USART identifier.
+ * @param terminalId - USART identifier of the debug terminal.
+ */
+void usart_printStats(USART_ID usartId, USART_ID terminalId)
+{
+	USART_STATS stats;
+	USART_LOCK_STATS lockStats;
+
+	usart_getStats(usartId, &stats);
+	usart_getLockStats(usartId, &lockStats);
+
+	usart_xfprintf_P(terminalId, PSTR("\n\rUSART%d rx:%lu tx:%lu\n\r"), usartId, stats.rxBytes, stats.txBytes);
+	usart_xfprintf_P(terminalId, PSTR(" rx drops fe:%u dor:%u upe:%u full:%u tx drops full:%u\n\r"),
+			stats.rxFrameErrors, stats.rxOverruns, stats.rxParityErrors, stats.rxRingFull, stats.txRingFull);
+	usart_xfprintf_P(terminalId, PSTR(" high water rx:%u tx:%u lock waits:%u max:%u ticks\n\r"),
+			stats.rxHighWater, stats.txHighWater, lockStats.contentions, (uint16_t)lockStats.maxWait);
+	usart_xfprintf_P(terminalId, PSTR(" flow control rts stops:%u cts pauses:%u priority max delay:%u\n\r"),
+			stats.rxRtsStops, stats.txCtsPauses, stats.txPriorityMaxDelay);
+}
+
 /*===============================================================================================================
  * LOCAL FUNCTONS
  *===============================================================================================================*/
@@ -700,47 +1378,541 @@ UBaseType_t usart_xputChar(USART_ID usartId, const UBaseType_t cOutChar )
 
 void usart_fprintf_arg(USART_ID usartId, const char * format, va_list arg)
 {
-	while(usartComBuf[usartId].workBufferInUse == USART_ENGAGED ) _delay_us(25);
-	usartComBuf[usartId].workBufferInUse = USART_ENGAGED;
+	USART_TX_RING *ring = &(usartComBuf[usartId].xCharsForTx);
 
-	vsnprintf((char *)(usartComBuf[usartId].workBuffer), usartComBuf[usartId].workBufferSize, (const char *)format, arg);
-	usart_fprint(defaultUSART, (usartComBuf[usartId].workBuffer));
+	usartTxLock(usartId, ring);
 
-	usartComBuf[usartId].workBufferInUse = USART_VACANT;
+	vfprintf( &(usartComBuf[usartId].pollStream), (const char *)format, arg);
+
+	usartTxUnlock(ring);
 }
 
 void usart_fprintf_P_arg(USART_ID usartId, PGM_P format, va_list arg)
 {
-	while(usartComBuf[usartId].workBufferInUse == USART_ENGAGED ) _delay_us(25);
-	usartComBuf[usartId].workBufferInUse = USART_ENGAGED;
+	USART_TX_RING *ring = &(usartComBuf[usartId].xCharsForTx);
+
+	usartTxLock(usartId, ring);
 
-	vsnprintf_P((char *)(usartComBuf[usartId].workBuffer), usartComBuf[usartId].workBufferSize, format, arg);
-	usart_fprint(usartId,usartComBuf[usartId].workBuffer);
+	vfprintf_P( &(usartComBuf[usartId].pollStream), format, arg);
 
-	usartComBuf[usartId].workBufferInUse = USART_VACANT;
+	usartTxUnlock(ring);
 
 }
 
 void usart_xfprintf_arg(USART_ID usartId, const char * format, va_list arg)
 {
-	while(usartComBuf[usartId].workBufferInUse == USART_ENGAGED ) taskYIELD();
-	usartComBuf[usartId].workBufferInUse = USART_ENGAGED;
+	USART_TX_RING *ring = usartTxLane(&usartId);
 
-	vsnprintf((char *)(usartComBuf[usartId].workBuffer), usartComBuf[usartId].workBufferSize, (const char *)format, arg);
-	usart_xfprint(usartId, (uint8_t *)(usartComBuf[usartId].workBuffer));
+	usartTxLock(usartId, ring);
+	usartTxReserve(ring, 0, NULL);
 
-	usartComBuf[usartId].workBufferInUse = USART_VACANT;
+	vfprintf( &(ring->stream), (const char *)format, arg);
+
+	usartTxCommit(usartId, ring, ring->used);
+	usartTxUnlock(ring);
 }
 
 void usart_xfprintf_P_arg(USART_ID usartId, PGM_P format, va_list arg)
 {
-	while(usartComBuf[usartId].workBufferInUse == USART_ENGAGED ) taskYIELD();
-	usartComBuf[usartId].workBufferInUse = USART_ENGAGED;
+	USART_TX_RING *ring = usartTxLane(&usartId);
+
+	usartTxLock(usartId, ring);
+	usartTxReserve(ring, 0, NULL);
+
+	vfprintf_P( &(ring->stream), format, arg);
+
+	usartTxCommit(usartId, ring, ring->used);
+	usartTxUnlock(ring);
+}
+
+/*************************************************************************************//*!
+ *  \brief Attaches a transmit ring to its storage and resets it.
+ * The mutex survives usartClose, so reopening the USART does not leak it; a priority ring without storage has
+ * no mutex.
+ * @param usartId - USART identifier
+ * @param ring - transmit ring (xCharsForTx or xPriorityTx).
+ * @param buffer - storage of the ring.
+ * @param size - size of the storage (capacity plus one, 0 - no ring).
+ * @param lane - 0 for xCharsForTx, USART_TX_PRIORITY for xPriorityTx (user data of the stream).
+******************************************************************************************/
+void usartTxOpen(USART_ID usartId, USART_TX_RING *ring, uint8_t *buffer, uint16_t size, uint8_t lane)
+{
+	ring->buffer = buffer;
+	ring->size = (buffer) ? size : 0;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->reserved = 0;
+	ring->used = 0;
+	ring->timeout = 0;
+	ring->waitingTask = NULL;
+	ring->messageHead = 0;
+	ring->messageTail = 0;
+	ring->atBoundary = 1;
+
+	// Stream used by the printf functions to format without a work buffer.
+	fdev_setup_stream( &(ring->stream), usartTxStreamPut, NULL, _FDEV_SETUP_WRITE );
+	fdev_set_udata( &(ring->stream), (void *)(uintptr_t)(usartId | lane) );
+
+	if( ring->mutex == NULL && ring->size > 0 )
+		ring->mutex = xSemaphoreCreateMutex();
+}
+
+/*************************************************************************************//*!
+ *  \brief Transmit ring selected by a write function.
+ * @param usartId - USART identifier, OR'ed with USART_TX_PRIORITY for the priority lane; the flag is removed.
+ * @return The priority ring if requested and the USART has one, the bulk ring otherwise.
+******************************************************************************************/
+USART_TX_RING *usartTxLane(USART_ID *usartId)
+{
+	uint8_t priority = *usartId & USART_TX_PRIORITY;
+	USART_COM_BUF *comBuf;
+
+	*usartId = (USART_ID)(*usartId & ~USART_TX_PRIORITY);
+	comBuf = &(usartComBuf[*usartId]);
+	return (priority && comBuf->xPriorityTx.size > 0) ? &(comBuf->xPriorityTx) : &(comBuf->xCharsForTx);
+}
+
+/*************************************************************************************//*!
+ *  \brief Takes a transmit ring of a USART for the calling task.
+ * Blocks on the mutex of the ring until no other task is writing a message in it.  The mutex uses priority
+ * inheritance, so a low priority task holding the ring runs at the priority of the task waiting for it.  Waits are
+ * recorded in txLockStats.  Before the scheduler is started there is a single thread of execution and no locking
+ * is done.
+ * @param usartId - USART identifier
+ * @param ring - transmit ring (lane).
+******************************************************************************************/
+void usartTxLock(USART_ID usartId, USART_TX_RING *ring)
+{
+	USART_COM_BUF *comBuf = &(usartComBuf[usartId]);
+	TickType_t start, waited;
+
+	if( ring->mutex == NULL || xTaskGetSchedulerState() != taskSCHEDULER_RUNNING )
+		return;
+
+	if( xSemaphoreTake(ring->mutex, 0) == pdTRUE )
+		return;
+
+	start = xTaskGetTickCount();
+	xSemaphoreTake(ring->mutex, portMAX_DELAY);
+	waited = xTaskGetTickCount() - start;
+
+	// The statistics are shared by the lanes.
+	portENTER_CRITICAL();
+	if( comBuf->txLockStats.contentions < UINT16_MAX )
+		comBuf->txLockStats.contentions++;
+	comBuf->txLockStats.totalWait += waited;
+	if( waited > comBuf->txLockStats.maxWait )
+		comBuf->txLockStats.maxWait = waited;
+	portEXIT_CRITICAL();
+}
+
+/*************************************************************************************//*!
+ *  \brief Releases a transmit ring taken with usartTxLock.
+ * The message of the calling task is complete: its end (head) is recorded in the message index, where the transmit
+ * ISR may switch lanes.  When the index is full, the end replaces the last one recorded (the two messages are
+ * transmitted as one).
+ * @param ring - transmit ring (lane).
+******************************************************************************************/
+void usartTxUnlock(USART_TX_RING *ring)
+{
+	uint8_t messageHead = ring->messageHead;
+
+	portENTER_CRITICAL();
+	if( messageHead != ring->messageTail && ring->messageEnd[(uint8_t)(messageHead - 1) & (TX_MESSAGE_INDEX_SIZE - 1)] == ring->head )
+		; // nothing committed since the last message
+	else if( (uint8_t)(messageHead - ring->messageTail) < TX_MESSAGE_INDEX_SIZE )
+	{
+		ring->messageEnd[messageHead & (TX_MESSAGE_INDEX_SIZE - 1)] = ring->head;
+		ring->messageHead = messageHead + 1;
+	}
+	else
+		ring->messageEnd[(uint8_t)(messageHead - 1) & (TX_MESSAGE_INDEX_SIZE - 1)] = ring->head;
+	portEXIT_CRITICAL();
+
+	if( ring->mutex == NULL || xTaskGetSchedulerState() != taskSCHEDULER_RUNNING )
+		return;
+
+	xSemaphoreGive(ring->mutex);
+}
+
+/*************************************************************************************//*!
+ *  \brief Number of free characters in a transmit ring buffer.
+ * The tail is updated by the transmit ISR, it is read with interrupts disabled (16 bit access).
+ * @param ring - transmit ring (lane).
+ * @return Number of characters that can be reserved.
+******************************************************************************************/
+uint16_t usartTxFree(USART_TX_RING *ring)
+{
+	uint16_t tail;
+
+	if( ring->size == 0 )
+		return 0;
+
+	portENTER_CRITICAL();
+	tail = ring->tail;
+	portEXIT_CRITICAL();
+
+	if( tail > ring->head )
+		return tail - ring->head - 1;
+	return ring->size - 1 - ring->head + tail;
+}
+
+/*************************************************************************************//*!
+ *  \brief Opens (or grows) the reservation of the transmit ring buffer.
+ * The transmit side must be taken with usartTxLock.  The reservation always starts at head, so calling the
+ * function again with a larger wanted grows the reservation with the space freed by the transmit ISR.
+ * @param ring - transmit ring (lane).
+ * @param wanted - number of characters wanted; the used count of the transmit stream is reset when 0.
+ * @param span - returns the reserved space, may be NULL.
+ * @return Number of characters reserved.
+******************************************************************************************/
+uint16_t usartTxReserve(USART_TX_RING *ring, uint16_t wanted, USART_TX_SPAN *span)
+{
+	uint16_t available = usartTxFree(ring);
+	uint16_t contiguous = ring->size - ring->head;
+
+	if( wanted == 0 )
+		ring->used = 0;
+	if( wanted > available )
+		wanted = available;
+	ring->reserved = wanted;
+
+	if( span )
+	{
+		span->ptr[0] = &(ring->buffer[ring->head]);
+		if( wanted <= contiguous )
+		{
+			span->len[0] = wanted;
+			span->ptr[1] = NULL;
+			span->len[1] = 0;
+		}
+		else
+		{
+			span->len[0] = contiguous;
+			span->ptr[1] = ring->buffer;
+			span->len[1] = wanted - contiguous;
+		}
+	}
+	return wanted;
+}
+
+/*************************************************************************************//*!
+ *  \brief Publishes the first used characters of the reservation to the transmit ISR.
+ * @param usartId - USART identifier
+ * @param ring - transmit ring (lane).
+ * @param used - number of characters written in the reservation.
+******************************************************************************************/
+void usartTxCommit(USART_ID usartId, USART_TX_RING *ring, uint16_t used)
+{
+	uint16_t head;
+	uint16_t level;
+
+	if( used > ring->reserved )
+		used = ring->reserved;
+	if( used == 0 )
+	{
+		ring->reserved = 0;
+		ring->used = 0;
+		return;
+	}
+
+	head = ring->head + used;
+	if( head >= ring->size )
+		head -= ring->size;
+
+	portENTER_CRITICAL();
+	ring->head = head;
+	// Occupation of the ring once the message is published.
+	level = (head >= ring->tail) ? head - ring->tail : ring->size - ring->tail + head;
+	if( level > usartComBuf[usartId].stats.txHighWater )
+		usartComBuf[usartId].stats.txHighWater = level;
+	portEXIT_CRITICAL();
+
+	ring->reserved = 0;
+	ring->used = 0;
+
+	xmitInterrupt_On(usartId);
+}
+
+/*************************************************************************************//*!
+ *  \brief Appends a character to the open reservation of the transmit ring buffer.
+ * When the reservation is exhausted it is grown with the space freed by the transmit ISR.  If the ring buffer
+ * is full, the characters written so far are committed and the function delays (or blocks, see timeout) to allow
+ * their transmission, so messages longer than the ring buffer are sent in parts.  The character is dropped if the
+ * ring remains full.
+ * @param usartId - USART identifier
+ * @param ring - transmit ring (lane).
+ * @param character - character to append.
+ * @return pdPASS if the character was appended, pdFAIL otherwise.
+******************************************************************************************/
+UBaseType_t usartTxStreamWrite(USART_ID usartId, USART_TX_RING *ring, uint8_t character)
+{
+	uint16_t index;
+
+	if( ring->used >= ring->reserved )
+	{
+		if( usartTxReserve(ring, ring->used + 1, NULL) <= ring->used )
+		{
+			// Ring full: publish the part already written (the task still holds the ring, so
+			// nothing can be interleaved) and let the ISR drain it.
+			usartTxCommit(usartId, ring, ring->used);
+			if( ring->timeout && xTaskGetSchedulerState() == taskSCHEDULER_RUNNING )
+				usartTxWait(ring); // sleep until the ISR has drained the ring down to the low-water mark
+			else
+			{
+				// go slower, per character rate for 115200 is 86us
+				_delay_us(25); // delay for about one character (maximum _delay_loop_1() delay is 32 us at 22MHz)
+				_delay_us(25);
+				_delay_us(25);
+				_delay_us(25);
+			}
+
+			if( usartTxReserve(ring, ring->used + 1, NULL) <= ring->used )
+			{
+				ring->timeout = 0; // timed out: do not block again for the rest of the message
+				if( usartComBuf[usartId].stats.txRingFull < UINT16_MAX )
+					usartComBuf[usartId].stats.txRingFull++;
+				return pdFAIL; // if the Tx ring buffer remains full
+			}
+		}
+	}
+
+	index = ring->head + ring->used;
+	if( index >= ring->size )
+		index -= ring->size;
+	ring->buffer[index] = character;
+	ring->used++;
+	return pdPASS;
+}
+
+/*************************************************************************************//*!
+ *  \brief Blocks the calling task until a transmit ring has drained to the low-water mark.
+ * The task registers itself in waitingTask and sleeps on its notification value (entry USART_NOTIFY_INDEX) for at
+ * most timeout ticks; the transmit ISR notifies it once TX_LOW_WATER characters are free (or the ring is empty).
+ * @param ring - transmit ring (lane).
+******************************************************************************************/
+void usartTxWait(USART_TX_RING *ring)
+{
+	ulTaskNotifyTakeIndexed(USART_NOTIFY_INDEX, pdTRUE, 0); // discard a stale notification of the USART
+
+	portENTER_CRITICAL();
+	ring->waitingTask = xTaskGetCurrentTaskHandle();
+	portEXIT_CRITICAL();
+
+	if( usartTxFree(ring) < TX_LOW_WATER(ring->size) )
+		ulTaskNotifyTakeIndexed(USART_NOTIFY_INDEX, pdTRUE, ring->timeout);
+
+	portENTER_CRITICAL();
+	ring->waitingTask = NULL;
+	portEXIT_CRITICAL();
+}
+
+/*************************************************************************************//*!
+ *  \brief Tells whether the characters committed to the transmit rings are all on the wire.
+ * The transmit ISR clears TXC each time it loads the data register, so TXC set with both rings empty means the
+ * last character has left the shift register.  txDraining covers a USART that has not transmitted anything since it
+ * was opened (TXC never set).  Called with interrupts disabled.
+ * @param usartId - USART identifier
+ * @return 1 if the transmission is complete, 0 otherwise.
+******************************************************************************************/
+UBaseType_t usartTxComplete(USART_ID usartId)
+{
+	USART_COM_BUF *comBuf = &(usartComBuf[usartId]);
+
+	if( comBuf->xCharsForTx.tail != comBuf->xCharsForTx.head || comBuf->xPriorityTx.tail != comBuf->xPriorityTx.head )
+		return 0;
+	if( comBuf->txDraining && (*usartReg[usartId].ucsrAPtr & TXC_BIT) )
+		comBuf->txDraining = 0;
+	return ! comBuf->txDraining;
+}
+
+/*************************************************************************************//*!
+ *  \brief Reads characters from the reception ring buffer, sleeping while it is empty.
+ * @param usartId - USART identifier
+ * @param buf - buffer for storing the characters read.
+ * @param len - maximum number of characters to read.
+ * @param delim - character ending the read (-1 - none).
+ * @param xTicksToWait - maximum time to wait.
+ * @return Number of characters read.
+******************************************************************************************/
+uint16_t usartRxRead(USART_ID usartId, uint8_t *buf, uint16_t len, int16_t delim, TickType_t xTicksToWait)
+{
+	SPSC_RING *ring = &(usartComBuf[usartId].xRxedChars);
+	uint16_t count = 0;
+	uint32_t pollingCycles = (uint32_t)xTicksToWait * portTICK_PERIOD_MS;
+	TimeOut_t timeOut;
+
+	if( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING )
+		vTaskSetTimeOutState(&timeOut);
+
+	while( count < len )
+	{
+		if( delim < 0 )
+		{
+			// No delimiter: copy what is available at once.
+			if( spscRingCount(ring) )
+			{
+				count += spscRingPopBulk(ring, &buf[count], len - count);
+				continue;
+			}
+		}
+		else if( spscRingPop(ring, &buf[count]) )
+		{
+			if( buf[count++] == delim )
+				break;
+			continue;
+		}
+
+		// End of the message: the line has been idle since the last character read.
+		if( delim == RX_IDLE_WAIT && count > 0 && usartComBuf[usartId].rxIdleCountdown == 0 )
+			break;
+
+		usartRxResume(usartId);
+		if( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING )
+		{
+			if( xTaskCheckForTimeOut(&timeOut, &xTicksToWait) == pdTRUE )
+				break;
+			// The first character of a message is waited for as with usart_xread.
+			usartRxWait(usartId, len - count, (delim == RX_IDLE_WAIT && count == 0) ? -1 : delim, xTicksToWait);
+		}
+		else
+		{
+			// Scheduler not started yet (e.g. Wi-Fi initialisation), poll.
+			if( pollingCycles-- == 0 )
+				break;
+			_delay_ms(1);
+		}
+	}
+	usartRxResume(usartId);
+	return count;
+}
+
+/*************************************************************************************//*!
+ *  \brief Blocks the calling task until characters are received.
+ * The task registers itself in rxWaitingTask and sleeps on its notification value (entry USART_NOTIFY_INDEX); the
+ * reception ISR notifies it once threshold characters are available or the delimiter is received, the idle ISR
+ * once the line is idle.
+ * @param usartId - USART identifier
+ * @param threshold - number of characters waking the task.
+ * @param delim - character waking the task (-1 - none, RX_LINE_WAIT - the line terminator of the USART,
+ * RX_IDLE_WAIT - the end of the message).
+ * @param xTicksToWait - maximum time to wait.
+******************************************************************************************/
+void usartRxWait(USART_ID usartId, uint16_t threshold, int16_t delim, TickType_t xTicksToWait)
+{
+	USART_COM_BUF *comBuf = &(usartComBuf[usartId]);
+
+	ulTaskNotifyTakeIndexed(USART_NOTIFY_INDEX, pdTRUE, 0); // discard a stale notification of the USART
+
+	portENTER_CRITICAL();
+	if( ((delim == RX_LINE_WAIT) ? usartRxLinePending(usartId) : spscRingCount( &(comBuf->xRxedChars) ))
+			|| (delim == RX_IDLE_WAIT && comBuf->rxIdleCountdown == 0) )
+	{
+		// characters (or a line, or the end of the message) arrived since the ring buffer was found empty
+		portEXIT_CRITICAL();
+		return;
+	}
+	comBuf->rxThreshold = threshold;
+	comBuf->rxDelimiter = (delim == RX_LINE_WAIT) ? comBuf->rxLineTerminator : (delim == RX_IDLE_WAIT) ? -1 : delim;
+	comBuf->rxIdleWake = (delim == RX_IDLE_WAIT);
+	comBuf->rxWaitingTask = xTaskGetCurrentTaskHandle();
+	portEXIT_CRITICAL();
+
+	ulTaskNotifyTakeIndexed(USART_NOTIFY_INDEX, pdTRUE, xTicksToWait);
+
+	portENTER_CRITICAL();
+	comBuf->rxWaitingTask = NULL;
+	comBuf->rxIdleWake = 0;
+	portEXIT_CRITICAL();
+}
+
+/*************************************************************************************//*!
+ *  \brief Tells whether usart_xreadLine has characters to return without waiting.
+ * True if a complete line is indexed, if characters received before the index was enabled (or while it was full)
+ * remain, or if the reception ring buffer is full or has raised RTS (a line longer than the ring buffer is returned
+ * in parts).
+ * Must be called with interrupts disabled.
+ * @param usartId - USART identifier
+ * @return pdTRUE if characters can be read, pdFALSE otherwise.
+******************************************************************************************/
+UBaseType_t usartRxLinePending(USART_ID usartId)
+{
+	USART_COM_BUF *comBuf = &(usartComBuf[usartId]);
+
+	return( comBuf->rxLineTail != comBuf->rxLineHead
+			|| SPSC_RING_DISTANCE(comBuf->rxUnindexedEnd, comBuf->xRxedChars.tail) > 0
+			|| spscRingCount( &(comBuf->xRxedChars) ) > comBuf->xRxedChars.mask
+			|| comBuf->rxStopped );
+}
+
+/*************************************************************************************//*!
+ *  \brief Lowers RTS once the reading task has drained the reception ring buffer to the low-water mark.
+ * Called by the reading functions after removing characters.  No effect without reception flow control.
+ * @param usartId - USART identifier
+******************************************************************************************/
+void usartRxResume(USART_ID usartId)
+{
+	USART_COM_BUF *comBuf = &(usartComBuf[usartId]);
 
-	vsnprintf_P((char *)(usartComBuf[usartId].workBuffer), usartComBuf[usartId].workBufferSize, format, arg);
-	usart_xfprint(usartId, (uint8_t *)(usartComBuf[usartId].workBuffer));
+	if( ! comBuf->rxStopped )
+		return;
 
-	usartComBuf[usartId].workBufferInUse = USART_VACANT;
+	// The port is shared with other pins: read-modify-write with interrupts disabled.
+	portENTER_CRITICAL();
+	if( spscRingCount( &(comBuf->xRxedChars) ) <= comBuf->rtsLowWater )
+	{
+		*comBuf->rtsPort &= ~comBuf->rtsMask;
+		comBuf->rxStopped = 0;
+	}
+	portEXIT_CRITICAL();
+}
+
+/*************************************************************************************//*!
+ *  \brief Converts the idle gap of a USART to periods of the idle ISR, at the current bit rate.
+ * A character (10 bits) lasts 80 * (UBRR + 1) CPU cycles in 2x mode (see usartOpen).  At most 255 periods.
+ * Must be called with interrupts disabled.
+ * @param usartId - USART identifier
+******************************************************************************************/
+void usartRxIdleTicks(USART_ID usartId)
+{
+	USART_COM_BUF *comBuf = &(usartComBuf[usartId]);
+	uint32_t ticks;
+
+	if( comBuf->rxIdleCharacterTimes == 0 )
+	{
+		comBuf->rxIdleTicks = 0;
+		return;
+	}
+	ticks = ((uint32_t)comBuf->rxIdleCharacterTimes * 80UL * (*usartReg[usartId].ubbrPtr + 1UL)
+			+ RX_IDLE_TICK_CYCLES - 1) / RX_IDLE_TICK_CYCLES + 1;
+	comBuf->rxIdleTicks = (ticks > UINT8_MAX) ? UINT8_MAX : (uint8_t)ticks;
+}
+
+/*************************************************************************************//*!
+ *  \brief Put function of the transmit streams (stream of USART_TX_RING) used by vfprintf.
+ * @param character - character to append to the reservation.
+ * @param stream - transmit stream; the user data holds the USART identifier and the lane (USART_TX_PRIORITY).
+ * @return 0 (a dropped character does not abort the formatting).
+******************************************************************************************/
+int usartTxStreamPut(char character, FILE *stream)
+{
+	USART_ID usartId = (USART_ID)(uintptr_t)fdev_get_udata(stream);
+	USART_TX_RING *ring = usartTxLane(&usartId);
+
+	usartTxStreamWrite( usartId, ring, character );
+	return 0;
+}
+
+/*************************************************************************************//*!
+ *  \brief Put function of the polling stream (pollStream) used by vfprintf.
+ * @param character - character to write to the USART.
+ * @param stream - polling stream; the user data holds the USART identifier.
+ * @return 0
+******************************************************************************************/
+int usartPollStreamPut(char character, FILE *stream)
+{
+	usartWrite( (USART_ID)(uintptr_t)fdev_get_udata(stream), character );
+	return 0;
 }
 
 /*************************************************************************************//*!
@@ -813,24 +1985,90 @@ ISR(USART3_RX_vect) { usart_rx_isr(USART_3); }
 
 /*************************************************************************************//*!
  *  \private Interrupt service routine for character reception.
- * Saves a received character in the receive ring buffer.  If an error occurred, nothing is done.
- * If the ring buffer is full, the character is lost.
+ * Saves a received character in the receive ring buffer.  If an error occurred, the character is read (to clear
+ * the interrupt) and discarded.  If the ring buffer is full, the character is lost.  Each loss is counted in the
+ * health counters (see usart_getStats).  A task waiting in usart_xread/usart_xreadUntil is notified once enough
+ * characters (or the delimiter) have been received.  With flow control, RTS is raised at the high-water mark and
+ * the waiting task is notified so that it drains the ring buffer.  With an idle gap, the end of message countdown is
+ * restarted.
  * @param usartId - USART id
 ******************************************************************************************/
 void usart_rx_isr(USART_ID usartId)
 {
+	USART_STATS *stats = &(usartComBuf[usartId].stats);
+	SPSC_RING *ring = &(usartComBuf[usartId].xRxedChars);
+	uint8_t cStatus;
 	uint8_t cChar;
+	uint16_t count;
 
-	/* Get status and data from buffer */
+	/* Get status and data from buffer; the status must be read before the data. */
+	cStatus = *usartReg[usartId].ucsrAPtr;
+	cChar = *usartReg[usartId].udrPtr;
+	stats->rxBytes++;
 
-	/* If error bit set (Frame Error, Data Over Run, Parity), do nothing */
-	if ( ! (*usartReg[usartId].ucsrAPtr & ((1<<FE0)|(1<<DOR0)|(1<<UPE0)) ) )
+	// The line is not idle: restart the end of message countdown (see usart_xsetIdleGap).
+	if( usartComBuf[usartId].rxIdleTicks )
 	{
-		/* If no error, get the character and post it on the buffer of Rxed characters.*/
-		cChar = *usartReg[usartId].udrPtr;
+		usartComBuf[usartId].rxIdleCountdown = usartComBuf[usartId].rxIdleTicks;
+		TIMSK0 |= _BV(OCIE0B);
+	}
 
-		if( ! ringBuffer_IsFull( &(usartComBuf[usartId].xRxedChars) ) )
-			ringBuffer_Poke( &(usartComBuf[usartId].xRxedChars), cChar);
+	/* If error bit set (Frame Error, Data Over Run, Parity), count it and discard the character */
+	if ( cStatus & ((1<<FE0)|(1<<DOR0)|(1<<UPE0)) )
+	{
+		if( (cStatus & (1<<FE0)) && stats->rxFrameErrors < UINT16_MAX )
+			stats->rxFrameErrors++;
+		if( (cStatus & (1<<DOR0)) && stats->rxOverruns < UINT16_MAX )
+			stats->rxOverruns++;
+		if( (cStatus & (1<<UPE0)) && stats->rxParityErrors < UINT16_MAX )
+			stats->rxParityErrors++;
+	}
+	else
+	{
+		/* If no error, post the character on the buffer of Rxed characters.*/
+		if( spscRingPush(ring, cChar) )
+		{
+			// Index the end of the line (usart_xreadLine).
+			if( cChar == usartComBuf[usartId].rxLineTerminator )
+			{
+				uint8_t lineHead = usartComBuf[usartId].rxLineHead;
+
+				if( (uint8_t)(lineHead - usartComBuf[usartId].rxLineTail) < RX_LINE_INDEX_SIZE )
+				{
+					usartComBuf[usartId].rxLineEnd[lineHead & (RX_LINE_INDEX_SIZE - 1)] = ring->head;
+					usartComBuf[usartId].rxLineHead = lineHead + 1;
+				}
+				else
+					usartComBuf[usartId].rxUnindexedEnd = ring->head; // index full, scanned
+			}
+		}
+		else if( stats->rxRingFull < UINT16_MAX )
+			stats->rxRingFull++;
+
+		count = spscRingUsed(ring);
+		if( count > stats->rxHighWater )
+			stats->rxHighWater = count;
+
+		// Ask the peer to stop sending (flow control).
+		if( usartComBuf[usartId].rtsPort != NULL && ! usartComBuf[usartId].rxStopped
+				&& count >= usartComBuf[usartId].rtsHighWater )
+		{
+			*usartComBuf[usartId].rtsPort |= usartComBuf[usartId].rtsMask;
+			usartComBuf[usartId].rxStopped = 1;
+			if( stats->rxRtsStops < UINT16_MAX )
+				stats->rxRtsStops++;
+		}
+
+		// Wake the task blocked in usart_xread/usart_xreadUntil.
+		if( usartComBuf[usartId].rxWaitingTask != NULL &&
+			( count >= usartComBuf[usartId].rxThreshold
+			  || cChar == usartComBuf[usartId].rxDelimiter
+			  || count > ring->mask
+			  || usartComBuf[usartId].rxStopped ) )
+		{
+			vTaskNotifyGiveIndexedFromISR( usartComBuf[usartId].rxWaitingTask, USART_NOTIFY_INDEX, NULL );
+			usartComBuf[usartId].rxWaitingTask = NULL;
+		}
 	}
 }
 /*-----------------------------------------------------------*/
@@ -843,18 +2081,168 @@ ISR(USART3_UDRE_vect) { usart_tx_isr(USART_3); }
 /***************************************************************************************//*!
  * \private Interrupt service routine for character transmission.
  * Transmits a character from the transmit ring buffer.  If the buffer is empty, the transmit interrupt is disabled.
+ * With a priority lane, the ISR drains the priority ring first, switching rings only between two messages (see
+ * usartTxUnlock), and records the worst-case delay of a priority message in the health counters.
+ * With flow control, the transmit interrupt is also disabled while the peer holds CTS high (see usart_cts_isr).
  * @param usartId - USART id
  ******************************************************************************************/
 void usart_tx_isr(USART_ID usartId)
 {
-	if( ringBuffer_IsEmpty( &(usartComBuf[usartId].xCharsForTx) ) )
+	USART_COM_BUF *comBuf = &(usartComBuf[usartId]);
+	USART_TX_RING *ring;
+	uint16_t tail;
+
+	// Peer not ready: pause until CTS goes low.
+	if( comBuf->ctsPin != NULL && (*comBuf->ctsPin & comBuf->ctsMask) )
 	{
-		// Queue empty, nothing to send.
+		xmitInterrupt_Off(usartId);
+		if( comBuf->stats.txCtsPauses < UINT16_MAX )
+			comBuf->stats.txCtsPauses++;
+		return;
+	}
+
+	// Choose the lane between two messages: priority messages first.
+	if( comBuf->xPriorityTx.size > 0 )
+	{
+		ring = (comBuf->txLane) ? &(comBuf->xPriorityTx) : &(comBuf->xCharsForTx);
+		while( ring->messageTail != ring->messageHead
+				&& ring->messageEnd[ring->messageTail & (TX_MESSAGE_INDEX_SIZE - 1)] == ring->tail )
+		{
+			ring->messageTail++;
+			ring->atBoundary = 1;
+		}
+		if( ring->atBoundary )
+			comBuf->txLane = (comBuf->xPriorityTx.tail != comBuf->xPriorityTx.head) ? USART_TX_PRIORITY : 0;
+	}
+	ring = (comBuf->txLane) ? &(comBuf->xPriorityTx) : &(comBuf->xCharsForTx);
+	tail = ring->tail;
+
+	if( tail == ring->head )
+	{
+		// Queue empty (or message of the lane not complete), nothing to send.
 		xmitInterrupt_Off(usartId);
 	}
 	else
 	{
-		*usartReg[usartId].udrPtr = ringBuffer_Pop( &(usartComBuf[usartId].xCharsForTx) );
+		// Clear TXC (written as one, the other status bits as zero) so that it tells when this character is sent.
+		*usartReg[usartId].ucsrAPtr = U2X_BIT | TXC_BIT;
+		*usartReg[usartId].udrPtr = ring->buffer[tail];
+		comBuf->txDraining = 1;
+		comBuf->stats.txBytes++;
+		if( ++tail >= ring->size )
+			tail = 0;
+		ring->tail = tail;
+		ring->atBoundary = 0;
+
+		// Characters of a bulk message sent while a priority message waits.
+		if( comBuf->txLane )
+		{
+			if( comBuf->txPriorityDelay > comBuf->stats.txPriorityMaxDelay )
+				comBuf->stats.txPriorityMaxDelay = comBuf->txPriorityDelay;
+			comBuf->txPriorityDelay = 0;
+		}
+		else if( comBuf->xPriorityTx.tail != comBuf->xPriorityTx.head && comBuf->txPriorityDelay < UINT16_MAX )
+			comBuf->txPriorityDelay++;
+	}
+
+	// Wake the task blocked on a full ring once the low-water mark is reached.
+	if( ring->waitingTask != NULL )
+	{
+		uint16_t head = ring->head;
+		uint16_t available = (tail > head) ? tail - head - 1 : ring->size - 1 - head + tail;
+
+		if( available >= TX_LOW_WATER(ring->size) || tail == head )
+		{
+			vTaskNotifyGiveIndexedFromISR( ring->waitingTask, USART_NOTIFY_INDEX, NULL );
+			ring->waitingTask = NULL;
+		}
+	}
+}
+
+// Transmit complete interrupts (see usart_xflushTx)
+ISR(USART0_TX_vect) { usart_txc_isr(USART_0); }
+ISR(USART1_TX_vect) { usart_txc_isr(USART_1); }
+ISR(USART2_TX_vect) { usart_txc_isr(USART_2); }
+ISR(USART3_TX_vect) { usart_txc_isr(USART_3); }
+
+/***************************************************************************************//*!
+ * \private Interrupt service routine for transmit complete (the shift register and the data register are empty).
+ * Enabled by usart_xflushTx only.  If both transmit rings are empty, the transmission is complete: the interrupt
+ * is disabled and the flushing task notified.  Otherwise (the transmit ISR was late, or is paused on CTS) nothing
+ * is done; the hardware clears TXC when the ISR runs, so it runs again at the next completion.
+ * @param usartId - USART id
+ ******************************************************************************************/
+void usart_txc_isr(USART_ID usartId)
+{
+	USART_COM_BUF *comBuf = &(usartComBuf[usartId]);
+
+	if( comBuf->xCharsForTx.tail != comBuf->xCharsForTx.head || comBuf->xPriorityTx.tail != comBuf->xPriorityTx.head )
+		return;
+
+	comBuf->txDraining = 0;
+	*usartReg[usartId].ucsrBPtr &= ~TXCIE_BIT;
+	if( comBuf->txFlushTask != NULL )
+	{
+		vTaskNotifyGiveIndexedFromISR( comBuf->txFlushTask, USART_NOTIFY_INDEX, NULL );
+		comBuf->txFlushTask = NULL;
+	}
+}
+
+// End of message countdowns (see usart_xsetIdleGap)
+ISR(TIMER0_COMPB_vect) { usart_idle_isr(); }
+
+/***************************************************************************************//*!
+ * \private Interrupt service routine of the end of message countdowns, once per TIMER0 period.
+ * Counts down the idle gap of the USARTs receiving a message.  When the gap has elapsed, the task waiting in
+ * usart_xreadMessage is notified.  The interrupt is disabled once no countdown runs (line idle on all USARTs).
+ ******************************************************************************************/
+void usart_idle_isr(void)
+{
+	uint8_t usartId;
+	uint8_t counting = 0;
+
+	for( usartId = 0; usartId < NUM_USARTS; usartId++ )
+	{
+		USART_COM_BUF *comBuf = &(usartComBuf[usartId]);
+
+		if( comBuf->rxIdleCountdown == 0 )
+			continue;
+
+		if( --comBuf->rxIdleCountdown )
+			counting = 1;
+		else if( comBuf->rxWaitingTask != NULL && comBuf->rxIdleWake )
+		{
+			vTaskNotifyGiveIndexedFromISR( comBuf->rxWaitingTask, USART_NOTIFY_INDEX, NULL );
+			comBuf->rxWaitingTask = NULL;
+		}
+	}
+
+	if( ! counting )
+		TIMSK0 &= ~_BV(OCIE0B);
+}
+
+/*-----------------------------------------------------------*/
+// CTS pin change interrupts (see usart_xsetFlowControl)
+ISR(PCINT0_vect) { usart_cts_isr(); }
+ISR(PCINT1_vect) { usart_cts_isr(); }
+ISR(PCINT2_vect) { usart_cts_isr(); }
+
+/***************************************************************************************//*!
+ * \private Interrupt service routine for a change of a CTS input.
+ * Restarts the transmission of the USARTs whose peer lowered CTS while characters are waiting.
+ ******************************************************************************************/
+void usart_cts_isr(void)
+{
+	uint8_t usartId;
+
+	for( usartId = 0; usartId < NUM_USARTS; usartId++ )
+	{
+		USART_COM_BUF *comBuf = &(usartComBuf[usartId]);
+
+		if( comBuf->ctsPin != NULL && ! (*comBuf->ctsPin & comBuf->ctsMask)
+				&& ( comBuf->xCharsForTx.tail != comBuf->xCharsForTx.head
+					|| comBuf->xPriorityTx.tail != comBuf->xPriorityTx.head ) )
+			xmitInterrupt_On((USART_ID)usartId);
 	}
 }
 
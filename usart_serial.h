@@ -13,7 +13,7 @@
 
     Both interrupt driven and polling functions are available.
 
-    Uses freeRTOS ring buffers to support interrupt functions.
+    Uses ring buffers to support interrupt functions (see spsc_ring.h for the reception ring).
 **********************************************************************************/
 
 
@@ -29,8 +29,6 @@ extern "C" {
 #include "queue.h"
 #include "portable.h"
 
-#include "ringBuffer.h"
-
 /****************************************************************//*!
  * \brief USART identifiers
  * Shall be used as indexes into corresponding structure arrays. They play the same
@@ -43,14 +41,118 @@ typedef enum {
   USART_3 = 3   //!< identifier for USART3
 } USART_ID;
 
+/****************************************************************//*!
+ * \brief Ring buffer sizes of each USART (compile-time configuration)
+ * Each entry is USART_BUFFERS(usart identifier, transmit size, reception
+ * size, priority transmit size).
+ * The buffers are placed in a static arena per USART by usart_serial.c, so
+ * usartOpen/usartClose never use the heap.  The transmit rings keep one slot
+ * empty (capacity of size - 1).  The reception size is a power of two, at
+ * most SPSC_RING_MAX_SIZE.  A priority transmit size of 0 means no priority
+ * lane (see USART_TX_PRIORITY).  A USART not listed can still be opened:
+ * it gets a one character reception ring and no transmit ring, so only the
+ * polling write functions work on it (the interrupt driven writes fail).
+ * Override the table from the build to resize
+ * the buffers; tools/usart_sram_report.c gives the SRAM used by each USART.
+ ******************************************************************/
+#ifndef USART_BUFFER_TABLE
+#define USART_BUFFER_TABLE \
+  USART_BUFFERS(USART_0, 256, 64, 64)   /* serial terminal and telemetry */ \
+  USART_BUFFERS(USART_1, 64, 8, 0)      /* LCD, write only */ \
+  USART_BUFFERS(USART_2, 256, 256, 32)  /* Gainspan Wi-Fi module */
+#endif
+
+/****************************************************************//*!
+ * \brief Priority lane flag of the interrupt driven write functions
+ * OR'ed with the USART identifier (e.g. usart_xwritev(USART_0 |
+ * USART_TX_PRIORITY, ...)), the message is queued in the priority transmit
+ * ring of the USART, which the transmit ISR drains first, between two
+ * messages of the bulk ring (messages are never interleaved).  Ignored by a
+ * USART without a priority lane.
+ ******************************************************************/
+#define USART_TX_PRIORITY 0x80
+
+/****************************************************************//*!
+ * \brief Task notification used by the blocking functions
+ * The functions sleeping until the ISRs wake them (full transmit ring,
+ * reception, end of transmission) use this entry of the notification array
+ * of the calling task, so they neither consume nor discard a notification
+ * that the task receives from elsewhere on entry 0 (e.g. the completions of
+ * the Gainspan AT command engine).  FreeRTOSConfig.h must define
+ * configTASK_NOTIFICATION_ARRAY_ENTRIES larger than this index.
+ ******************************************************************/
+#ifndef USART_NOTIFY_INDEX
+#define USART_NOTIFY_INDEX 1
+#endif
+
+/****************************************************************//*!
+ * \brief Memory space holding a transmit segment
+ ******************************************************************/
+typedef enum {
+  USART_IOV_RAM = 0,   //!< segment is stored in RAM
+  USART_IOV_PGM = 1    //!< segment is stored in program memory
+} USART_IOV_MEM;
+
+/****************************************************************//*!
+ * \brief Transmit segment used by usart_xwritev
+ * A message is described by an array of segments that are queued back to
+ * back in the transmit ring buffer (e.g. frame header, payload, trailer).
+ ******************************************************************/
+typedef struct usart_iov {
+  const void *base;    //!< start of the segment
+  uint16_t len;        //!< number of bytes in the segment
+  USART_IOV_MEM mem;   //!< memory space holding the segment
+} USART_IOV;
+
+/*! \struct usart_tx_span
+ * \brief Reservation of the transmit ring buffer returned by usart_xreserveTx
+ *
+ * The reservation is split in two parts when it wraps around the end of the ring buffer.
+ */
+typedef struct usart_tx_span {
+  uint8_t *ptr[2];     //!< start of each contiguous part (ptr[1] is NULL if not wrapped)
+  uint16_t len[2];     //!< number of bytes in each part
+} USART_TX_SPAN;
+
+/*! \struct usart_lock_stats
+ * \brief Contention statistics of the mutex serialising the messages written to a USART
+ */
+typedef struct usart_lock_stats {
+  uint16_t contentions;  //!< number of times a task waited for the USART
+  TickType_t maxWait;    //!< longest wait for the USART (ticks)
+  uint32_t totalWait;    //!< sum of the waits for the USART (ticks)
+} USART_LOCK_STATS;
+
+/*! \struct usart_stats
+ * \brief Health counters of a USART: characters lost by cause, traffic and ring buffer high-water marks
+ *
+ * The 16 bit counters saturate at UINT16_MAX.
+ */
+typedef struct usart_stats {
+  uint32_t rxBytes;         //!< characters received (including the ones discarded)
+  uint32_t txBytes;         //!< characters transmitted
+  uint16_t rxFrameErrors;   //!< characters discarded on a framing error (FE)
+  uint16_t rxOverruns;      //!< data overruns (DOR): characters lost because the ISR was late
+  uint16_t rxParityErrors;  //!< characters discarded on a parity error (UPE)
+  uint16_t rxRingFull;      //!< characters lost because the receive ring buffer was full
+  uint16_t txRingFull;      //!< characters dropped (end of a message) because the transmit ring buffer remained full
+  uint16_t rxHighWater;     //!< highest number of characters in the receive ring buffer
+  uint16_t txHighWater;     //!< highest number of characters in the transmit ring buffer
+  uint16_t rxRtsStops;      //!< times RTS was raised because the receive ring buffer reached its high-water mark
+  uint16_t txCtsPauses;     //!< times transmission was paused because the peer raised CTS
+  uint16_t txPriorityMaxDelay; //!< most characters of the bulk ring transmitted while a priority message was waiting (worst-case latency, in character times)
+} USART_STATS;
+
 
 /*-----------------------------------------------------------*/
 //Entry Points - documented in c file
 /*-----------------------------------------------------------*/
 // Initialisation and configuration
 void setDefaultUSART(USART_ID usartId);
-USART_ID usartOpen(USART_ID usartId, uint32_t ulWantedBaud, uint16_t uxTxQueueLength, uint16_t uxRxQueueLength );
+USART_ID usartOpen(USART_ID usartId, uint32_t ulWantedBaud);
 void usartClose(USART_ID usartId );
+UBaseType_t usartSetBaud(USART_ID usartId, uint32_t ulWantedBaud);
+UBaseType_t usart_xsetFlowControl(USART_ID usartId, volatile uint8_t *rtsPort, uint8_t rtsBit, volatile uint8_t *ctsPin, uint8_t ctsBit);
 // Polling functions using default USART
 void usart_printf(const char *, ...);
 void usart_printf_P(PGM_P, ...);
@@ -76,7 +178,24 @@ void usart_xfprint_P(USART_ID, PGM_P);
 void usart_xflushRx(USART_ID);
 uint16_t usart_AvailableCharRx(USART_ID);
 UBaseType_t usart_xgetChar(USART_ID, UBaseType_t * );
+uint16_t usart_xread(USART_ID, uint8_t *, uint16_t, TickType_t);
+uint16_t usart_xreadUntil(USART_ID, uint8_t *, uint16_t, uint8_t, TickType_t);
+void usart_xsetLineTerminator(USART_ID, int16_t);
+uint16_t usart_xreadLine(USART_ID, uint8_t *, uint16_t, TickType_t *);
+void usart_xsetIdleGap(USART_ID, uint8_t);
+uint16_t usart_xreadMessage(USART_ID, uint8_t *, uint16_t, TickType_t);
 UBaseType_t usart_xputChar(USART_ID, const UBaseType_t);
+UBaseType_t usart_xputCharWait(USART_ID, const UBaseType_t, TickType_t);
+UBaseType_t usart_xwritev(USART_ID, const USART_IOV *, uint8_t);
+UBaseType_t usart_xwritevWait(USART_ID, const USART_IOV *, uint8_t, TickType_t);
+uint16_t usart_xreserveTx(USART_ID, uint16_t, USART_TX_SPAN *);
+void usart_xcommitTx(USART_ID, uint16_t);
+UBaseType_t usart_xflushTx(USART_ID, TickType_t);
+void usart_getLockStats(USART_ID, USART_LOCK_STATS *);
+void usart_clearLockStats(USART_ID);
+void usart_getStats(USART_ID, USART_STATS *);
+void usart_clearStats(USART_ID);
+void usart_printStats(USART_ID, USART_ID);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,580 @@
+/*
+ * web_connections.c
+ *
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+/****************************************************************************//*!
+ * \defgroup web_connections Module Web Connections
+ * @{
+******************************************************************************/
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS:
+ * Program file: Section I. Prologue: description about the file, description author(s), revision control
+ * 				information, references, etc.
+ */
+
+/*(Doxygen help: use \brief to provide short summary and \details command can be used)*/
+
+/*!	\file web_connections.c
+ * 	\brief This file defines and implements the web connections functions including APIs.
+ *
+ * \details The stream parser is a state machine fed one character at a time, so a read may end anywhere in a line
+ * or a frame; its state is kept in WEB_CONNECTIONS between reads. Connections are only opened by the caller, on the
+ * CONNECT line of the client: a frame of a CID without a connection (refused, closed or never announced) is
+ * discarded. The data of a bulk data frame is counted, not parsed, so the escape sequences it may hold are data.
+ *
+ * Module APIs:
+ * 	- web_connections_initialize(): empties the table and resets the stream parser.
+ * 	- web_connections_open(), web_connections_close(): add or remove the connection of a CID.
+ * 	- web_connections_receive(): parses characters received from the module.
+ * 	- web_connections_acknowledgement(): answer of the module to the data sent.
+ * 	- web_connections_next_ready(): next connection to serve, in round robin order.
+ * 	- web_connections_expired(): a connection whose request did not complete in time.
+ *
+ */
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS:
+ * Program file: Section II. Include(s): header file includes. System include files and then user include files.
+ * 				Ensure to add comments for an inclusion which is not very obvious. Suggested order of inclusion is
+ * 								System -> Other Modules -> Same Module -> Specific to this file
+ * Note: Avoid nested inclusions.
+ */
+
+/* --Includes-- */
+/* module includes */
+#include "web_connections.h"		/* for module functions */
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS:
+ * Program file: Section III. Defines and typedefs: order of appearance -> constant macros, function macros,
+ * 				typedefs and then enums.
+ * Naming convention: Use upper case and words joined with an underscore (_). Limit  the  use  of  abbreviations.
+ * Constants: define and use constants, rather than using numerical values; it make code more readable, and easier
+ * 			  to modify.
+ */
+
+
+#define ESCAPE_CHARACTER												0x1b							/*!<Escape, starts a data frame or ends it*/
+#define BULK_LENGTH_DIGITS												4								/*!<Digits of the length of a bulk data frame*/
+
+/*States of the stream parser*/
+#define STREAM_LINE														0								/*!<Response line, outside the frames*/
+#define STREAM_ESCAPE													1								/*!<Escape received*/
+#define STREAM_DATA_CID													2								/*!<ESC S received, CID expected*/
+#define STREAM_DATA														3								/*!<Data of ESC S <CID> ... ESC E*/
+#define STREAM_DATA_ESCAPE												4								/*!<Escape received in the data, E expected*/
+#define STREAM_BULK_CID													5								/*!<ESC Z received, CID expected*/
+#define STREAM_BULK_LENGTH												6								/*!<Length digits of ESC Z <CID> <length> expected*/
+#define STREAM_BULK_DATA												7								/*!<Data of a bulk data frame*/
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS:
+ * Program file: Section IV. Global   or   external   data   declarations -> externs, non­static globals, and then
+ * 				static globals.
+ *
+ * Naming convention: variables names must be meaningful lower case and words joined with an underscore (_). Limit
+ * 					  the  use  of  abbreviations.
+ * Guidelines for variable declaration:
+ *				1) Do not group unrelated variables declarations even if of same data type.
+ * 				2) Do not declare multiple variables in one declaration that spans lines. Start a new declaration
+ * 				   on each line, in­stead.
+ * 				3) Move the declaration of each local variable into the smallest scope that includes all its uses.
+ * 				   This makes the program cleaner.
+ */
+
+
+/* NO GLOBAL DATA */
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS
+ * Program file: Section V. Functions: order on abstraction level or usage; and if independent alphabetical
+ * 				or­dering is good choice.
+ *
+ * 1) Declare all the functions (entry points, external functions, local functions, and ISR-interrupt service
+ *    routines) before first function definition in the program file or in header file and include it; and define
+ *    functions in the same order as of declaration.
+ * 2) Suggested order of declaration and definition of functions is
+ * 	  Entry points -> External functions -> Local functions -> ISR-Interrupt Service Routines
+ * 3) Declare function names, parameters (names and types) and re­turn type in one line; if not possible fold it at
+ *    an appropriate place to make it easily readable.
+ * 4) No function definition should be longer than a page or screen long. If it is long, try and split it into two
+ *    or more functions.
+ * 5) Indentation and Spacing: this can improve the readability of the source code greatly. Tabs should be used to
+ *    indent code, rather than spaces; because spaces can often be out by one and lead to confusions.
+ * 6) Keep the length of source lines to 79 characters or less, for max­imum readability.
+ */
+
+/*---------------------------------------  Function Declarations  -------------------------------------------------*/
+/*
+ * Declare all your functions, except for entry points, for the module here; ensure to follow the same order while
+ * defining them later.
+ */
+
+/*Parse one character of the stream*/
+static void web_connections_parse(WEB_CONNECTIONS *web_connections, uint8_t character,
+		WEB_CONNECTIONS_LINE_HANDLER line_handler);
+
+/*Pass the response line to the line handler*/
+static void web_connections_end_line(WEB_CONNECTIONS *web_connections, WEB_CONNECTIONS_LINE_HANDLER line_handler);
+
+/*Find the connection receiving a frame*/
+static uint8_t web_connections_start_frame(WEB_CONNECTIONS *web_connections, uint8_t cid_character);
+
+/*Store a character of a request*/
+static void web_connections_store(WEB_CONNECTIONS *web_connections, uint8_t character);
+
+/*Find the connection of a CID*/
+static uint8_t web_connections_find(WEB_CONNECTIONS *web_connections, uint8_t cid);
+
+/*Value of a hexadecimal digit*/
+static uint8_t web_connections_hex_value(uint8_t character);
+
+/*---------------------------------------  ENTRY POINTS  ---------------------------------------------------------*/
+/*define your entry points here*/
+
+/*(Doxygen help: use \brief to provide short summary, \details for detailed description and \param for parameters */
+
+
+/*!\brief Initialize the connection table.
+ *
+ * \details Frees all the connections and resets the stream parser, at the start of a line.
+ *
+ *
+ * @param web_connections - connection table.
+ *
+ * @return void
+ *
+ */
+void web_connections_initialize(WEB_CONNECTIONS *web_connections){
+	uint8_t index = 0;
+
+	for (index = 0; index < WEB_CONNECTIONS_MAXIMUM; index++){
+		web_connections->connections[index].state = WEB_CONNECTION_FREE;
+	}
+	web_connections->next = 0;
+	web_connections->stream_state = STREAM_LINE;
+	web_connections->stream_connection = WEB_CONNECTION_NONE;
+	web_connections->line_length = 0;
+	web_connections->acknowledgement = WEB_CONNECTIONS_ACKNOWLEDGEMENT_NONE;
+	web_connections->refused = 0;
+}
+
+
+/*!\brief Open the connection of a client.
+ *
+ * \details Called on CONNECT <server CID> <client CID>. A connection already open on the CID is restarted (its
+ * DISCONNECT was missed).
+ *
+ *
+ * @param web_connections - connection table.
+ * @param cid - CID of the client.
+ * @param now - time (ms).
+ *
+ * @return 1 if the connection is open, 0 if the table is full (the client must be closed).
+ *
+ */
+uint8_t web_connections_open(WEB_CONNECTIONS *web_connections, uint8_t cid, uint32_t now){
+	uint8_t index = web_connections_find(web_connections, cid);
+
+	if (index == WEB_CONNECTION_NONE){
+		for (index = 0; index < WEB_CONNECTIONS_MAXIMUM; index++){
+			if (web_connections->connections[index].state == WEB_CONNECTION_FREE){
+				break;
+			}
+		}
+	}
+	if (index >= WEB_CONNECTIONS_MAXIMUM){
+		if (web_connections->refused < UINT16_MAX){
+			web_connections->refused++;
+		}
+		return 0;
+	}
+
+	web_connections->connections[index].cid = cid;
+	web_connections->connections[index].state = WEB_CONNECTION_RECEIVING;
+	web_connections->connections[index].request_length = 0;
+	web_connections->connections[index].request[0] = '\0';
+	web_connections->connections[index].empty_line = 0;
+	web_connections->connections[index].discarded = 0;
+	web_connections->connections[index].open_time = now;
+	return 1;
+}
+
+
+/*!\brief Close the connection of a client.
+ *
+ * \details Called on DISCONNECT <CID>, or once the client is served or expired. A frame being received for the
+ * connection is discarded.
+ *
+ *
+ * @param web_connections - connection table.
+ * @param cid - CID of the client.
+ *
+ * @return void
+ *
+ */
+void web_connections_close(WEB_CONNECTIONS *web_connections, uint8_t cid){
+	uint8_t index = web_connections_find(web_connections, cid);
+
+	if (index != WEB_CONNECTION_NONE){
+		web_connections->connections[index].state = WEB_CONNECTION_FREE;
+		if (web_connections->stream_connection == index){
+			web_connections->stream_connection = WEB_CONNECTION_NONE;
+		}
+	}
+}
+
+
+/*!\brief Count the open connections.
+ *
+ *
+ * @param web_connections - connection table.
+ *
+ * @return the number of connections in use.
+ *
+ */
+uint8_t web_connections_count(WEB_CONNECTIONS *web_connections){
+	uint8_t index = 0;
+	uint8_t count = 0;
+
+	for (index = 0; index < WEB_CONNECTIONS_MAXIMUM; index++){
+		if (web_connections->connections[index].state != WEB_CONNECTION_FREE){
+			count++;
+		}
+	}
+	return count;
+}
+
+
+/*!\brief Parse characters received from Gainspan module.
+ *
+ * \details Splits the stream into the data frames, stored in the request of their connection, and the response
+ * lines, passed to the line handler. The characters may end anywhere, the parser resumes with the next call.
+ *
+ *
+ * @param web_connections - connection table.
+ * @param data - characters received.
+ * @param length - number of characters.
+ * @param line_handler - handler of the response lines, NULL to drop them.
+ *
+ * @return void
+ *
+ */
+void web_connections_receive(WEB_CONNECTIONS *web_connections, const uint8_t *data, uint16_t length,
+		WEB_CONNECTIONS_LINE_HANDLER line_handler){
+	while (length-- > 0){
+		web_connections_parse(web_connections, *data++, line_handler);
+	}
+}
+
+
+/*!\brief Answer of the module to the data sent.
+ *
+ * \details Returns the last ESC O or ESC F parsed since the previous call, and clears it. The caller clears it before
+ * sending a data frame, then parses the characters received until an answer is returned.
+ *
+ *
+ * @param web_connections - connection table.
+ *
+ * @return WEB_CONNECTIONS_ACKNOWLEDGEMENT_OK, WEB_CONNECTIONS_ACKNOWLEDGEMENT_FAILED or
+ * WEB_CONNECTIONS_ACKNOWLEDGEMENT_NONE.
+ *
+ */
+uint8_t web_connections_acknowledgement(WEB_CONNECTIONS *web_connections){
+	uint8_t acknowledgement = web_connections->acknowledgement;
+
+	web_connections->acknowledgement = WEB_CONNECTIONS_ACKNOWLEDGEMENT_NONE;
+	return acknowledgement;
+}
+
+
+/*!\brief Next connection to serve.
+ *
+ * \details Searches the ready connections in round robin order, starting after the connection returned last, so
+ * that each ready connection is returned within WEB_CONNECTIONS_MAXIMUM calls. The connection stays ready until it
+ * is closed.
+ *
+ *
+ * @param web_connections - connection table.
+ *
+ * @return index of the connection in the table, WEB_CONNECTION_NONE if no request is complete.
+ *
+ */
+uint8_t web_connections_next_ready(WEB_CONNECTIONS *web_connections){
+	uint8_t searched = 0;
+	uint8_t index = web_connections->next;
+
+	for (searched = 0; searched < WEB_CONNECTIONS_MAXIMUM; searched++){
+		if (index >= WEB_CONNECTIONS_MAXIMUM){
+			index = 0;
+		}
+		if (web_connections->connections[index].state == WEB_CONNECTION_READY){
+			web_connections->next = index + 1;
+			return index;
+		}
+		index++;
+	}
+	return WEB_CONNECTION_NONE;
+}
+
+
+/*!\brief Find a connection whose request is overdue.
+ *
+ * \details A client that connects and does not complete its request (idle browser connection, slow script) would
+ * hold its entry for ever; the caller closes the connections returned.
+ *
+ *
+ * @param web_connections - connection table.
+ * @param now - time (ms).
+ * @param timeout - time allowed from the connection to the end of the request (ms).
+ *
+ * @return index of an overdue connection in the table, WEB_CONNECTION_NONE if none.
+ *
+ */
+uint8_t web_connections_expired(WEB_CONNECTIONS *web_connections, uint32_t now, uint32_t timeout){
+	uint8_t index = 0;
+
+	for (index = 0; index < WEB_CONNECTIONS_MAXIMUM; index++){
+		if ((web_connections->connections[index].state == WEB_CONNECTION_RECEIVING) &&
+				(now - web_connections->connections[index].open_time >= timeout)){
+			return index;
+		}
+	}
+	return WEB_CONNECTION_NONE;
+}
+
+
+/*---------------------------------------  LOCAL FUNCTIONS  ------------------------------------------------------*/
+/*define your local functions here*/
+
+/*(Doxygen help: use \brief to provide short summary, \details for detailed description and \param for parameters */
+
+
+/*!\brief Parse one character of the stream.
+ *
+ * \details An escape in the data of an ESC S frame, other than ESC E, starts a new sequence (the module does not
+ * send escapes in that data). The answers to the data sent (ESC O, ESC F) are kept for
+ * web_connections_acknowledgement.
+ *
+ *
+ * @param web_connections - connection table.
+ * @param character - character received.
+ * @param line_handler - handler of the response lines, NULL to drop them.
+ *
+ * @return void
+ *
+ */
+static void web_connections_parse(WEB_CONNECTIONS *web_connections, uint8_t character,
+		WEB_CONNECTIONS_LINE_HANDLER line_handler){
+	uint8_t digit = 0;
+
+	switch (web_connections->stream_state){
+	case STREAM_ESCAPE:
+		if (character == 'S'){
+			web_connections->stream_state = STREAM_DATA_CID;
+		}else if (character == 'Z'){
+			web_connections->stream_state = STREAM_BULK_CID;
+		}else if ((character == WEB_CONNECTIONS_ACKNOWLEDGEMENT_OK) || (character == WEB_CONNECTIONS_ACKNOWLEDGEMENT_FAILED)){
+			web_connections->acknowledgement = character;
+			web_connections->stream_state = STREAM_LINE;
+		}else{
+			web_connections->stream_state = STREAM_LINE;
+		}
+		break;
+	case STREAM_DATA_CID:
+		web_connections->stream_connection = web_connections_start_frame(web_connections, character);
+		web_connections->stream_state = STREAM_DATA;
+		break;
+	case STREAM_DATA:
+		if (character == ESCAPE_CHARACTER){
+			web_connections->stream_state = STREAM_DATA_ESCAPE;
+		}else{
+			web_connections_store(web_connections, character);
+		}
+		break;
+	case STREAM_DATA_ESCAPE:
+		web_connections->stream_state = STREAM_ESCAPE;
+		if (character == 'E'){
+			web_connections->stream_state = STREAM_LINE;
+		}else{
+			web_connections_parse(web_connections, character, line_handler);
+		}
+		break;
+	case STREAM_BULK_CID:
+		web_connections->stream_connection = web_connections_start_frame(web_connections, character);
+		web_connections->stream_digits = 0;
+		web_connections->stream_remaining = 0;
+		web_connections->stream_state = STREAM_BULK_LENGTH;
+		break;
+	case STREAM_BULK_LENGTH:
+		digit = character - '0';
+		if (digit > 9){
+			/*Not a bulk data frame*/
+			web_connections->stream_state = STREAM_LINE;
+			break;
+		}
+		web_connections->stream_remaining = web_connections->stream_remaining * 10 + digit;
+		if (++web_connections->stream_digits == BULK_LENGTH_DIGITS){
+			web_connections->stream_state = (web_connections->stream_remaining > 0) ? STREAM_BULK_DATA : STREAM_LINE;
+		}
+		break;
+	case STREAM_BULK_DATA:
+		web_connections_store(web_connections, character);
+		if (--web_connections->stream_remaining == 0){
+			web_connections->stream_state = STREAM_LINE;
+		}
+		break;
+	case STREAM_LINE:
+	default:
+		if (character == ESCAPE_CHARACTER){
+			web_connections_end_line(web_connections, line_handler);
+			web_connections->stream_state = STREAM_ESCAPE;
+		}else if ((character == '\r') || (character == '\n')){
+			web_connections_end_line(web_connections, line_handler);
+		}else if (web_connections->line_length < WEB_CONNECTIONS_LINE_SIZE - 1){
+			web_connections->line[web_connections->line_length++] = character;
+		}
+		break;
+	}
+}
+
+
+/*!\brief Pass the response line to the line handler.
+ *
+ *
+ * @param web_connections - connection table.
+ * @param line_handler - handler of the response lines, NULL to drop them.
+ *
+ * @return void
+ *
+ */
+static void web_connections_end_line(WEB_CONNECTIONS *web_connections, WEB_CONNECTIONS_LINE_HANDLER line_handler){
+	if (web_connections->line_length > 0){
+		web_connections->line[web_connections->line_length] = '\0';
+		web_connections->line_length = 0;
+		if (line_handler != (WEB_CONNECTIONS_LINE_HANDLER) 0){
+			line_handler(web_connections->line);
+		}
+	}
+}
+
+
+/*!\brief Find the connection receiving a frame.
+ *
+ *
+ * @param web_connections - connection table.
+ * @param cid_character - CID of the frame, hexadecimal digit.
+ *
+ * @return index of the connection in the table, WEB_CONNECTION_NONE to discard the frame (no connection).
+ *
+ */
+static uint8_t web_connections_start_frame(WEB_CONNECTIONS *web_connections, uint8_t cid_character){
+	uint8_t cid = web_connections_hex_value(cid_character);
+
+	if (cid == WEB_CONNECTION_NONE){
+		return WEB_CONNECTION_NONE;
+	}
+	return web_connections_find(web_connections, cid);
+}
+
+
+/*!\brief Store a character of a request.
+ *
+ * \details The characters that do not fit are counted, not stored. The request is ready at the empty line ending
+ * its header; the characters received after it are discarded.
+ *
+ *
+ * @param web_connections - connection table.
+ * @param character - character of the frame.
+ *
+ * @return void
+ *
+ */
+static void web_connections_store(WEB_CONNECTIONS *web_connections, uint8_t character){
+	WEB_CONNECTION *connection = 0;
+
+	if (web_connections->stream_connection == WEB_CONNECTION_NONE){
+		return;
+	}
+	connection = &web_connections->connections[web_connections->stream_connection];
+	if (connection->state != WEB_CONNECTION_RECEIVING){
+		return;
+	}
+
+	if (connection->request_length < WEB_CONNECTION_REQUEST_SIZE - 1){
+		connection->request[connection->request_length++] = character;
+		connection->request[connection->request_length] = '\0';
+	}else if (connection->discarded < UINT16_MAX){
+		connection->discarded++;
+	}
+
+	if (character == '\n'){
+		if (++connection->empty_line == 2){
+			connection->state = WEB_CONNECTION_READY;
+		}
+	}else if (character != '\r'){
+		connection->empty_line = 0;
+	}
+}
+
+
+/*!\brief Find the connection of a CID.
+ *
+ *
+ * @param web_connections - connection table.
+ * @param cid - CID of the client.
+ *
+ * @return index of the connection in the table, WEB_CONNECTION_NONE if the CID has no connection.
+ *
+ */
+static uint8_t web_connections_find(WEB_CONNECTIONS *web_connections, uint8_t cid){
+	uint8_t index = 0;
+
+	for (index = 0; index < WEB_CONNECTIONS_MAXIMUM; index++){
+		if ((web_connections->connections[index].state != WEB_CONNECTION_FREE) &&
+				(web_connections->connections[index].cid == cid)){
+			return index;
+		}
+	}
+	return WEB_CONNECTION_NONE;
+}
+
+
+/*!\brief Value of a hexadecimal digit.
+ *
+ *
+ * @param character - digit, 0-9, A-F or a-f.
+ *
+ * @return value of the digit, WEB_CONNECTION_NONE if the character is not a digit.
+ *
+ */
+static uint8_t web_connections_hex_value(uint8_t character){
+	if ((character >= '0') && (character <= '9')){
+		return character - '0';
+	}else if ((character >= 'A') && (character <= 'F')){
+		return character - 'A' + 10;
+	}else if ((character >= 'a') && (character <= 'f')){
+		return character - 'a' + 10;
+	}
+	return WEB_CONNECTION_NONE;
+}
+
+
+/*---------------------------------------  ISR-Interrupt Service Routines  ---------------------------------------*/
+/*define your Interrupt Service Routines here*/
+
+/*(Doxygen help: use \brief to provide short summary, \details for detailed description and \param for parameters */
+
+
+/*NO ISR*/
+
+/*!@}*/   // end module
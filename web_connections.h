@@ -0,0 +1,183 @@
+/*
+ * web_connections.h
+ *
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+/****************************************************************************//*!
+ * \defgroup web_connections Module Web Connections
+ * @{
+******************************************************************************/
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS
+ * Header file: Section I. Prologue: description about the file, description author(s), revision control
+ * 				information, references, etc.
+ * Note: 1. Header files should be functionally organized.
+ *		 2. Declarations   for   separate   subsystems   should   be   in   separate
+ */
+
+/*(Doxygen help: use \brief to provide short summary and \details command can be used)*/
+
+/*!\file web_connections.h
+ * 	\brief This file declares the web connections API functions.
+ *
+ * \details Connection table of the web server: one entry per client connection (CID) of Gainspan module, so that
+ * several clients are accepted, read and answered in turn. The module multiplexes all the clients on its serial
+ * link: response lines (CONNECT, DISCONNECT...) and data frames of each CID, ESC S <CID> <data> ESC E or
+ * ESC Z <CID> <4 digit length> <data>. The stream parser splits them, whatever the boundaries of the reads:
+ * 	- the data of a frame goes to the connection of its CID, in a bounded request buffer;
+ * 	- each complete line outside the frames goes to a line handler (e.g. to route CONNECT and DISCONNECT);
+ * 	- the answer of the module to the data sent, ESC O (accepted) or ESC F (failed), is kept until it is read.
+ *
+ * A connection is ready once the header of its request is complete (empty line). The ready connections are served
+ * in round robin order, so a client waits for at most WEB_CONNECTIONS_MAXIMUM - 1 pages of other clients.
+ *
+ * The module does not depend on the AVR or on freeRTOS (the time is given by the caller), so the host benchmark
+ * (tools/web_server_bench.c) exercises the same code as the robot.
+ *
+ * Module APIs:
+ * 	- web_connections_initialize(): empties the table and resets the stream parser.
+ * 	- web_connections_open(), web_connections_close(): add or remove the connection of a CID.
+ * 	- web_connections_receive(): parses characters received from the module.
+ * 	- web_connections_acknowledgement(): answer of the module to the data sent.
+ * 	- web_connections_next_ready(): next connection to serve, in round robin order.
+ * 	- web_connections_expired(): a connection whose request did not complete in time.
+ *
+ */
+
+
+#ifndef INCLUDE_WEB_CONNECTIONS_H_
+#define INCLUDE_WEB_CONNECTIONS_H_
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS:
+ * Header file: Section II. Include(s): header file includes. System include files and then user include files.
+ * 				Ensure to add comments for an inclusion which is not very obvious. Suggested order of inclusion is
+ * 								System -> Other Modules -> Same Module -> Specific to this file
+ * Note: Avoid nested inclusions.
+ */
+
+#include <stdint.h>
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS
+ * Header file: Section III. Defines and typedefs: order of appearance -> constant macros, function macros,
+ * 				typedefs and then enums.
+ *
+ * Custom data types and typedef: these definitions are best placed in a header file so that all source code
+ * files which rely on that header file have access to the same set of definitions. This also makes it easier
+ * to modify.
+ * Naming convention: Use upper case and words joined with an underscore (_). Limit  the  use  of  abbreviations.
+ * Constants: define and use constants, rather than using numerical values; it make code more readable, and easier
+ * 			  to modify.
+ * Note: Avoid initialized data definitions.
+ */
+
+#ifndef WEB_CONNECTIONS_MAXIMUM
+#define WEB_CONNECTIONS_MAXIMUM											4								/*!<Clients served at the same time; further clients are refused*/
+#endif
+#define WEB_CONNECTION_REQUEST_SIZE										64								/*!<Characters of a request kept (request line), the rest is discarded*/
+#define WEB_CONNECTIONS_LINE_SIZE										48								/*!<Characters of a response line kept, e.g. CONNECT 0 1 192.168.100.100 65535*/
+#define WEB_CONNECTION_NONE												255								/*!<No connection (index in the table)*/
+#define WEB_CONNECTIONS_ACKNOWLEDGEMENT_NONE							0								/*!<No answer to the data sent*/
+#define WEB_CONNECTIONS_ACKNOWLEDGEMENT_OK								'O'								/*!<ESC O, the module accepted the data*/
+#define WEB_CONNECTIONS_ACKNOWLEDGEMENT_FAILED							'F'								/*!<ESC F, the module failed to send the data*/
+
+/*!
+ * \brief State of a client connection.
+ */
+typedef enum{
+	WEB_CONNECTION_FREE = 0,															/*!<Entry not in use*/
+	WEB_CONNECTION_RECEIVING,															/*!<Client connected, request incomplete*/
+	WEB_CONNECTION_READY																/*!<Request complete, waiting to be served*/
+} WEB_CONNECTION_STATE;
+
+/*!
+ * \brief Connection of a client.
+ */
+typedef struct{
+	uint8_t cid;																		/*!<CID of the connection in Gainspan module*/
+	WEB_CONNECTION_STATE state;															/*!<State of the connection*/
+	uint8_t request_length;																/*!<Characters in request*/
+	uint8_t empty_line;																	/*!<Line feeds since the last character other than CR, 2 ends the header*/
+	uint16_t discarded;																	/*!<Characters of the request that did not fit*/
+	uint32_t open_time;																	/*!<Time the client connected (ms), for web_connections_expired*/
+	char request[WEB_CONNECTION_REQUEST_SIZE];											/*!<Start of the request, terminated*/
+} WEB_CONNECTION;
+
+/*!
+ * \brief Handler of the response lines found between the data frames.
+ *
+ * @param line - the line, terminated, without its CR/LF.
+ */
+typedef void (*WEB_CONNECTIONS_LINE_HANDLER)(char *line);
+
+/*!
+ * \brief Connection table and stream parser.
+ */
+typedef struct{
+	WEB_CONNECTION connections[WEB_CONNECTIONS_MAXIMUM];								/*!<Client connections*/
+	uint8_t next;																		/*!<Entry searched first for a ready connection (round robin)*/
+	uint8_t stream_state;																/*!<State of the stream parser*/
+	uint8_t stream_connection;															/*!<Connection receiving the frame, WEB_CONNECTION_NONE if discarded*/
+	uint8_t stream_digits;																/*!<Length digits received of a bulk data frame*/
+	uint16_t stream_remaining;															/*!<Length, then data characters left of a bulk data frame*/
+	uint8_t line_length;																/*!<Characters in line*/
+	char line[WEB_CONNECTIONS_LINE_SIZE];												/*!<Response line being received*/
+	uint8_t acknowledgement;															/*!<Last answer to the data sent (WEB_CONNECTIONS_ACKNOWLEDGEMENT_), until read*/
+	uint16_t refused;																	/*!<Connections refused (table full)*/
+} WEB_CONNECTIONS;
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS:
+ * Header file: Section IV. Global   or   external   data   declarations -> externs, non­static globals, and then
+ * 				static globals.
+ *
+ * Naming convention: variables names must be meaningful lower case and words joined with an underscore (_). Limit
+ * 					  the  use  of  abbreviations.
+ */
+
+
+/* NO GLOBAL DATA */
+
+
+/******************************************************************************************************************/
+/* CODING STANDARDS
+ * Header file: Section V. Functions: order on abstraction level or usage; and if independent alphabetical
+ * 				or­dering is good choice.
+ *
+ * 1) Declare all the entry point functions.
+ * 2) Declare function names, parameters (names and types) and re­turn type in one line; if not possible fold it at
+ *    an appropriate place to make it easily readable.
+ */
+
+
+/*---------------------------------------  ENTRY POINTS  ---------------------------------------------------------*/
+/*Declare your entry points here*/
+
+void web_connections_initialize(WEB_CONNECTIONS *web_connections);
+
+uint8_t web_connections_open(WEB_CONNECTIONS *web_connections, uint8_t cid, uint32_t now);
+
+void web_connections_close(WEB_CONNECTIONS *web_connections, uint8_t cid);
+
+uint8_t web_connections_count(WEB_CONNECTIONS *web_connections);
+
+void web_connections_receive(WEB_CONNECTIONS *web_connections, const uint8_t *data, uint16_t length,
+		WEB_CONNECTIONS_LINE_HANDLER line_handler);
+
+uint8_t web_connections_acknowledgement(WEB_CONNECTIONS *web_connections);
+
+uint8_t web_connections_next_ready(WEB_CONNECTIONS *web_connections);
+
+uint8_t web_connections_expired(WEB_CONNECTIONS *web_connections, uint32_t now, uint32_t timeout);
+
+#endif /* INCLUDE_WEB_CONNECTIONS_H_ */
+
+/*!@}*/   // end module
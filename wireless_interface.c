@@ -64,10 +64,11 @@
  *
  * Usage guide (For "Limited AP" or hot-spot mode):
  *
- * 		=> Set SET_GAINSPAN_TERMINAL_OUTPUT_ON to 1 in "gainspan_gs1011m.h" to get the command response/progress on
- * 			serial terminal.
- *
- * 		=> Set SET_WEB_SERVER_TERMINAL_OUTPUT_ON to 1 in "web_server.h" to get server logs on serial terminal.
+ * 		=> The progress and server logs are sent as tokenized log messages (see log_messages.h) on the telemetry
+ * 			port; decode them with tools/telemetry_decoder. Their level is set per module (LOG_MODULE_GAINSPAN,
+ * 			LOG_MODULE_WEB_SERVER) with logSetLevel, up to LOG_COMPILE_LEVEL (see logging.h); build with
+ * 			LOG_COMPILE_LEVEL=LOG_LEVEL_DEBUG and call logSetLevel(LOG_MODULE_GAINSPAN, LOG_LEVEL_DEBUG) to get
+ * 			every command and response.
  *
  * 		=> Initialize USART0 and USART2
  *
@@ -83,6 +84,11 @@
  *
  * 			Example: gs_set_wireless_ssid("WifiTeamX")
  *
+ * 		=> Optionally call gs_set_baud_rate(BAUD_RATE target_baud_rate) to switch the link with the module to a
+ * 			higher baud rate; the link falls back to the current baud rate on failure.
+ *
+ * 			Example: gs_set_baud_rate(BAUD_RATE_115200);
+ *
  * 		=> Call gs_activate_wireless_connection(), to activate wireless network with configuration parameters
  *			defined in earlier step. Status will be returned defined by GAINSPAN_ACTIVE, which you can verify.
  *
@@ -107,7 +113,8 @@
  * 			call start_web_server();
  *
  * 		=> Serve the incoming connection request from clients, ensure to call this function from task with
- * 			a sufficiently high frequency to serve all the request and avoid time-out for clients.
+ * 			a sufficiently high frequency to serve all the request and avoid time-out for clients. Up to
+ * 			WEB_CONNECTIONS_MAXIMUM clients are served at the same time, in turn (see web_connections.h).
  *
  * 			call process_client_request();
  *
@@ -139,17 +146,31 @@
 /* --Includes-- */
 /* FreeRTOS includes */
 #include "FreeRTOS.h" 						/* for various kernel functions */
+#include "queue.h"							/* for the requests of the AT command engine */
+#include "semphr.h"							/* for the mutex of the link with the module */
+#include "task.h"							/* for the AT command engine task and its notifications */
 
 #include <stdio.h>							/* for text string formatting functions */
 #include <string.h>
 #include <stdlib.h>
+#include <ctype.h>							/* for the bounds of the values found in status responses */
 
 #include <avr/io.h>
 #include <util/delay.h>
 
+/* other modules */
+#include "compact_format.h"					/* for command formatting without the printf family */
+#include "custom_timer.h"					/* for round trip and page serve times */
+#include "logging.h"						/* for the terminal output, as tokenized log messages */
+#include "web_connections.h"				/* for the connections of the web clients */
+
 /* module includes */
 #include "wireless_interface.h"				/* module include */
 
+#if (configTASK_NOTIFICATION_ARRAY_ENTRIES <= GS_AT_NOTIFY_INDEX) || (GS_AT_NOTIFY_INDEX == USART_NOTIFY_INDEX) || (GS_AT_NOTIFY_INDEX == 0)
+#error "wireless_interface: GS_AT_NOTIFY_INDEX must be a notification entry of its own (configTASK_NOTIFICATION_ARRAY_ENTRIES, FreeRTOSConfig.h)"
+#endif
+
 
 /******************************************************************************************************************/
 /* CODING STANDARDS:
@@ -164,13 +185,52 @@
 #define CHARACTERS_TO_READ_FROM_GAINSPAN_RESPONSE 						128							/*!<Number of characters to read from response from Gainspan module*/
 #define GENERAL_SIZE 													128							/*!<Number of characters for SSID, ID, and passwords*/
 #define IP_SIZE 														15							/*!<Number of characters for IP, Subnet, gateway*/
-/*Polling interval, after issuing command, to check availability of response from Gainspan*/
-#define COMMAND_RESPONSE_POLLING_INTERVAL_IN_MILLISECONDS				5							/*!<Polling interval, after issuing command, to check availability of response from Gainspan*/
+#define COMMAND_BUFFER_SIZE 											112							/*!<Number of characters for a command sent to Gainspan module: AT+WPAPSK=<SSID, 32>,<passphrase, 63>, terminator; longer commands are not sent*/
+/*Maximum time to block on a full transmit ring buffer while writing data to a socket*/
+#define SOCKET_WRITE_TIMEOUT_IN_MILLISECONDS							500							/*!<Maximum time to wait for space in the transmit buffer when writing data to a socket*/
+#define WEB_SERVER_POLLING_PERIOD_IN_MILLISECONDS						30							/*!<Time process_client_request waits for data from the clients*/
+#define WEB_SERVER_REQUEST_TIMEOUT_IN_MILLISECONDS						2000							/*!<Time allowed to a client from its connection to the end of its request, then it is closed*/
+/*Link check when changing the baud rate*/
+#define LINK_CHECK_ATTEMPTS												2							/*!<AT commands sent to check the link, the first command after power up may fail*/
 
 #define HTML_ELEMENT_LABEL_SIZE 										40							/*!<Label size (characters) for HTML elements on web-page*/
 #define WEB_PAGE_ELEMENTS 												10							/*!<Number of elements on web-page*/
 #define WEB_TITLE_SIZE 													128							/*!<Title size (characters) for web-page/menu-title*/
+#define WEB_PAGE_RENDERED_SIZE											768							/*!<Size (characters) of the rendered web-page with its HTTP header, longer pages are truncated*/
 #define MIN(X, Y) 														((X) < (Y) ? (X) : (Y)) 	/*!<Min of two numbers*/
+
+/*Activation script step flags (GS_ACTIVATION_STEP)*/
+#define GS_STEP_RETRY													0x01						/*!<Sent again once on failure, the first command after power up may fail*/
+#define GS_STEP_LIMITED_AP												0x02						/*!<Only in WIRELESS_MODE_LIMITEDAP*/
+#define GS_STEP_FLOW_CONTROL											0x04						/*!<Enables hardware flow control on the MCU side first, disables it on failure*/
+#define GS_STEP_SKIP_WHEN_UP											0x08						/*!<Skipped when the state queries show the module up as configured (warm reboot of the MCU)*/
+#define GS_STEP_CHECK_ASSOCIATED										0x10						/*!<State query: associated with the configured SSID (AT+WSTAT=?)*/
+#define GS_STEP_CHECK_NETWORK											0x20						/*!<State query: configured with the local IP address (AT+NSTAT=?)*/
+#define GS_MODULE_UP													(GS_STEP_CHECK_ASSOCIATED | GS_STEP_CHECK_NETWORK)	/*!<Module state when all the state queries are satisfied*/
+#define GS_STEP_SKIPPED													3							/*!<Outcome logged for a skipped step, after the values of COMMAND_OUTCOME*/
+/*!\brief Step of the activation script.
+ *
+ * \details Command sent by gs_activate_wireless_connection, and when (GS_STEP_ flags).
+ *
+ */
+typedef struct _GS_ACTIVATION_STEP {
+	AT_COMMAND at_command;													/*!<Command, parameters are taken from the configuration of the module*/
+	uint8_t step_flags;														/*!<GS_STEP_ flags*/
+} GS_ACTIVATION_STEP;
+
+
+/*!\brief State query in progress (context of its AT command request).
+ *
+ * \details Filled line by line by gs_check_state_line, from the AT command engine task.
+ *
+ */
+typedef struct _GS_STATE_QUERY {
+	char *expected_value;													/*!<Configuration value the response must show (SSID, local IP address)*/
+	BOOLEAN_DATA value_found;												/*!<A line shows the value*/
+	BOOLEAN_DATA not_connected;												/*!<A line reports NOT CONNECTED*/
+} GS_STATE_QUERY;
+
+
 /*!\brief Data structure to hold web-server configuration parameters.
  *
  * \details Data structure to hold web-server configuration parameters.
@@ -236,6 +296,9 @@ typedef struct _HTML_WEB_PAGE {
 	HTML_ELEMENT_TYPE element_type;											/*!<HTML element type for the web-page*/
 	HTML_ELEMENT_CHOICE web_page_elements[WEB_PAGE_ELEMENTS];				/*!<HTML elements for web-page*/
 	uint8_t element_count;													/*!<HTML element count added*/
+	char rendered_page[WEB_PAGE_RENDERED_SIZE];								/*!<HTTP header and HTML of the web-page, rendered by gs_render_web_page and sent as is to each client*/
+	uint16_t rendered_length;												/*!<Length of rendered_page, 0 when the web-page changed since it was rendered*/
+	BOOLEAN_DATA rendered_truncated;										/*!<The web-page did not fit in rendered_page, it is not served*/
 } HTML_WEB_PAGE;
 
 
@@ -311,13 +374,130 @@ const char *gs_at_commands[] = {
 		"AT+NSUDP=",									/*Start the UDP server connection with IPv4 address:<Port>*/
 		"AT+NCUDP=",									/*Create a UDP client connection to the remote server with IPv4:<Dest-Address>,<Port>[<,Src.Port>]*/
 		"AT+NCLOSE=",									/*Close the connection associated with current active socket by identifying CID:<CID>*/
-		"TCP_RESPONSE" 									/*This is not a command, it is used to identify and send message to serial/terminal*/
-		"AT_COMMAND_INVALID" 							/*Not a command, it is an identifier for invalid command*/
+		"TCP_RESPONSE",									/*This is not a command, it is used to identify and send message to serial/terminal*/
+		"AT_COMMAND_INVALID",							/*Not a command, it is an identifier for invalid command*/
+		/*Provisioning*/
+		"AT+WEBPROV=",									/*Start support provisioning through web pages:<user name>,<password>[,SSL Enabled,Param StoreOption,idletimeout,ncmautoconnect]*/
+		"AT+WEBPROVSTOP",								/*Stop support provisioning through web pages*/
+		/*Serial-to-WiFi profile configuration*/
+		"AT&K1",										/*Enable (1) hardware flow control*/
+		/*Connection management configuration*/
+		"AT+NCLOSEALL",									/*Close all the connections*/
+};
+_Static_assert( sizeof(gs_at_commands) / sizeof(gs_at_commands[0]) == AT_COMMAND_COUNT,
+	"gs_at_commands: one entry per AT command identifier" );
+
+
+/*Response timeouts for Gainspan GS1011M commands*/
+/*!
+ * \brief Gainspan module command response timeouts, in milliseconds;
+ *
+ *
+ * \details Maximum time to wait for the final result line (OK, ERROR or INVALID CID) of each command, in the order
+ * of gs_at_commands. A command completes as soon as its final result line arrives (see gs_get_command_response),
+ * so the timeout is only spent when the module does not answer.
+ *
+ */
+const uint16_t gs_at_command_timeouts[] PROGMEM = {
+		/*Serial-to-WiFi profile configuration*/
+		300,											/*AT*/
+		300,											/*ATE0*/
+		300,											/*ATV1*/
+		300,											/*ATB=*/
+		300,											/*ATI0*/
+		300,											/*ATI1*/
+		300,											/*ATI2*/
+		/*WiFi interface configuration*/
+		300,											/*AT+NMAC=?*/
+		300,											/*AT+WS=*/
+		300,											/*AT+WM=*/
+		1500,											/*AT+WA=*/
+		300,											/*AT+WD*/
+		300,											/*AT+NSTAT=?*/
+		300,											/*AT+WSTAT=?*/
+		300,											/*AT+WRSSI=?*/
+		300,											/*AT+WRATE=*/
+		300,											/*AT+WRATE=?*/
+		/*WiFi Security Configuration	*/
+		300,											/*AT+WAUTH=*/
+		300,											/*AT+WSEC=*/
+		300,											/*AT+WWPA=*/
+		300,											/*AT+WPAPSK=*/
+		300,											/*AT+WRXACTIVE=0*/
+		300,											/*AT+WRXACTIVE=1*/
+		300,											/*AT+WRXPS=0*/
+		300,											/*AT+WRXPS=1*/
+		/*Network interface*/
+		300,											/*AT+NDHCP=0*/
+		300,											/*AT+NDHCP=1*/
+		300,											/*AT+NSET=*/
+		300,											/*AT+DHCPSRVR=0*/
+		300,											/*AT+DHCPSRVR=1*/
+		300,											/*AT+DNS=0*/
+		300,											/*AT+DNS=1*/
+		300,											/*AT+DNSLOOKUP=*/
+		/*GSLink*/
+		300,											/*AT+WEBSERVER=0*/
+		300,											/*AT+WEBSERVER=1*/
+		300,											/*AT+XMLPARSE=0*/
+		300,											/*AT+XMLPARSE=1*/
+		/*Connection management configuration*/
+		300,											/*AT+NSTCP=*/
+		300,											/*AT+NCTCP=*/
+		300,											/*AT+NSUDP=*/
+		300,											/*AT+NCUDP=*/
+		1000,											/*AT+NCLOSE=*/
+		0,											/*TCP_RESPONSE*/
+		0,											/*AT_COMMAND_INVALID*/
 		/*Provisioning*/
-		//"AT+WEBPROV=",								/*Start support provisioning through web pages:<user name>,<password>[,SSL Enabled,Param StoreOption,idletimeout,ncmautoconnect]*/
-		//"AT+WEBPROVSTOP",								/*Stop support provisioning through web pages*/
+		300,											/*AT+WEBPROV=*/
+		300,											/*AT+WEBPROVSTOP*/
+		/*Serial-to-WiFi profile configuration*/
+		300,											/*AT&K1*/
+		/*Connection management configuration*/
+		1000,											/*AT+NCLOSEALL*/
+};
+_Static_assert( sizeof(gs_at_command_timeouts) / sizeof(gs_at_command_timeouts[0]) == AT_COMMAND_COUNT,
+	"gs_at_command_timeouts: one entry per AT command identifier" );
+
+
+/*Activation script for Gainspan GS1011M*/
+/*!
+ * \brief Gainspan module activation script;
+ *
+ *
+ * \details Commands sent by gs_activate_wireless_connection, in order. The state queries tell whether the module
+ * is still up as configured (the MCU was reset, not the module); the steps marked GS_STEP_SKIP_WHEN_UP are then
+ * skipped. The connections are always closed, so that start_web_server does not find the TCP server (and its
+ * clients) of the previous run still open on the module.
+ *
+ */
+const GS_ACTIVATION_STEP gs_activation_script[] PROGMEM = {
+		{AT_OK,										GS_STEP_RETRY},											/*Test connection with device*/
+		{AT_DISABLE_ECHO,							0},														/*Echo off*/
+#if SET_GAINSPAN_FLOW_CONTROL_ON
+		{AT_ENABLE_HARDWARE_FLOW_CONTROL,			GS_STEP_FLOW_CONTROL},									/*Hardware flow control*/
+#endif
+		{AT_GET_CURRENT_WIRELESS_NETWORK_STATUS,	GS_STEP_LIMITED_AP | GS_STEP_CHECK_ASSOCIATED},			/*Query: network created with the SSID*/
+		{AT_GET_CURRENT_NETWORK_STATUS,				GS_STEP_LIMITED_AP | GS_STEP_CHECK_NETWORK},			/*Query: local IP address set*/
+		{AT_CLOSE_ALL_CONNECTIONS,					0},														/*Close the server and clients left open by a reset of the MCU*/
+		{AT_STOP_DHCP_SERVER_IPV4,					GS_STEP_SKIP_WHEN_UP},									/*Stop DHCP server*/
+		{AT_DISASSOCIATE_CURRENT_NETWORK,			GS_STEP_SKIP_WHEN_UP},									/*Dis-associate current network*/
+		{AT_DISABLE_DHCP_IPV4,						GS_STEP_SKIP_WHEN_UP},									/*Disable DHCP*/
+		{AT_SET_STATIC_NETWORK_PARAMTERS_IPV4,		GS_STEP_LIMITED_AP | GS_STEP_SKIP_WHEN_UP},				/*Set network stack parameters*/
+		{AT_SET_WIRELESS_MODE,						GS_STEP_LIMITED_AP | GS_STEP_SKIP_WHEN_UP},				/*Set wireless mode*/
+		{AT_ASSOCIATE_START_NETWORK,				GS_STEP_LIMITED_AP | GS_STEP_SKIP_WHEN_UP},				/*Create infrastructure network*/
+		{AT_START_DHCP_SERVER_IPV4,					GS_STEP_LIMITED_AP | GS_STEP_SKIP_WHEN_UP},				/*Start DHCP server*/
 };
 
+#define GS_ACTIVATION_STEPS												(sizeof(gs_activation_script) / sizeof(gs_activation_script[0]))	/*!<Number of steps of the activation script*/
+
+
+/*Gainspan data mode framing*/
+const char gs_frame_end[] PROGMEM = {0x1b, 0x45};								/*!<TCP Data end - Escape, E 0x45*/
+const char gs_frame_close[] PROGMEM = {0x1b, 0x43};								/*!<TCP connection close - Escape, C 0x43*/
+const char gs_frame_new_line[] PROGMEM = {'\n', '\r'};							/*!<Line termination appended to single character data*/
+
 
 /*Structure holds Gainspan device socket table*/
 /*!
@@ -408,6 +588,11 @@ char *client_response_buffer;															/*!<Circular buffer/Variable to hold
 uint8_t client_response_buffer_write_pointer = 0;										/*!<Write pointer*/
 uint8_t client_response_buffer_read_pointer = 0;										/*!<Read pointer*/
 WEB_SERVER_STATUS web_server_status = WEB_SERVER_NOT_ACTIVE;							/*!<Web server status*/
+WEB_CONNECTIONS web_connections;										/*!<Connections of the web clients, one per client CID*/
+
+QueueHandle_t gs_at_queue = NULL;														/*!<Requests (GS_AT_REQUEST pointers) waiting for the AT command engine*/
+TaskHandle_t gs_at_engine_handle = NULL;												/*!<AT command engine task, NULL until it runs*/
+SemaphoreHandle_t gs_link_mutex = NULL;													/*!<Held for an exchange with the module: a command and its response, or a client request*/
 
 
 /******************************************************************************************************************/
@@ -437,9 +622,15 @@ WEB_SERVER_STATUS web_server_status = WEB_SERVER_NOT_ACTIVE;							/*!<Web serve
 
 void gs_initialize_gainspan(void);
 
-void gs_send_command(AT_COMMAND at_command);
+SUCCESS_ERROR gs_send_command(AT_COMMAND at_command);
+
+uint16_t gs_get_command_response(char *gs_command_response, uint16_t polling_period_in_milliseconds, GS_AT_REQUEST *request);
 
-uint16_t gs_get_command_response(char *gs_command_response, uint16_t polling_period_in_milliseconds);
+uint16_t gs_get_data_response(char *gs_data_response, uint16_t polling_period_in_milliseconds);
+
+BOOLEAN_DATA gs_is_final_result(char *response_line);
+
+uint16_t gs_get_command_timeout(AT_COMMAND at_command);
 
 COMMAND_OUTCOME gs_parse_command_response(char *gs_command_response);
 
@@ -449,8 +640,46 @@ void gs_send_command_response_to_serial_terminal(AT_COMMAND at_command, COMMAND_
 
 void gs_send_activation_status_to_serial_terminal(GAINSPAN_ACTIVE gs_active);
 
+BOOLEAN_DATA gs_route_unsolicited_event(char *response_line);
+
+COMMAND_OUTCOME gs_check_link(unsigned long *round_trip_in_milliseconds);
+
+BOOLEAN_DATA gs_query_module_state(AT_COMMAND at_command);
+
+void gs_check_state_line(GS_AT_REQUEST *request, char *response_line);
+
+BOOLEAN_DATA gs_response_has_value(char *response_line, char *value);
+
+void gs_at_engine_initialize(void);
+
+COMMAND_OUTCOME gs_exchange_command(GS_AT_REQUEST *request);
+
+COMMAND_OUTCOME gs_execute_request(GS_AT_REQUEST *request);
+
+void gs_link_lock(void);
+
+void gs_link_unlock(void);
+
 void initialize_web_server(uint16_t port, uint8_t protocol);
 
+void gs_render_web_page(void);
+
+SUCCESS_ERROR gs_send_bulk_data(uint8_t cid, const uint8_t *data, uint16_t data_length);
+
+COMMAND_OUTCOME gs_wait_data_acknowledgement(void);
+
+void gs_close_client_connection(uint8_t cid);
+
+void gs_receive_client_data(uint16_t polling_period_in_milliseconds);
+
+void gs_route_client_line(char *line);
+
+uint8_t gs_web_client_cid(char *response_line);
+
+void gs_serve_client(uint8_t connection);
+
+void gs_log_link_stats(void);
+
 uint8_t hex_to_int(char character);
 
 char int_to_hex(uint8_t character);
@@ -479,6 +708,10 @@ char int_to_hex(uint8_t character);
 void gs_initialize_module(USART_ID target_usart_id, BAUD_RATE target_baud_rate, USART_ID target_serial_terminal_usart_id, BAUD_RATE target_serial_terminal_baud_rate){
 	/*Initialize the data structure*/
 	gs_initialize_gainspan();
+	/*Request queue and link mutex*/
+	gs_at_engine_initialize();
+	/*Stream parser, which also finds the answers to data frames before the web server is started*/
+	web_connections_initialize(&web_connections);
 	/*set the USART*/
 	gs_set_usart(target_usart_id, target_baud_rate, target_serial_terminal_usart_id, target_serial_terminal_baud_rate);
 }
@@ -504,6 +737,72 @@ void gs_set_usart(USART_ID target_usart_id, BAUD_RATE target_baud_rate, USART_ID
 
 	gainspan.serial_terminal_usart_id = target_serial_terminal_usart_id;
 	gainspan.serial_terminal_baud_rate = target_serial_terminal_baud_rate;
+
+	/*Responses are read line by line, the USART indexes the end of each line*/
+	usart_xsetLineTerminator(gainspan.usart_id, '\n');
+	/*A response ends when the line goes idle*/
+	usart_xsetIdleGap(gainspan.usart_id, GAINSPAN_RESPONSE_IDLE_GAP_IN_CHARACTER_TIMES);
+}
+
+
+/*!
+ * \brief Switch the link with Gainspan module to another baud rate.
+ *
+ *
+ * \details Checks the link at the current baud rate, sends AT_SET_USART (the module acknowledges at the current
+ * baud rate, then switches), changes the baud rate of the MCU USART and checks the link again with AT. On failure,
+ * the MCU USART falls back to the previous baud rate. If the module does not answer at the current baud rate, the
+ * target baud rate is tried, as the module keeps it when only the MCU is reset.
+ *
+ * \note The round trip time of AT is sent to the serial terminal, before and after the switch.
+ *
+ * @param target_baud_rate - Baud rate for communication with Gainspan WiFi module.
+ * @return - SUCCESS if the link works at the target baud rate, else ERROR (link at the previous baud rate).
+ *
+ */
+SUCCESS_ERROR gs_set_baud_rate(BAUD_RATE target_baud_rate){
+	BAUD_RATE previous_baud_rate = gainspan.baud_rate;
+	unsigned long round_trip_before = 0, round_trip_after = 0;
+	COMMAND_OUTCOME command_result = COMMAND_OUTCOME_NO_RESPONSE;
+	SUCCESS_ERROR process_result = ERROR;
+
+	if (gs_check_link(&round_trip_before) == COMMAND_OUTCOME_SUCCESS){
+		if (target_baud_rate == previous_baud_rate){
+			return SUCCESS;
+		}
+		/*Module answers OK at the current baud rate, then switches*/
+		gainspan.baud_rate = target_baud_rate;
+		command_result = gs_execute_command(AT_SET_USART, SOCKET_MODE_NONE);
+	}else{
+		/*No answer: the module may already be at the target baud rate*/
+		gainspan.baud_rate = target_baud_rate;
+		command_result = COMMAND_OUTCOME_SUCCESS;
+	}
+
+	if (command_result == COMMAND_OUTCOME_SUCCESS){
+		usartSetBaud(gainspan.usart_id, target_baud_rate);
+		gs_flush();
+		if (gs_check_link(&round_trip_after) == COMMAND_OUTCOME_SUCCESS){
+			process_result = SUCCESS;
+		}
+	}
+
+	if (process_result == ERROR){
+		/*Fall back to the previous baud rate*/
+		gainspan.baud_rate = previous_baud_rate;
+		usartSetBaud(gainspan.usart_id, previous_baud_rate);
+		gs_flush();
+	}
+
+	if (process_result == SUCCESS){
+		LOG_INFO(LOG_MODULE_GAINSPAN, LOG_GS_BAUD_RATE_SWITCHED, (uint32_t) target_baud_rate,
+				round_trip_before, (uint32_t) previous_baud_rate, round_trip_after, (uint32_t) target_baud_rate);
+	}else{
+		LOG_WARNING(LOG_MODULE_GAINSPAN, LOG_GS_BAUD_RATE_FAILED, (uint32_t) target_baud_rate,
+				round_trip_before, (uint32_t) previous_baud_rate, round_trip_after, (uint32_t) target_baud_rate);
+	}
+
+	return process_result;
 }
 
 
@@ -587,7 +886,10 @@ void gs_set_webserver_authentication(WEBSERVER_AUTHENTICATION_PROFILE target_web
  * \brief Activate Gainspan WiFi device using the configuration parameters.
  *
  *
- * \details Activates Gaispan WiFi device using the configuration parameters from structure GAINSPAN.
+ * \details Activates Gaispan WiFi device using the configuration parameters from structure GAINSPAN, by running
+ * the activation script (gs_activation_script). When the state queries show the module up as configured, i.e. the
+ * MCU was reset but not the module, the configuration steps are skipped. The time taken by each step is sent to the
+ * serial terminal.
  *
  * \note: Current implementation allows only Limited AP mode.
  *
@@ -596,170 +898,61 @@ void gs_set_webserver_authentication(WEBSERVER_AUTHENTICATION_PROFILE target_web
  *
  */
 GAINSPAN_ACTIVE gs_activate_wireless_connection(void){
-	char gs_command_response[MAX_TX_BUFFER] = "\0";
 	GAINSPAN_ACTIVE gs_active = GAINSPAN_ACTIVE_FALSE;
-	uint16_t number_of_characters_read = 0;
 	COMMAND_OUTCOME command_result = COMMAND_OUTCOME_SUCCESS;
 	uint8_t command_outcomes_success = 0, command_outcomes_errors = 0;
-
-	#if SET_GAINSPAN_TERMINAL_OUTPUT_ON == 1
-		/*Send message to serial terminal*/
-		usart_xfprint(gainspan.serial_terminal_usart_id, (uint8_t *) "\n\rGainspan Device: activation in progress....\n\r");
-	#endif
-
-	/*Test connection with device. Observed while testing that the first command always gets error; hence sending AT-OK two times*/
-	strcpy(gs_command_response, "\0");
-	gs_send_command(AT_OK);
-	number_of_characters_read = gs_get_command_response(gs_command_response, 300);
-	command_result = gs_parse_command_response(gs_command_response);
-	#if SET_GAINSPAN_TERMINAL_OUTPUT_ON == 1
-		gs_send_command_response_to_serial_terminal(AT_OK, command_result);
-	#endif
-	/*do not include this towards outcome success or error*/
-
-	strcpy(gs_command_response, "\0");
-	gs_send_command(AT_OK);
-	number_of_characters_read = gs_get_command_response(gs_command_response, 300);
-	command_result = gs_parse_command_response(gs_command_response);
-	#if SET_GAINSPAN_TERMINAL_OUTPUT_ON == 1
-		gs_send_command_response_to_serial_terminal(AT_OK, command_result);
-	#endif
-	if(command_result == COMMAND_OUTCOME_SUCCESS){
-		command_outcomes_success++;
-	}else{
-		command_outcomes_errors++;
-	}
-
-	/*Echo off*/
-	strcpy(gs_command_response, "\0");
-	gs_send_command(AT_DISABLE_ECHO);
-	number_of_characters_read = gs_get_command_response(gs_command_response, 300);
-	command_result = gs_parse_command_response(gs_command_response);
-	#if SET_GAINSPAN_TERMINAL_OUTPUT_ON == 1
-		gs_send_command_response_to_serial_terminal(AT_DISABLE_ECHO, command_result);
-	#endif
-	if(command_result == COMMAND_OUTCOME_SUCCESS){
-		command_outcomes_success++;
-	}else{
-		command_outcomes_errors++;
-	}
-
-	/*Get Device MAC Address*/
-	//Handle the response first
-	/*
-	strcpy(gs_command_response, "\0");
-	gs_send_command(AT_GET_DEVICE_MAC_ADDRESS);
-	number_of_characters_read = gs_get_command_response(gs_command_response, 300);
-	command_result = gs_parse_command_response(gs_command_response);
-	#if SET_GAINSPAN_TERMINAL_OUTPUT_ON == 1
-		gs_send_command_response_to_serial_terminal(AT_GET_DEVICE_MAC_ADDRESS, command_result);
-	#endif
-	(if(command_result == COMMAND_OUTCOME_SUCCESS){
-		command_outcomes_success++;
-	}else{
-		command_outcomes_errors++;
-	}*/
-
-	/*Stop DHCP server*/
-	strcpy(gs_command_response, "\0");
-	gs_send_command(AT_STOP_DHCP_SERVER_IPV4);
-	number_of_characters_read = gs_get_command_response(gs_command_response, 300);
-	command_result = gs_parse_command_response(gs_command_response);
-	#if SET_GAINSPAN_TERMINAL_OUTPUT_ON == 1
-		gs_send_command_response_to_serial_terminal(AT_STOP_DHCP_SERVER_IPV4, command_result);
-	#endif
-	if(command_result == COMMAND_OUTCOME_SUCCESS){
-		command_outcomes_success++;
-	}else{
-		command_outcomes_errors++;
-	}
-
-	/*Dis-associate current network*/
-	strcpy(gs_command_response, "\0");
-	gs_send_command(AT_DISASSOCIATE_CURRENT_NETWORK);
-	number_of_characters_read = gs_get_command_response(gs_command_response, 300);
-	command_result = gs_parse_command_response(gs_command_response);
-	#if SET_GAINSPAN_TERMINAL_OUTPUT_ON == 1
-		gs_send_command_response_to_serial_terminal(AT_DISASSOCIATE_CURRENT_NETWORK, command_result);
-	#endif
-	if(command_result == COMMAND_OUTCOME_SUCCESS){
-		command_outcomes_success++;
-	}else{
-		command_outcomes_errors++;
-	}
-
-	/*Disable DHCP*/
-	strcpy(gs_command_response, "\0");
-	gs_send_command(AT_DISABLE_DHCP_IPV4);
-	number_of_characters_read = gs_get_command_response(gs_command_response, 300);
-	command_result = gs_parse_command_response(gs_command_response);
-	#if SET_GAINSPAN_TERMINAL_OUTPUT_ON == 1
-		gs_send_command_response_to_serial_terminal(AT_DISABLE_DHCP_IPV4, command_result);
-	#endif
-	if(command_result == COMMAND_OUTCOME_SUCCESS){
-		command_outcomes_success++;
-	}else{
-		command_outcomes_errors++;
-	}
-
-	if (gainspan.wireless_mode == WIRELESS_MODE_LIMITEDAP){
-		/*Set network stack parameters*/
-		strcpy(gs_command_response, "\0");
-		gs_send_command(AT_SET_STATIC_NETWORK_PARAMTERS_IPV4);
-		number_of_characters_read = gs_get_command_response(gs_command_response, 300);
-		command_result = gs_parse_command_response(gs_command_response);
-		#if SET_GAINSPAN_TERMINAL_OUTPUT_ON == 1
-			gs_send_command_response_to_serial_terminal(AT_SET_STATIC_NETWORK_PARAMTERS_IPV4, command_result);
-		#endif
-		if(command_result == COMMAND_OUTCOME_SUCCESS){
-			command_outcomes_success++;
-		}else{
-			command_outcomes_errors++;
-		}
-
-		/*Set wireless mode*/
-		strcpy(gs_command_response, "\0");
-		gs_send_command(AT_SET_WIRELESS_MODE);
-		number_of_characters_read = gs_get_command_response(gs_command_response, 300);
-		command_result = gs_parse_command_response(gs_command_response);
-		#if SET_GAINSPAN_TERMINAL_OUTPUT_ON == 1
-			gs_send_command_response_to_serial_terminal(AT_SET_WIRELESS_MODE, command_result);
-		#endif
-		if(command_result == COMMAND_OUTCOME_SUCCESS){
-			command_outcomes_success++;
-		}else{
-			command_outcomes_errors++;
-		}
-
-		/*Create infrastructure network*/
-		strcpy(gs_command_response, "\0");
-		gs_send_command(AT_ASSOCIATE_START_NETWORK);
-		number_of_characters_read = gs_get_command_response(gs_command_response, 1500);
-		command_result = gs_parse_command_response(gs_command_response);
-		#if SET_GAINSPAN_TERMINAL_OUTPUT_ON == 1
-			gs_send_command_response_to_serial_terminal(AT_ASSOCIATE_START_NETWORK, command_result);
-		#endif
-		if(command_result == COMMAND_OUTCOME_SUCCESS){
-			command_outcomes_success++;
-		}else{
-			command_outcomes_errors++;
+	uint8_t step = 0;
+	uint8_t step_flags = 0;
+	uint8_t step_outcome = 0;
+	uint8_t module_state = 0;
+	AT_COMMAND at_command = AT_COMMAND_INVALID;
+	unsigned long step_start_time = 0;
+
+	/*Send message to serial terminal*/
+	LOG_INFO(LOG_MODULE_GAINSPAN, LOG_GS_ACTIVATION_STARTED);
+
+	for (step = 0; step < GS_ACTIVATION_STEPS; step++){
+		at_command = pgm_read_byte(&gs_activation_script[step].at_command);
+		step_flags = pgm_read_byte(&gs_activation_script[step].step_flags);
+		if ((step_flags & GS_STEP_LIMITED_AP) && (gainspan.wireless_mode != WIRELESS_MODE_LIMITEDAP)){
+			continue;
 		}
-
-		/*Start DHCP server*/
-//		strcpy(gs_command_response, "\0");
-		strcpy(gs_command_response, "");
-		gs_send_command(AT_START_DHCP_SERVER_IPV4);
-		number_of_characters_read = gs_get_command_response(gs_command_response, 300);
-		command_result = gs_parse_command_response(gs_command_response);
-		#if SET_GAINSPAN_TERMINAL_OUTPUT_ON == 1
-			gs_send_command_response_to_serial_terminal(AT_START_DHCP_SERVER_IPV4, command_result);
-		#endif
-		if(command_result == COMMAND_OUTCOME_SUCCESS){
-			command_outcomes_success++;
+		step_start_time = time_in_milliseconds();
+
+		if ((step_flags & GS_STEP_SKIP_WHEN_UP) && (module_state == GS_MODULE_UP)){
+			/*Already done before the MCU was reset*/
+			step_outcome = GS_STEP_SKIPPED;
+		}else if (step_flags & (GS_STEP_CHECK_ASSOCIATED | GS_STEP_CHECK_NETWORK)){
+			/*State query, not counted towards outcome success or error*/
+			if (gs_query_module_state(at_command) == BOOLEAN_TRUE){
+				module_state |= step_flags & (GS_STEP_CHECK_ASSOCIATED | GS_STEP_CHECK_NETWORK);
+				step_outcome = COMMAND_OUTCOME_SUCCESS;
+			}else{
+				step_outcome = COMMAND_OUTCOME_ERROR;
+			}
 		}else{
-			command_outcomes_errors++;
+			if (step_flags & GS_STEP_FLOW_CONTROL){
+				/*Hardware flow control: the MCU side is set first, so that RTS is low (ready) when the module starts to follow it*/
+				usart_xsetFlowControl(gainspan.usart_id, GAINSPAN_RTS_PORT, GAINSPAN_RTS_BIT, GAINSPAN_CTS_PIN, GAINSPAN_CTS_BIT);
+			}
+			command_result = gs_execute_command(at_command, SOCKET_MODE_NONE);
+			if ((command_result != COMMAND_OUTCOME_SUCCESS) && (step_flags & GS_STEP_RETRY)){
+				command_result = gs_execute_command(at_command, SOCKET_MODE_NONE);
+			}
+			if ((command_result != COMMAND_OUTCOME_SUCCESS) && (step_flags & GS_STEP_FLOW_CONTROL)){
+				/*Module does not follow RTS/CTS: no flow control on the MCU side either*/
+				usart_xsetFlowControl(gainspan.usart_id, NULL, 0, NULL, 0);
+			}
+			if(command_result == COMMAND_OUTCOME_SUCCESS){
+				command_outcomes_success++;
+			}else{
+				command_outcomes_errors++;
+			}
+			step_outcome = command_result;
 		}
 
+		LOG_INFO(LOG_MODULE_GAINSPAN, LOG_GS_ACTIVATION_STEP, gs_at_commands[at_command], step_outcome,
+				(int) (time_in_milliseconds() - step_start_time));
 	}
 
 	/*Determine the Gainspan activation status*/
@@ -772,9 +965,9 @@ GAINSPAN_ACTIVE gs_activate_wireless_connection(void){
 	}
 
 	/*Send activation status to serial terminal*/
-	#if SET_GAINSPAN_TERMINAL_OUTPUT_ON == 1
-		gs_send_activation_status_to_serial_terminal(gs_active);
-	#endif
+	gs_send_activation_status_to_serial_terminal(gs_active);
+	/*Characters lost on the Gainspan link during activation*/
+	gs_log_link_stats();
 
 	gainspan.device_connection_status = gs_active;
 
@@ -928,21 +1121,13 @@ void gs_configure_socket(TCP_SOCKET socket, PROTOCOLS socket_protocol, TCP_PORT
  *
  */
 SUCCESS_ERROR  gs_enable_activate_socket(TCP_SOCKET socket){
-	char gs_command_response[MAX_TX_BUFFER] = "\0";
-	uint16_t number_of_characters_read = 0;
 	COMMAND_OUTCOME command_result = COMMAND_OUTCOME_ERROR;
 	SUCCESS_ERROR process_result = ERROR;
 
 	/*Make the socket active for disconnection/deactivation*/
 	if(gs_activate_socket(socket) == SUCCESS){
 		/*Start TCP Server - Enable TCP Listen mode on socket*/
-		strcpy(gs_command_response, "\0");
-		gs_send_command(AT_START_TCP_SERVER);
-		number_of_characters_read = gs_get_command_response(gs_command_response, 300);
-		command_result = gs_parse_command_response_tcp(gs_command_response, SOCKET_MODE_ENABLE, AT_START_TCP_SERVER);
-		#if SET_GAINSPAN_TERMINAL_OUTPUT_ON == 1
-			gs_send_command_response_to_serial_terminal(AT_START_TCP_SERVER, command_result);
-		#endif
+		command_result = gs_execute_command(AT_START_TCP_SERVER, SOCKET_MODE_ENABLE);
 		if(command_result == COMMAND_OUTCOME_SUCCESS){
 			gainspan.device_operation_mode = GAINSPAN_DEVICE_MODE_COMMAND;
 			process_result = SUCCESS;
@@ -970,30 +1155,10 @@ SUCCESS_ERROR  gs_enable_activate_socket(TCP_SOCKET socket){
  */
 SUCCESS_ERROR gs_reset_socket(TCP_SOCKET socket){
 	SUCCESS_ERROR process_result = ERROR;
-	char command_buffer[MAX_TX_BUFFER];
 
 	if(gs_activate_socket(socket) == SUCCESS){
-		/*Close the connection with client on the socket by sending the Escape-C*/
-
-		/*Escape sequence indicating data mode - Escape*/
-		sprintf(command_buffer,"\x1b");
-		usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-
-		/*TCP Data start - S 0x53*/
-		sprintf(command_buffer,"\x53");
-		usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-
-		/*Put client CID based on socket*/
-		sprintf(command_buffer,"%x", (uint8_t) gainspan.socket_table[socket].cid);
-		usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-
-		/*TCP Data end - E - 0x45*/
-		sprintf(command_buffer,"\x1b");
-		usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-
-		//sprintf(command_buffer,"\x45");
-		sprintf(command_buffer,"\x43");
-		usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
+		/*Close the connection with client on the socket*/
+		gs_close_client_connection(gainspan.socket_table[socket].cid);
 
 		/*Reset socket.*/
 		strcpy(gainspan.socket_table[socket].ip_address, "0.0.0.0");
@@ -1026,20 +1191,12 @@ SUCCESS_ERROR gs_reset_socket(TCP_SOCKET socket){
  */
 SUCCESS_ERROR gs_disconnect_deactivate_socket(TCP_SOCKET socket){
 	TCP_SOCKET socket_counter = 0;
-	char gs_command_response[MAX_TX_BUFFER] = "\0";
-	uint16_t number_of_characters_read = 0;
 	COMMAND_OUTCOME command_result = COMMAND_OUTCOME_ERROR;
 	SUCCESS_ERROR process_result = ERROR;
 
 	if(gs_activate_socket(socket) == SUCCESS){
 		/*Disconnect/deactivate socket.*/
-		strcpy(gs_command_response, "\0");
-		gs_send_command(AT_CLOSE_CONNECTION_CID);
-		number_of_characters_read = gs_get_command_response(gs_command_response, 1000);
-		command_result = gs_parse_command_response_tcp(gs_command_response, SOCKET_MODE_ENABLE, AT_CLOSE_CONNECTION_CID);
-		#if SET_GAINSPAN_TERMINAL_OUTPUT_ON == 1
-			gs_send_command_response_to_serial_terminal(AT_CLOSE_CONNECTION_CID, command_result);
-		#endif
+		command_result = gs_execute_command(AT_CLOSE_CONNECTION_CID, SOCKET_MODE_ENABLE);
 		if(command_result == COMMAND_OUTCOME_SUCCESS){
 			strcpy(gainspan.socket_table[socket].ip_address, "0.0.0.0");
 			gainspan.socket_table[socket].status = SOCKET_STATUS_CLOSED;
@@ -1091,22 +1248,26 @@ SUCCESS_ERROR gs_read_data_from_socket(char *data_string){
 	uint16_t number_of_characters_read = 0;
 	uint16_t string_index = 0;
 	uint16_t data_string_length = 0;
+	uint16_t response_length = 0;
+	BOOLEAN_DATA response_parsed = BOOLEAN_FALSE;
 
 	strcpy(data_string, "\0");
 
 	strcpy(gs_command_response, "\0");
 	//number_of_characters_read = gs_get_command_response(gs_command_response, 50); //50 ms works better
-	number_of_characters_read = gs_get_command_response(gs_command_response, 30);
+	number_of_characters_read = gs_get_data_response(gs_command_response, 30);
 
-	if ((strlen(gs_command_response)) <= 0 || (number_of_characters_read <=0)){
+	response_length = strlen(gs_command_response);
+	if (response_length <= 0 || (number_of_characters_read <=0)){
 		strcpy(data_string, "\0");
 		data_string = gs_command_response; //send the complete read data back for debugging
 		process_result = ERROR;
 	}else{
-		for(string_index = 0; string_index <= strlen(gs_command_response); string_index++){
-			/*TCP Command Socket Process Mode - Client response/request*/
-			if ((gs_command_response[string_index] != 0x1b) && (gs_command_response[string_index] != 0x53) && (gs_command_response[string_index] != 0x45) && (gainspan.device_operation_mode == GAINSPAN_DEVICE_MODE_COMMAND)){
+		for(string_index = 0; string_index <= response_length; string_index++){
+			/*TCP Command Socket Process Mode - Client response/request; the lines of the response are parsed once*/
+			if ((response_parsed == BOOLEAN_FALSE) && (gs_command_response[string_index] != 0x1b) && (gs_command_response[string_index] != 0x53) && (gs_command_response[string_index] != 0x45) && (gainspan.device_operation_mode == GAINSPAN_DEVICE_MODE_COMMAND)){
 				command_result  = gs_parse_command_response_tcp(gs_command_response, SOCKET_MODE_PROCESS, TCP_RESPONSE);
+				response_parsed = BOOLEAN_TRUE;
 				if (command_result == COMMAND_OUTCOME_SUCCESS){
 					process_result = SUCCESS;
 
@@ -1212,52 +1373,82 @@ SUCCESS_ERROR gs_get_socket_connection_status(TCP_SOCKET socket){
  *
  */
 void gs_write_data_to_socket(TCP_SOCKET socket, char *data_string){
-	char command_buffer[MAX_TX_BUFFER];
-
-	memset(command_buffer, ' ', MAX_TX_BUFFER);
-
-	strcpy(command_buffer, "\0");
+	char frame_start[] = {0x1b, 0x53, '0'};
+	USART_IOV frame[4];
+	uint8_t segments = 0;
+	size_t data_string_length = strlen(data_string);
 
-	if(strlen(data_string) > 0 && data_string[0] != '\r'){
+	if(data_string_length > 0 && data_string[0] != '\r'){
 		if(gainspan.socket_table[socket].protocol == PROTOCOL_TCP){
-
-			/*Escape sequence indicating data mode - Escape*/
-			sprintf(command_buffer,"\x1b");
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-
-			/*TCP Data start - S 0x53*/
-			sprintf(command_buffer,"\x53");
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-
-			/*Put client CID based on socket*/
-			sprintf(command_buffer,"%x", (uint8_t) gainspan.socket_table[socket].cid);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
+			/*Escape sequence indicating data mode - Escape, TCP Data start - S 0x53, client CID based on socket*/
+			frame_start[2] = int_to_hex(gainspan.socket_table[socket].cid);
+			frame[segments].base = frame_start;
+			frame[segments].len = sizeof(frame_start);
+			frame[segments].mem = USART_IOV_RAM;
+			segments++;
 
 			/*Transmit data*/
-			if(strlen(data_string) == 1){
-	            if(data_string[0] != '\r' && data_string[0] != '\n'){
-					sprintf(command_buffer,"%s\n\r", data_string);
-					usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-	            } else if (data_string[0] == '\n') {
-					sprintf(command_buffer,"\n\r");
-					usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-	            }
+			if(data_string_length == 1 && data_string[0] == '\n'){
+				frame[segments].base = gs_frame_new_line;
+				frame[segments].len = sizeof(gs_frame_new_line);
+				frame[segments].mem = USART_IOV_PGM;
+				segments++;
 			}else{
-				sprintf(command_buffer,"%s", data_string);
-				usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
+				frame[segments].base = data_string;
+				frame[segments].len = data_string_length;
+				frame[segments].mem = USART_IOV_RAM;
+				segments++;
+				if(data_string_length == 1){
+					frame[segments].base = gs_frame_new_line;
+					frame[segments].len = sizeof(gs_frame_new_line);
+					frame[segments].mem = USART_IOV_PGM;
+					segments++;
+				}
 			}
 
-			/*TCP Data end - E - 0x45*/
-			sprintf(command_buffer,"\x1b");
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
+			/*TCP Data end - Escape, E - 0x45*/
+			frame[segments].base = gs_frame_end;
+			frame[segments].len = sizeof(gs_frame_end);
+			frame[segments].mem = USART_IOV_PGM;
+			segments++;
 
-			sprintf(command_buffer,"\x45");
-			//sprintf(command_buffer,"\x43");
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
+			/*Block, rather than drop characters, while the transmit buffer drains*/
+			usart_xwritevWait(gainspan.usart_id, frame, segments, SOCKET_WRITE_TIMEOUT_IN_MILLISECONDS / portTICK_PERIOD_MS);
 		}
 	}
-	/*Delay for transmission to complete*/
-	 _delay_ms(150);
+	/*Wait for the frame to be on the wire*/
+	usart_xflushTx(gainspan.usart_id, SOCKET_WRITE_TIMEOUT_IN_MILLISECONDS / portTICK_PERIOD_MS);
+}
+
+
+/*!
+ * \brief Write data to socket in bulk data mode.
+ *
+ *
+ * \details Sends the data in bulk data frames, ESC Z <CID> <4 digit length> <data>, of at most
+ * GAINSPAN_BULK_MAX_LENGTH characters. The length tells the module where the data ends, so any byte may be sent
+ * (binary data, escape characters, terminator) and nothing is escaped. Each frame completes once it is on the wire
+ * (usart_xflushTx), or on the answer of the module with SET_GAINSPAN_BULK_ACKNOWLEDGEMENT_ON, rather than after a
+ * fixed delay.
+ *
+ * \note Takes the link with the module (see gs_execute_command), so it can be called from any task.
+ *
+ *
+ * @param socket - valid socket number, limited by MAX_SOCKET_NUMBER.
+ * @param data - data to be written, need not be terminated.
+ * @param data_length - number of characters to write.
+ * @return - outcome, SUCCESS if the module accepted all the frames, else ERROR; defined by SUCCESS_ERROR.
+ *
+ */
+SUCCESS_ERROR gs_write_bulk_to_socket(TCP_SOCKET socket, const uint8_t *data, uint16_t data_length){
+	SUCCESS_ERROR process_result = ERROR;
+
+	if ((socket < MAX_SOCKET_NUMBER) && (gainspan.socket_table[socket].protocol == PROTOCOL_TCP)){
+		gs_link_lock();
+		process_result = gs_send_bulk_data(gainspan.socket_table[socket].cid, data, data_length);
+		gs_link_unlock();
+	}
+	return process_result;
 }
 
 
@@ -1270,10 +1461,145 @@ void gs_write_data_to_socket(TCP_SOCKET socket, char *data_string){
  *
  */
 void gs_flush(void){
-	 unsigned char character_from_response = ' ';
-	 while (usart_AvailableCharRx(gainspan.usart_id)){
-		usart_xgetChar(gainspan.usart_id, &character_from_response);
-	 }
+	 usart_xflushRx(gainspan.usart_id);
+}
+
+
+/*!
+ * \brief AT command engine task.
+ *
+ *
+ * \details Takes the requests submitted with gs_submit_command (and gs_execute_command) in order, sends each command,
+ * collects and parses its response, then completes the request (command_result, callback, notification). The task
+ * sleeps while it waits for the queue or for the module, so tasks of higher priority keep their schedule.
+ * Unsolicited events found in the responses (CONNECT, DISCONNECT, Disassociation Event) are handled by
+ * gs_route_unsolicited_event, not taken as the outcome of the command.
+ *
+ * \note Create a single instance, with a stack of GS_AT_ENGINE_STACK_SIZE and a priority below the control tasks.
+ *
+ * @param pvParameters - Used only for function definition compatibility.
+ *
+ */
+void gs_at_engine_task(void *pvParameters){
+	GS_AT_REQUEST *request = NULL;
+	TaskHandle_t notify_task = NULL;
+	UBaseType_t notify_index = 0;
+
+	gs_at_engine_initialize();
+	gs_at_engine_handle = xTaskGetCurrentTaskHandle();
+
+	for(;;){
+		if (xQueueReceive(gs_at_queue, &request, portMAX_DELAY) == pdTRUE){
+			gs_link_lock();
+			request->command_result = gs_exchange_command(request);
+			gs_link_unlock();
+
+			/*The request may be reused by the callback*/
+			notify_task = request->notify_task;
+			notify_index = request->notify_index;
+			if (request->callback != NULL){
+				request->callback(request);
+			}
+			if (notify_task != NULL){
+				xTaskNotifyGiveIndexed(notify_task, notify_index);
+			}
+		}
+	}
+}
+
+
+/*!
+ * \brief Submit a command to the AT command engine, without waiting.
+ *
+ *
+ * \details Queues the request for gs_at_engine_task and returns at once. The request completes later, through its
+ * callback or task notification (see GS_AT_REQUEST); it must stay valid until then.
+ *
+ * \note The notification is given on entry 0 of notify_task, which is reserved for these completions: the USART
+ * waits use USART_NOTIFY_INDEX and gs_execute_command GS_AT_NOTIFY_INDEX, so the task may wait on a USART or execute
+ * a command before it takes the notification.
+ *
+ * @param request - command request; command_result is set to COMMAND_OUTCOME_NO_RESPONSE until it completes.
+ * @return - SUCCESS if the request is queued, ERROR if the queue is full or the module is not initialized.
+ *
+ */
+SUCCESS_ERROR gs_submit_command(GS_AT_REQUEST *request){
+	if (gs_at_queue == NULL){
+		return ERROR;
+	}
+	request->command_result = COMMAND_OUTCOME_NO_RESPONSE;
+	request->notify_index = 0;
+	if (xQueueSend(gs_at_queue, &request, 0) != pdPASS){
+		return ERROR;
+	}
+	return SUCCESS;
+}
+
+
+/*!
+ * \brief Execute a command and wait for its outcome.
+ *
+ *
+ * \details Submits the command to the AT command engine and sleeps until it completes, at most for the timeout of
+ * the command (gs_at_command_timeouts) once it is sent. Before the scheduler is
+ * started, when the engine task does not run, or when called by the engine task itself (from a callback), the
+ * command is exchanged by the calling task instead. The outcome is sent to the serial terminal.
+ *
+ *
+ * @param at_command - valid command, refer the list of valid commands.
+ * @param socket_mode - SOCKET_MODE_NONE, or socket mode of a TCP command (response parsed by gs_parse_command_response_tcp).
+ * @return - command outcome, valid values are defined by COMMAND_OUTCOME.
+ *
+ */
+COMMAND_OUTCOME gs_execute_command(AT_COMMAND at_command, SOCKET_MODE socket_mode){
+	GS_AT_REQUEST request;
+
+	request.at_command = at_command;
+	request.timeout_in_milliseconds = 0;
+	request.socket_mode = socket_mode;
+	request.callback = NULL;
+	request.line_callback = NULL;
+	request.context = NULL;
+
+	return gs_execute_request(&request);
+}
+
+
+/*!
+ * \brief Execute a request and wait for its outcome.
+ *
+ *
+ * \details As gs_execute_command, for a request prepared by the caller (line callback, context). The completion
+ * callback and notify_task of the request are set by this function. The task sleeps on its notification entry
+ * GS_AT_NOTIFY_INDEX, so a request it submitted with gs_submit_command may complete meanwhile on entry 0 without
+ * waking it early or being lost.
+ *
+ *
+ * @param request - command request, valid until the function returns.
+ * @return - command outcome, valid values are defined by COMMAND_OUTCOME.
+ *
+ */
+COMMAND_OUTCOME gs_execute_request(GS_AT_REQUEST *request){
+	request->command_result = COMMAND_OUTCOME_NO_RESPONSE;
+	request->callback = NULL;
+
+	if ((gs_at_engine_handle == NULL) || (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) ||
+			(xTaskGetCurrentTaskHandle() == gs_at_engine_handle)){
+		request->notify_task = NULL;
+		gs_link_lock();
+		request->command_result = gs_exchange_command(request);
+		gs_link_unlock();
+		return request->command_result;
+	}
+
+	request->notify_task = xTaskGetCurrentTaskHandle();
+	request->notify_index = GS_AT_NOTIFY_INDEX;
+	ulTaskNotifyTakeIndexed(GS_AT_NOTIFY_INDEX, pdTRUE, 0); /*discard a stale notification*/
+	xQueueSend(gs_at_queue, &request, portMAX_DELAY);
+	/*The engine completes every request, the response time is bounded by its timeout*/
+	ulTaskNotifyTakeIndexed(GS_AT_NOTIFY_INDEX, pdTRUE, portMAX_DELAY);
+
+	return request->command_result;
 }
 
 
@@ -1303,6 +1629,8 @@ void configure_web_page(char *page_title, char *menu_title, HTML_ELEMENT_TYPE el
 		strcpy(client_web_page.web_page_elements[index].element_label, " ");
 	}
 	client_web_page.element_count = 0;
+	/*Rendered web-page, out of date*/
+	client_web_page.rendered_length = 0;
 	/*Client response buffer*/
 	client_response_buffer = (char *)pvPortMalloc( sizeof(char) * RING_BUFFER_SIZE);
 	strcpy(client_response_buffer, "\0");
@@ -1334,10 +1662,8 @@ void configure_web_page(char *page_title, char *menu_title, HTML_ELEMENT_TYPE el
 	strcpy(client_response_buffer, "");
 	client_response_buffer_write_pointer = 0;
 	client_response_buffer_read_pointer = 0;
-	#if SET_WEB_SERVER_TERMINAL_OUTPUT_ON == 1
-		/*Send message to serial terminal*/
-		usart_xfprint(SERIAL_TERNMINAL, (uint8_t *) "\n\rWeb Page: configured....\n\r");
-	#endif
+	/*Send message to serial terminal*/
+	LOG_INFO(LOG_MODULE_WEB_SERVER, LOG_WEB_PAGE_CONFIGURED);
 }
 
 
@@ -1362,10 +1688,8 @@ void add_element_choice(char choice_identifier, char *element_label){
 		}
 	}
 	if(choice_identifier_exists == 1){
-		#if SET_WEB_SERVER_TERMINAL_OUTPUT_ON == 1
-			/*Send message to serial terminal*/
-			usart_xfprint(SERIAL_TERNMINAL, (uint8_t *) "\n\rWeb Page: element choice identifier already exists....\n\r");
-		#endif
+		/*Send message to serial terminal*/
+		LOG_WARNING(LOG_MODULE_WEB_SERVER, LOG_WEB_PAGE_ELEMENT_EXISTS, choice_identifier);
 	}else{
 		if (client_web_page.element_count <= WEB_PAGE_ELEMENTS){
 			client_web_page.web_page_elements[client_web_page.element_count].element_identifier = choice_identifier;
@@ -1380,16 +1704,13 @@ void add_element_choice(char choice_identifier, char *element_label){
 			if (client_web_page.element_count > WEB_PAGE_ELEMENTS){
 				client_web_page.element_count = WEB_PAGE_ELEMENTS;
 			}
-			#if SET_WEB_SERVER_TERMINAL_OUTPUT_ON == 1
-				/*Send message to serial terminal*/
-				usart_xfprint(SERIAL_TERNMINAL, (uint8_t *) "\n\rWeb Page: element added....\n\r");
-			#endif
+			/*Rendered again before it is served*/
+			client_web_page.rendered_length = 0;
+			/*Send message to serial terminal*/
+			LOG_DEBUG(LOG_MODULE_WEB_SERVER, LOG_WEB_PAGE_ELEMENT_ADDED, choice_identifier);
 		}else{
-			#if SET_WEB_SERVER_TERMINAL_OUTPUT_ON == 1
-				/*Send message to serial terminal*/
-				usart_xfprint(SERIAL_TERNMINAL, (uint8_t *) "\n\rWeb Page: can't add element, max 10 allowed....\n\r");
-				_delay_ms(5000);
-			#endif
+			/*Send message to serial terminal*/
+			LOG_ERROR(LOG_MODULE_WEB_SERVER, LOG_WEB_PAGE_FULL, WEB_PAGE_ELEMENTS);
 		}
 	}
 }
@@ -1414,6 +1735,10 @@ void start_web_server(void){
 	uint8_t protocol = SERVER_PROTOCOL;
 
 	if (client_web_page.element_count > 0){
+		/*Render the web-page now rather than at the first client request*/
+		if (client_web_page.rendered_length == 0){
+			gs_render_web_page();
+		}
 		/*Initialize the server*/
 		initialize_web_server(port, protocol);
 		/*Search for available socket, activate and start to listen incoming connection*/
@@ -1423,20 +1748,17 @@ void start_web_server(void){
 					gs_configure_socket(socket, wifi_server.server_protocol, wifi_server.server_port);
 					gs_enable_activate_socket(socket);
 					wifi_client.client_socket = socket;
-					#if SET_WEB_SERVER_TERMINAL_OUTPUT_ON == 1
-						/*Send message to serial terminal*/
-						usart_xfprint(SERIAL_TERNMINAL, (uint8_t *) "\n\rWeb Server: Started....\n\r");
-					#endif
+					web_connections_initialize(&web_connections);
+					/*Send message to serial terminal*/
+					LOG_INFO(LOG_MODULE_WEB_SERVER, LOG_WEB_SERVER_STARTED);
 					web_server_status = WEB_SERVER_ACTIVE;
 					break;
 				}
 			}
 		}
 	}else{
-		#if SET_WEB_SERVER_TERMINAL_OUTPUT_ON == 1
-			/*Send message to serial terminal*/
-			usart_xfprint(SERIAL_TERNMINAL, (uint8_t *) "\n\rWeb Server: can't start, web-page empty....\n\r");
-		#endif
+		/*Send message to serial terminal*/
+		LOG_ERROR(LOG_MODULE_WEB_SERVER, LOG_WEB_SERVER_PAGE_EMPTY);
 	}
 }
 
@@ -1446,106 +1768,47 @@ void start_web_server(void){
 
 /*!\brief Process client request.
  *
- * \details accepts incoming connection on socket, sends the web-page and
- * reads the client response
+ * \details Reads the data from the clients, then serves the complete requests in round robin order (web_connections),
+ * one page per client: reads the client response and sends the web-page; the data received meanwhile is read
+ * between two pages. Several clients are accepted and read in an interleaved way, and a client waits for at most
+ * WEB_CONNECTIONS_MAXIMUM - 1 pages of other clients. The clients whose request is not complete after
+ * WEB_SERVER_REQUEST_TIMEOUT_IN_MILLISECONDS are closed.
+ * \note The web-page is rendered once (gs_render_web_page) and sent in a single bulk data frame.
  * \warning Ensure web-page is configured and web server is started before calling this routine/function.
  *
  *
  */
 void process_client_request(void){
-
-	char data_string[128] = "\0";
-	char html_string[128] = "\0";
-	char find_GET_in_response[128] = "\0";
-	char client_response = ' ';
-	uint8_t loop_counter = 0;
+	uint8_t connection = WEB_CONNECTION_NONE;
+	uint8_t pages_served = 0;
 
 	if (web_server_status == WEB_SERVER_ACTIVE){
-		if (gs_get_socket_status(wifi_client.client_socket) == SOCKET_STATUS_LISTEN){
-			gs_read_data_from_socket(data_string); //accept connection, get CID
-			/*Extract client request and store in ring buffer*/
-			if(strlen(data_string) > 0){
-				strcpy(find_GET_in_response, strstr(data_string, "GET"));
-				if (*(find_GET_in_response + 5) == '?'){
-					client_response = *(find_GET_in_response + 8);
-
-					/*Add to circular buffer for processing*/
-					client_response_buffer[client_response_buffer_write_pointer] = client_response;
-					client_response_buffer_write_pointer++;
-					if (client_response_buffer_write_pointer >= RING_BUFFER_SIZE){
-						client_response_buffer_write_pointer = 0;
-					}
-				}
-			}
-			if(gs_get_socket_status(wifi_client.client_socket) == SOCKET_STATUS_ESTABLISHED){
-				//HTML header
-				gs_write_data_to_socket(wifi_client.client_socket, "HTTP/1.1 200 OK\n");
-				gs_write_data_to_socket(wifi_client.client_socket, "Content-Type: text/html\n\n");
-				gs_write_data_to_socket(wifi_client.client_socket, "<!DOCTYPE HTML>\n\n");
-				//Send web page HTML script/code
-				gs_write_data_to_socket(wifi_client.client_socket, "<html> \n");
-				gs_write_data_to_socket(wifi_client.client_socket, "<head> \n");
-				/*Page title*/
-				strcpy(html_string, "<title>");
-				strcat(html_string, client_web_page.page_title);
-				strcat(html_string, "</title> \n");
-				gs_write_data_to_socket(wifi_client.client_socket, html_string);
-				gs_write_data_to_socket(wifi_client.client_socket, "</head> \n");
-				gs_write_data_to_socket(wifi_client.client_socket, "<body> \n");
-				/*Page title*/
-				strcpy(html_string, "<center><h1>");
-				strcat(html_string, client_web_page.page_title);
-				strcat(html_string, "</h1> \n");
-				gs_write_data_to_socket(wifi_client.client_socket, html_string);
-				strcpy(html_string, "<center><h3>");
-				strcat(html_string, client_web_page.menu_title);
-				strcat(html_string, "</h3> \n\n");
-				gs_write_data_to_socket(wifi_client.client_socket, html_string);
-				gs_write_data_to_socket(wifi_client.client_socket, "<p> \n");
-				gs_write_data_to_socket(wifi_client.client_socket, "<form method=\"get\" action=\"\"> \n");
-				/*Check for element type*/
-				if (client_web_page.element_type == HTML_DROPDOWN_LIST ){
-					gs_write_data_to_socket(wifi_client.client_socket, "<select name=\"l\"> \n");
-					/*Add the elements*/
-					for (loop_counter = 0; loop_counter < client_web_page.element_count; loop_counter++){
-						strcpy(html_string, "<option value=\"");
-						strncat(html_string, &client_web_page.web_page_elements[loop_counter].element_identifier, 1);
-						strcat(html_string, "\">");
-						strcat(html_string, client_web_page.web_page_elements[loop_counter].element_label);
-						strcat(html_string, "</option> \n");
-						gs_write_data_to_socket(wifi_client.client_socket, html_string);
-					}
-					gs_write_data_to_socket(wifi_client.client_socket, "</select> \n");
-				}else if (client_web_page.element_type == HTML_RADIO_BUTTON){
-					for (loop_counter = 0; loop_counter < client_web_page.element_count; loop_counter++){
-						strcpy(html_string, "<input type=\"radio\" name=\"choice\" value=\"");
-						strncat(html_string, &client_web_page.web_page_elements[loop_counter].element_identifier, 1);
-						strcat(html_string, "\">");
-						strcat(html_string, client_web_page.web_page_elements[loop_counter].element_label);
-						strcat(html_string, " \n");
-						gs_write_data_to_socket(wifi_client.client_socket, html_string);
-					}
-				}else{
-					gs_write_data_to_socket(wifi_client.client_socket, "<center><h3> No valid elements added, please check! </h3> \n\n");
-				}
-				gs_write_data_to_socket(wifi_client.client_socket, "<input type=\"submit\" value=\"Set\"> \n");
-				gs_write_data_to_socket(wifi_client.client_socket, "</form> \n");
-				gs_write_data_to_socket(wifi_client.client_socket, "</p> \n");
-				gs_write_data_to_socket(wifi_client.client_socket, "</center> \n");
-				gs_write_data_to_socket(wifi_client.client_socket, "</body> \n");
-				gs_write_data_to_socket(wifi_client.client_socket, "</html>");
-				gs_write_data_to_socket(wifi_client.client_socket, "");
-				gs_write_data_to_socket(wifi_client.client_socket, " ");
-//				gs_write_data_to_socket(wifi_client.client_socket, "HTTP/1.1 205 Reset Content\n");
-
-				gs_reset_socket(wifi_client.client_socket);
-
-				gs_flush();
-
-				/*Wait for web browser to get refresh*/
-				_delay_ms(100);
+		/*No command of another task in the middle of the client requests*/
+		gs_link_lock();
+		gs_receive_client_data(WEB_SERVER_POLLING_PERIOD_IN_MILLISECONDS);
+		for (pages_served = 0; pages_served < WEB_CONNECTIONS_MAXIMUM; pages_served++){
+			connection = web_connections_next_ready(&web_connections);
+			if (connection == WEB_CONNECTION_NONE){
+				break;
 			}
+			gs_serve_client(connection);
+			gs_receive_client_data(0);
+		}
+
+		/*Close the clients that did not complete their request*/
+		while ((connection = web_connections_expired(&web_connections, time_in_milliseconds(),
+				WEB_SERVER_REQUEST_TIMEOUT_IN_MILLISECONDS)) != WEB_CONNECTION_NONE){
+			LOG_WARNING(LOG_MODULE_WEB_SERVER, LOG_WEB_CLIENT_TIMED_OUT, web_connections.connections[connection].cid,
+					(uint16_t) web_connections.connections[connection].request_length);
+			gs_close_client_connection(web_connections.connections[connection].cid);
+			web_connections_close(&web_connections, web_connections.connections[connection].cid);
 		}
+
+		if (pages_served > 0){
+			/*Wait for the close commands to be on the wire before the web browsers refresh*/
+			usart_xflushTx(gainspan.usart_id, SOCKET_WRITE_TIMEOUT_IN_MILLISECONDS / portTICK_PERIOD_MS);
+		}
+		gs_link_unlock();
 	}
 }
 
@@ -1674,162 +1937,112 @@ void gs_initialize_gainspan(void){
  * \brief Send/submit command to Gainspan WiFi module.
  *
  *
- * \details Sends/submits valid command to Gainspan WiFi module.
+ * \details Sends/submits valid command to Gainspan WiFi module. A command longer than COMMAND_BUFFER_SIZE (e.g. a
+ * long SSID or key) is not sent: truncated, it would lose its terminator and the module would wait for the rest.
  *
  *
  * @param at_command - valid command, refer the list of valid commands.
+ * @return - SUCCESS if the command was sent, ERROR if it does not fit; defined by SUCCESS_ERROR.
  *
  */
-void gs_send_command(AT_COMMAND at_command){
-	char command_buffer[50];
-	memset(command_buffer, ' ', 50);
+SUCCESS_ERROR gs_send_command(AT_COMMAND at_command){
+	char command_buffer[COMMAND_BUFFER_SIZE];
+	FORMAT_BUFFER command;
 
-	/*Flush to transmission buffer*/
-	gs_flush();
+	format_initialize(&command, command_buffer, sizeof(command_buffer));
+
+	/*Drop what is left of earlier responses; once the web server is started, the clients' data and events waiting
+	 * in the receiving buffer are parsed instead, so that the command does not discard them*/
+	if (web_server_status == WEB_SERVER_ACTIVE){
+		gs_receive_client_data(0);
+	}else{
+		gs_flush();
+	}
 
 	switch(at_command){
+		/*Commands without parameters*/
 		case AT_OK:
-			sprintf(command_buffer,"%s\n\r", gs_at_commands[at_command]);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
 		case AT_DISABLE_ECHO:
-			sprintf(command_buffer,"%s\n\r", gs_at_commands[at_command]);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
 		case AT_VERBOSE_ENABLE:
-			sprintf(command_buffer,"%s\n\r", gs_at_commands[at_command]);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
-		case AT_SET_USART:
-			sprintf(command_buffer,"%s%lu,8,n,1\n\r", gs_at_commands[at_command], (uint32_t) gainspan.baud_rate);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
-		case AT_GET_DEVICE_OEM_ID:
-			break;
-		case AT_GET_DEVICE_HARDWARE_VERSION:
-			break;
-		case AT_GET_DEVICE_SOFTWARE_VERSION:
-			break;
-		case AT_GET_DEVICE_MAC_ADDRESS:
-			break;
-		case AT_SCAN_NETWORK_FOR_SSID:
-			break;
-		case AT_SET_WIRELESS_MODE:
-			sprintf(command_buffer,"%s%u\n\r", gs_at_commands[at_command], (uint8_t) gainspan.wireless_mode);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
-		case AT_ASSOCIATE_START_NETWORK:
-			sprintf(command_buffer,"%s%s,,%u\n\r", gs_at_commands[at_command], gainspan.ssid, (uint8_t) gainspan.wireless_channel);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
+		case AT_ENABLE_HARDWARE_FLOW_CONTROL:
 		case AT_DISASSOCIATE_CURRENT_NETWORK:
-			sprintf(command_buffer,"%s\n\r", gs_at_commands[at_command]);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
 		case AT_GET_CURRENT_NETWORK_STATUS:
-			break;
 		case AT_GET_CURRENT_WIRELESS_NETWORK_STATUS:
-			break;
-		case AT_GET_WIRELESS_RSSI:
-			break;
-		case AT_SET_TRANSMISSION_RATE:
-			sprintf(command_buffer,"%s%u\n\r", gs_at_commands[at_command], (uint8_t) gainspan.transmission_rate);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
-		case AT_GET_TRANSMISSION_RATE:
-			break;
-		case AT_SET_AUTHENTICATION_MODE:
-			sprintf(command_buffer,"%s%u\n\r", gs_at_commands[at_command], (uint8_t) gainspan.authentication_mode);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
-		case AT_SET_WIRELESS_SECURITY_CONFIGURATION:
-			sprintf(command_buffer,"%s%u\n\r", gs_at_commands[at_command], (uint8_t) gainspan.wireless_security_configuration);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
-		case AT_SET_WPA_PASSPHRASE:
-			sprintf(command_buffer,"%s%s\n\r", gs_at_commands[at_command], gainspan.security_key);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
-		case AT_SET_WPA2PSK:
-			sprintf(command_buffer,"%s%s,%s\n\r", gs_at_commands[at_command], gainspan.ssid, gainspan.security_key);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
 		case AT_DISABLE_RADIO:
-			sprintf(command_buffer,"%s\n\r", gs_at_commands[at_command]);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
 		case AT_ENABLE_RADIO:
-			sprintf(command_buffer,"%s\n\r", gs_at_commands[at_command]);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
 		case AT_DISABLE_RADIO_POWER_SAVER_MODE:
-			sprintf(command_buffer,"%s\n\r", gs_at_commands[at_command]);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
 		case AT_ENABLE_RADIO_POWER_SAVER_MODE:
-			sprintf(command_buffer,"%s\n\r", gs_at_commands[at_command]);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
 		case AT_DISABLE_DHCP_IPV4:
-			sprintf(command_buffer,"%s\n\r", gs_at_commands[at_command]);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
 		case AT_ENABLE_DHCP_IPV4:
-			sprintf(command_buffer,"%s\n\r", gs_at_commands[at_command]);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
-		case AT_SET_STATIC_NETWORK_PARAMTERS_IPV4:
-			sprintf(command_buffer,"%s%s,%s,%s\n\r", gs_at_commands[at_command], gainspan.local_ip_address, gainspan.subnet, gainspan.gateway);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
 		case AT_STOP_DHCP_SERVER_IPV4:
-			sprintf(command_buffer,"%s\n\r", gs_at_commands[at_command]);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
 		case AT_START_DHCP_SERVER_IPV4:
-			sprintf(command_buffer,"%s\n\r", gs_at_commands[at_command]);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
 		case AT_STOP_DNS_SERVER:
-			sprintf(command_buffer,"%s\n\r", gs_at_commands[at_command]);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
-			break;
 		case AT_START_DNS_SERVER:
-			sprintf(command_buffer,"%s\n\r", gs_at_commands[at_command]);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
+		case AT_STOP_WEBSERVER:
+		case AT_DISABLE_XML_PARSE:
+		case AT_ENABLE_XML_PARSE:
+		case AT_CLOSE_ALL_CONNECTIONS:
+			format_append_string(&command, gs_at_commands[at_command]);
 			break;
-		case AT_DNS_LOOKUP:
+		case AT_SET_USART:
+			format_append_string(&command, gs_at_commands[at_command]);
+			format_append_unsigned(&command, (uint32_t) gainspan.baud_rate, 0);
+			FORMAT_APPEND_LITERAL(&command, ",8,n,1");
 			break;
-		case AT_STOP_WEBSERVER:
-			sprintf(command_buffer,"%s\n\r", gs_at_commands[at_command]);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
+		case AT_SET_WIRELESS_MODE:
+			format_append_string(&command, gs_at_commands[at_command]);
+			format_append_unsigned(&command, (uint8_t) gainspan.wireless_mode, 0);
 			break;
-		case AT_START_WEBSERVER:
-			sprintf(command_buffer,"%s%s,%s\n\r", gs_at_commands[at_command], gainspan.web_server_administrator_id, gainspan.web_server_administrator_password);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
+		case AT_ASSOCIATE_START_NETWORK:
+			format_append_string(&command, gs_at_commands[at_command]);
+			format_append_string(&command, gainspan.ssid);
+			FORMAT_APPEND_LITERAL(&command, ",,");
+			format_append_unsigned(&command, (uint8_t) gainspan.wireless_channel, 0);
 			break;
-		case AT_DISABLE_XML_PARSE:
-			sprintf(command_buffer,"%s\n\r", gs_at_commands[at_command]);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
+		case AT_SET_TRANSMISSION_RATE:
+			format_append_string(&command, gs_at_commands[at_command]);
+			format_append_unsigned(&command, (uint8_t) gainspan.transmission_rate, 0);
 			break;
-		case AT_ENABLE_XML_PARSE:
-			sprintf(command_buffer,"%s\n\r", gs_at_commands[at_command]);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
+		case AT_SET_AUTHENTICATION_MODE:
+			format_append_string(&command, gs_at_commands[at_command]);
+			format_append_unsigned(&command, (uint8_t) gainspan.authentication_mode, 0);
 			break;
-		case AT_START_TCP_SERVER:
-			sprintf(command_buffer,"%s%u\n\r", gs_at_commands[at_command], (uint8_t) gainspan.server_port);
-			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
+		case AT_SET_WIRELESS_SECURITY_CONFIGURATION:
+			format_append_string(&command, gs_at_commands[at_command]);
+			format_append_unsigned(&command, (uint8_t) gainspan.wireless_security_configuration, 0);
 			break;
-		case AT_START_TCP_CLIENT:
+		case AT_SET_WPA_PASSPHRASE:
+			format_append_string(&command, gs_at_commands[at_command]);
+			format_append_string(&command, gainspan.security_key);
 			break;
-		case AT_START_UDP_SERVER:
+		case AT_SET_WPA2PSK:
+			format_append_string(&command, gs_at_commands[at_command]);
+			format_append_string(&command, gainspan.ssid);
+			format_append_character(&command, ',');
+			format_append_string(&command, gainspan.security_key);
 			break;
-		case AT_START_UDP_CLIENT:
+		case AT_SET_STATIC_NETWORK_PARAMTERS_IPV4:
+			format_append_string(&command, gs_at_commands[at_command]);
+			format_append_string(&command, gainspan.local_ip_address);
+			format_append_character(&command, ',');
+			format_append_string(&command, gainspan.subnet);
+			format_append_character(&command, ',');
+			format_append_string(&command, gainspan.gateway);
+			break;
+		case AT_START_WEBSERVER:
+			format_append_string(&command, gs_at_commands[at_command]);
+			format_append_string(&command, gainspan.web_server_administrator_id);
+			format_append_character(&command, ',');
+			format_append_string(&command, gainspan.web_server_administrator_password);
+			break;
+		case AT_START_TCP_SERVER:
+			format_append_string(&command, gs_at_commands[at_command]);
+			format_append_unsigned(&command, (uint8_t) gainspan.server_port, 0);
 			break;
 		case AT_CLOSE_CONNECTION_CID:
 			if(gainspan.socket_table[gainspan.active_socket].status != SOCKET_STATUS_CLOSED){
-				sprintf(command_buffer,"%s%x\n\r", gs_at_commands[at_command], gainspan.active_client_cid);
-				usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
+				format_append_string(&command, gs_at_commands[at_command]);
+				format_append_hex(&command, gainspan.active_client_cid, 0);
 			}
 			break;
 /*
@@ -1842,15 +2055,25 @@ void gs_send_command(AT_COMMAND at_command){
 			usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
 			break;
 */
+		/*Not implemented: AT_GET_DEVICE_OEM_ID, AT_GET_DEVICE_HARDWARE_VERSION, AT_GET_DEVICE_SOFTWARE_VERSION,
+		 * AT_GET_DEVICE_MAC_ADDRESS, AT_SCAN_NETWORK_FOR_SSID, AT_GET_WIRELESS_RSSI, AT_GET_TRANSMISSION_RATE, AT_DNS_LOOKUP,
+		 * AT_START_TCP_CLIENT, AT_START_UDP_SERVER, AT_START_UDP_CLIENT*/
 		default:
 			break;
 	}
-	#if SET_GAINSPAN_TERMINAL_OUTPUT_ON == 1
+
+	/*Room for the terminator, else the command was truncated*/
+	if (command.length + 2 >= command.size){
+		LOG_ERROR(LOG_MODULE_GAINSPAN, LOG_GS_COMMAND_TOO_LONG, at_command, COMMAND_BUFFER_SIZE - 3);
+		return ERROR;
+	}
+	if (command.length > 0){
 		/*Send the actual command to serial terminal for debugging*/
-		usart_xfprint(gainspan.serial_terminal_usart_id, (uint8_t *) "\n\r");
-		usart_xfprint(gainspan.serial_terminal_usart_id, (uint8_t *) command_buffer);
-		//usart_xfprint(gainspan.serial_terminal_usart_id, (uint8_t *) "\n\r");
-	#endif
+		LOG_DEBUG(LOG_MODULE_GAINSPAN, LOG_GS_COMMAND, command_buffer);
+		FORMAT_APPEND_LITERAL(&command, "\n\r");
+		usart_xfprint(gainspan.usart_id, (uint8_t *) command_buffer);
+	}
+	return SUCCESS;
 }
 
 
@@ -1858,51 +2081,131 @@ void gs_send_command(AT_COMMAND at_command){
  * \brief Collect the command response from Gainspan WiFi module.
  *
  *
- * \details Collect the response from Gainspan WiFi module for the last submitted command. Attempt will
- * be made to collect the response for the polling period. Polling interval is defined by COMMAND_RESPONSE_POLLING_INTERVAL_IN_MILLISECONDS.
+ * \details Collect the response from Gainspan WiFi module for the last submitted command. The calling task sleeps
+ * until each line of the response arrives (usart_xreadLine) and returns as soon as the final result line (OK, ERROR
+ * or INVALID CID, see gs_is_final_result) has been read, so the polling period is only spent when the module does
+ * not answer.
  *
- * \note: returns maximum 128 characters, and rest of the response is discarded.
+ * \note: returns maximum 127 characters, and rest of the response is discarded. With the line callback of the
+ * request, the lines before the final result are handed to it as they arrive and only the final result is returned,
+ * so a longer response is not truncated.
  *
  * @param gs_command_response - Pointer to string buffer to return the response.
- * @param polling_period_in_milliseconds - Polling period.
+ * @param polling_period_in_milliseconds - Polling period, maximum time to wait for the final result line.
+ * @param request - request of the command (line callback), or NULL.
  * @return - returns the number of characters read.
  *
  */
-uint16_t gs_get_command_response(char *gs_command_response, uint16_t polling_period_in_milliseconds){
-	unsigned char character_from_response = ' ';
-	uint16_t string_index = 0;
+uint16_t gs_get_command_response(char *gs_command_response, uint16_t polling_period_in_milliseconds, GS_AT_REQUEST *request){
 	uint16_t number_of_characters_read = 0;
-	uint16_t maximum_polling_cycles = polling_period_in_milliseconds / COMMAND_RESPONSE_POLLING_INTERVAL_IN_MILLISECONDS, polling_cycle_counter = 0;
-
-	for(polling_cycle_counter = 0; polling_cycle_counter <= maximum_polling_cycles; polling_cycle_counter++){
-		_delay_ms(COMMAND_RESPONSE_POLLING_INTERVAL_IN_MILLISECONDS);
-		while (usart_AvailableCharRx(gainspan.usart_id)){
-			usart_xgetChar(gainspan.usart_id, &character_from_response);
-			gs_command_response[string_index] = character_from_response;
-			string_index++;
-			number_of_characters_read++;
-			/*Max limit on characters to be captured from response is 128*/
-			if (number_of_characters_read >= CHARACTERS_TO_READ_FROM_GAINSPAN_RESPONSE){
-				/*Discard the rest of characters from USART buffer*/
-				gs_flush();
-				break;
-			}
-		 }
-	 }
+	uint16_t line_length = 0;
+	char *response_line = gs_command_response;
+	TickType_t ticks_to_wait = (polling_period_in_milliseconds + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+
+	/*Read line by line, the lines share the polling period. Last character reserved for termination*/
+	while ((number_of_characters_read < CHARACTERS_TO_READ_FROM_GAINSPAN_RESPONSE - 1) &&
+			((line_length = usart_xreadLine(gainspan.usart_id, (uint8_t *) gs_command_response + number_of_characters_read,
+					CHARACTERS_TO_READ_FROM_GAINSPAN_RESPONSE - 1 - number_of_characters_read, &ticks_to_wait)) > 0)){
+		response_line = gs_command_response + number_of_characters_read;
+		number_of_characters_read += line_length;
+		gs_command_response[number_of_characters_read] = '\0';
+		if (gs_is_final_result(response_line) == BOOLEAN_TRUE){
+			break;
+		}
+		if ((request != NULL) && (request->line_callback != NULL)){
+			/*Line handed over, the buffer is reused for the next one*/
+			LOG_DEBUG(LOG_MODULE_GAINSPAN, LOG_GS_RESPONSE, response_line);
+			request->line_callback(request, response_line);
+			number_of_characters_read -= line_length;
+		}
+	}
+	if (number_of_characters_read >= CHARACTERS_TO_READ_FROM_GAINSPAN_RESPONSE - 1){
+		/*Discard the rest of characters from USART buffer*/
+		gs_flush();
+	}
 
-	 gs_command_response[string_index] = '\0';  //terminate string
+	 gs_command_response[number_of_characters_read] = '\0';  //terminate string
 
-	 #if SET_GAINSPAN_TERMINAL_OUTPUT_ON == 1
-	 	 /*Send the actual command to serial terminal for debugging*/
- 	 	 usart_xfprint(gainspan.serial_terminal_usart_id, (uint8_t *) "\n\rResponse:");
-	 	 usart_xfprint(gainspan.serial_terminal_usart_id, (uint8_t *) gs_command_response);
- 	 	 usart_xfprint(gainspan.serial_terminal_usart_id, (uint8_t *) "\n\r");
-	 #endif
+ 	 /*Send the response to serial terminal for debugging (truncated to a log record)*/
+ 	 LOG_DEBUG(LOG_MODULE_GAINSPAN, LOG_GS_RESPONSE, gs_command_response);
 
 	 return number_of_characters_read;
 }
 
 
+/*!
+ * \brief Collect the data (client requests) sent by Gainspan WiFi module.
+ *
+ *
+ * \details Unlike a command response, the data from a socket has no final result line and its frames do not end with
+ * a line terminator. The calling task sleeps until data arrives (for at most the polling period), then until the end
+ * of the data, i.e. the line has been idle for GAINSPAN_RESPONSE_IDLE_GAP_IN_CHARACTER_TIMES (usart_xreadMessage).
+ *
+ * \note: returns maximum 127 characters, and rest of the data is discarded.
+ *
+ * @param gs_data_response - Pointer to string buffer to return the data.
+ * @param polling_period_in_milliseconds - Polling period.
+ * @return - returns the number of characters read.
+ *
+ */
+uint16_t gs_get_data_response(char *gs_data_response, uint16_t polling_period_in_milliseconds){
+	uint16_t number_of_characters_read = 0;
+	TickType_t ticks_to_wait = (polling_period_in_milliseconds + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+
+	/*Sleep until the data arrives and ends, or the polling period expires. Last character reserved for termination*/
+	number_of_characters_read = usart_xreadMessage(gainspan.usart_id, (uint8_t *) gs_data_response,
+			CHARACTERS_TO_READ_FROM_GAINSPAN_RESPONSE - 1, ticks_to_wait);
+	if (number_of_characters_read >= CHARACTERS_TO_READ_FROM_GAINSPAN_RESPONSE - 1){
+		/*Discard the rest of characters from USART buffer*/
+		gs_flush();
+	}
+
+	gs_data_response[number_of_characters_read] = '\0';  //terminate string
+
+	/*Send the data to serial terminal for debugging (truncated to a log record)*/
+	LOG_DEBUG(LOG_MODULE_GAINSPAN, LOG_GS_RESPONSE, gs_data_response);
+
+	return number_of_characters_read;
+}
+
+
+/*!
+ * \brief Check for the final result line of a command response.
+ *
+ *
+ * \details The final result line ends the response of a command: OK, ERROR (with or without details) or
+ * INVALID CID. Leading carriage returns are skipped.
+ *
+ *
+ * @param response_line - start of the line.
+ * @return - BOOLEAN_TRUE if the line is a final result line, else BOOLEAN_FALSE.
+ *
+ */
+BOOLEAN_DATA gs_is_final_result(char *response_line){
+	while (*response_line == '\r'){
+		response_line++;
+	}
+	if ((strncmp(response_line, "OK", 2) == 0) || (strncmp(response_line, "ERROR", 5) == 0) ||
+			(strncmp(response_line, "INVALID CID", 11) == 0)){
+		return BOOLEAN_TRUE;
+	}
+	return BOOLEAN_FALSE;
+}
+
+
+/*!
+ * \brief Get the response timeout of a command.
+ *
+ *
+ * @param at_command - valid command, refer the list of valid commands.
+ * @return - maximum time to wait for the final result line, in milliseconds (gs_at_command_timeouts).
+ *
+ */
+uint16_t gs_get_command_timeout(AT_COMMAND at_command){
+	return pgm_read_word(&gs_at_command_timeouts[at_command]);
+}
+
+
 /*!
  * \brief Parse the command response from Gainspan WiFi module.
  *
@@ -1911,7 +2214,8 @@ uint16_t gs_get_command_response(char *gs_command_response, uint16_t polling_per
  * Response are defined in COMMAND_OUTCOME. For more details read the data-sheet or related documentation
  * for Gainspan GS1011M.
  *
- *
+ * \note The response is parsed in a single pass, each line is compared in place when its end is reached. Unsolicited
+ * events are handled by gs_route_unsolicited_event and do not change the outcome.
  *
  * @param gs_command_response - Pointer to string buffer having the response from module.
  * @return - command outcome, valid values are defined by COMMAND_OUTCOME.
@@ -1919,33 +2223,23 @@ uint16_t gs_get_command_response(char *gs_command_response, uint16_t polling_per
  */
 COMMAND_OUTCOME gs_parse_command_response(char *gs_command_response){
 	COMMAND_OUTCOME command_result = COMMAND_OUTCOME_NO_RESPONSE;
-	char string_buffer[80];
-	uint16_t string_buffer_index = 0;
-	uint16_t string_index = 0;
-
-	memset(string_buffer, ' ', 80);
-
-	if (strlen(gs_command_response) <= 0 ){
-		command_result = COMMAND_OUTCOME_NO_RESPONSE;
-	}else{
-		for(string_index = 0; string_index <= strlen(gs_command_response); string_index++){
-			if ((gs_command_response[string_index] == '\r') || (gs_command_response[string_index] == '\n')){				//end of line
-				if (string_buffer_index > 0){ //valid string
-					//compare for OK or ERROR
-					string_buffer[string_buffer_index] = '\0';
-					if (strncmp(string_buffer, "OK", 2) == 0){ //OK
-						command_result = COMMAND_OUTCOME_SUCCESS;
-					} else if (strncmp(string_buffer, "ERROR", 5) == 0){ //ERROR
-						command_result = COMMAND_OUTCOME_ERROR;
-					}
-					string_buffer_index = 0;
-					memset(string_buffer, ' ', 80); //flush
-					string_buffer[0] = '\0'; //terminate string
+	char *line_start = gs_command_response;
+	char *character = gs_command_response;
+
+	for(character = gs_command_response; ; character++){
+		if ((*character == '\r') || (*character == '\n') || (*character == '\0')){				//end of line
+			if ((character > line_start) && (gs_route_unsolicited_event(line_start) == BOOLEAN_FALSE)){ //valid string, not an event
+				//compare for OK or ERROR
+				if (strncmp(line_start, "OK", 2) == 0){ //OK
+					command_result = COMMAND_OUTCOME_SUCCESS;
+				} else if (strncmp(line_start, "ERROR", 5) == 0){ //ERROR
+					command_result = COMMAND_OUTCOME_ERROR;
 				}
-			}else{
-				string_buffer[string_buffer_index] = gs_command_response[string_index];
-				string_buffer_index++;
 			}
+			if (*character == '\0'){
+				break;
+			}
+			line_start = character + 1;
 		}
 	}
 	return command_result;
@@ -1961,7 +2255,9 @@ COMMAND_OUTCOME gs_parse_command_response(char *gs_command_response){
  * Response are defined in COMMAND_OUTCOME. For more details read the data-sheet or related documentation
  * for Gainspan GS1011M.
  * This function modifies the other function gs_parse_command_response , as it handles the response for
- * TCP connections.
+ * TCP connections. The response is parsed in a single pass, each line is compared in place.
+ * Unsolicited events are handled by gs_route_unsolicited_event; in process mode, where the client requests are
+ * read, an event is the outcome (COMMAND_OUTCOME_SUCCESS), otherwise the parsing goes on to the final result.
  *
  *
  *
@@ -1973,79 +2269,48 @@ COMMAND_OUTCOME gs_parse_command_response(char *gs_command_response){
  */
 COMMAND_OUTCOME gs_parse_command_response_tcp(char *gs_command_response, SOCKET_MODE socket_mode, AT_COMMAND at_command){
 	COMMAND_OUTCOME command_result = COMMAND_OUTCOME_NO_RESPONSE;
-	char string_buffer[MAX_TX_BUFFER];
-	uint16_t string_buffer_index = 0;
-	uint16_t string_index = 0;
+	char *line_start = gs_command_response;
+	char *character = gs_command_response;
 	TCP_SOCKET socket = gainspan.active_socket;
-	SUCCESS_ERROR process_result = ERROR;
 
-	memset(string_buffer, ' ', MAX_TX_BUFFER);
-
-	if (strlen(gs_command_response) <= 0 ){
-		command_result = COMMAND_OUTCOME_NO_RESPONSE;
-	}else{
-		for(string_index = 0; string_index <= strlen(gs_command_response); string_index++){
-			if ((gs_command_response[string_index] == '\r') || (gs_command_response[string_index] == '\n')){				//end of line
-				if (string_buffer_index > 0){ //valid string
-					//compare for CONNECT, OK or ERROR
-					string_buffer[string_buffer_index] = '\0';
-					if (strncmp(string_buffer, "CONNECT", 7) == 0){ //CONNECT
-						if(socket_mode == SOCKET_MODE_ENABLE){
-							/*Socket Activate/Enable mode*/
-							gainspan.server_cid = hex_to_int(string_buffer[8]);
-							gainspan.active_client_cid = hex_to_int(string_buffer[8]);
-							gainspan.socket_table[gainspan.active_socket].cid = hex_to_int(string_buffer[8]);
-							gainspan.socket_table[gainspan.active_socket].status = SOCKET_STATUS_LISTEN;
-						}else if(socket_mode == SOCKET_MODE_PROCESS){
-							/*Socket Process mode*/
-							for(socket = 0; socket  < MAX_SOCKET_NUMBER; socket++){
-								if((gainspan.socket_table[socket].status == SOCKET_STATUS_LISTEN) && (gainspan.socket_table[socket].cid == hex_to_int(string_buffer[8]))){
-									if((gainspan.socket_table[socket].protocol == PROTOCOL_TCP) && (gainspan.server_cid == hex_to_int(string_buffer[8]))){
-										gainspan.active_socket = socket;
-										gainspan.active_client_cid = hex_to_int(string_buffer[10]);
-										gainspan.socket_table[socket].cid = hex_to_int(string_buffer[10]);
-										gainspan.socket_table[socket].status = SOCKET_STATUS_ESTABLISHED;
-									}
-								}
-							}
-						}
-						command_result = COMMAND_OUTCOME_SUCCESS;
-						break;
-					}else if (strncmp(string_buffer, "DISCONNECT", 10) == 0){ //DISCONNECT
-						for(socket = 0; socket  < MAX_SOCKET_NUMBER; socket++){
-							if(((gainspan.socket_table[socket].status == SOCKET_STATUS_ESTABLISHED) || (gainspan.socket_table[socket].status == SOCKET_STATUS_LISTEN)) && (gainspan.active_client_cid == hex_to_int(string_buffer[11]))){
-								process_result = gs_reset_socket(socket);
-								gainspan.device_operation_mode = GAINSPAN_DEVICE_MODE_COMMAND;
-							}
-						}
+	for(character = gs_command_response; ; character++){
+		if ((*character == '\r') || (*character == '\n') || (*character == '\0')){				//end of line
+			if (character > line_start){ //valid string
+				//route events, then compare for CONNECT, OK or ERROR
+				if (gs_route_unsolicited_event(line_start) == BOOLEAN_TRUE){ //CONNECT of a client, DISCONNECT, Disassociation Event
+					if(socket_mode == SOCKET_MODE_PROCESS){
 						command_result = COMMAND_OUTCOME_SUCCESS;
 						break;
-					}else if (strncmp(string_buffer, "Disassociation Event", 20) == 0){ //DISCONNECT
-						gainspan.device_connection_status = GAINSPAN_ACTIVE_TRUE_WITH_ERRORS;
-						command_result = COMMAND_OUTCOME_SUCCESS;
-						break;
-					}else if (strncmp(string_buffer, "OK", 2) == 0){ //OK
-						command_result = COMMAND_OUTCOME_SUCCESS;
-						gainspan.device_operation_mode = GAINSPAN_DEVICE_MODE_COMMAND;
-						break;
-					} else if (strncmp(string_buffer, "ERROR", 5) == 0){ //ERROR
-						/*Put active socket to listen mode*/
-						gainspan.socket_table[socket].status = SOCKET_STATUS_LISTEN;
-						gainspan.device_operation_mode = GAINSPAN_DEVICE_MODE_COMMAND;
-						command_result = COMMAND_OUTCOME_ERROR;
-						break;
-					} else if (strncmp(string_buffer, "INVALID CID", 11) == 0){ //Invalid CID
-						command_result = COMMAND_OUTCOME_ERROR;
-						break;
 					}
-					string_buffer_index = 0;
-					memset(string_buffer, ' ', MAX_TX_BUFFER);  //flush
-					string_buffer[0] = '\0'; 					//terminate string
+				}else if (strncmp(line_start, "CONNECT", 7) == 0){ //CONNECT <server CID>
+					if(socket_mode == SOCKET_MODE_ENABLE){
+						/*Socket Activate/Enable mode*/
+						gainspan.server_cid = hex_to_int(line_start[8]);
+						gainspan.active_client_cid = hex_to_int(line_start[8]);
+						gainspan.socket_table[gainspan.active_socket].cid = hex_to_int(line_start[8]);
+						gainspan.socket_table[gainspan.active_socket].status = SOCKET_STATUS_LISTEN;
+					}
+					command_result = COMMAND_OUTCOME_SUCCESS;
+					break;
+				}else if (strncmp(line_start, "OK", 2) == 0){ //OK
+					command_result = COMMAND_OUTCOME_SUCCESS;
+					gainspan.device_operation_mode = GAINSPAN_DEVICE_MODE_COMMAND;
+					break;
+				} else if (strncmp(line_start, "ERROR", 5) == 0){ //ERROR
+					/*Put active socket to listen mode*/
+					gainspan.socket_table[socket].status = SOCKET_STATUS_LISTEN;
+					gainspan.device_operation_mode = GAINSPAN_DEVICE_MODE_COMMAND;
+					command_result = COMMAND_OUTCOME_ERROR;
+					break;
+				} else if (strncmp(line_start, "INVALID CID", 11) == 0){ //Invalid CID
+					command_result = COMMAND_OUTCOME_ERROR;
+					break;
 				}
-			}else{
-				string_buffer[string_buffer_index] = gs_command_response[string_index];
-				string_buffer_index++;
 			}
+			if (*character == '\0'){
+				break;
+			}
+			line_start = character + 1;
 		}
 	}
 	return command_result ;
@@ -2056,8 +2321,8 @@ COMMAND_OUTCOME gs_parse_command_response_tcp(char *gs_command_response, SOCKET_
  * \brief Send the message to serial terminal on outcome of the command response from Gainspan WiFi module.
  *
  *
- * \details Sends appropriate message to serial terminal.
- *
+ * \details Sends appropriate message to serial terminal, as a log message (the text is rebuilt by the host
+ * decoder).
  *
  *
  * @param at_command - valid command issued, refer the list of valid commands.
@@ -2065,24 +2330,18 @@ COMMAND_OUTCOME gs_parse_command_response_tcp(char *gs_command_response, SOCKET_
  *
  */
 void gs_send_command_response_to_serial_terminal(AT_COMMAND at_command, COMMAND_OUTCOME command_result){
-	char string_buffer[80] = "", command_response_result[50] = "\0";
-
 	switch (command_result){
 	case COMMAND_OUTCOME_ERROR:
-		strcpy(command_response_result, "ERROR!");
+		LOG_ERROR(LOG_MODULE_GAINSPAN, LOG_GS_COMMAND_ERROR, gs_at_commands[at_command]);
 		break;
 	case COMMAND_OUTCOME_SUCCESS:
-		strcpy(command_response_result, "SUCCESS!");
+		LOG_DEBUG(LOG_MODULE_GAINSPAN, LOG_GS_COMMAND_SUCCESS, gs_at_commands[at_command]);
 		break;
 	case COMMAND_OUTCOME_NO_RESPONSE:
-		strcpy(command_response_result, "NO RESPONSE CAPTURED!");
-		break;
 	default:
-		strcpy(command_response_result, "NO RESPONSE CAPTURED!");
+		LOG_WARNING(LOG_MODULE_GAINSPAN, LOG_GS_COMMAND_NO_RESPONSE, gs_at_commands[at_command]);
 		break;
 	}
-	sprintf(string_buffer,"Command-%s: %s\n\r", gs_at_commands[at_command], (char *) command_response_result);
-	usart_xfprint(gainspan.serial_terminal_usart_id, (uint8_t *) string_buffer);
 }
 
 
@@ -2090,32 +2349,301 @@ void gs_send_command_response_to_serial_terminal(AT_COMMAND at_command, COMMAND_
  * \brief Send the activation status of Gainspan WiFi module to serial terminal.
  *
  *
- * \details Sends appropriate message to serial terminal.
+ * \details Sends appropriate message to serial terminal, as a log message.
  *
  *
  * @param gs_active - device activation status, valid values are defined by GAINSPAN_ACTIVE.
  *
  */
 void gs_send_activation_status_to_serial_terminal(GAINSPAN_ACTIVE gs_active){
-	char string_buffer[80] = "", gs_activate_status[50] = "\0";
-
 	switch (gs_active){
-	case GAINSPAN_ACTIVE_FALSE:
-		strcpy(gs_activate_status, "activation failure!");
-		break;
 	case GAINSPAN_ACTIVE_TRUE:
-		strcpy(gs_activate_status, "activated successfully!");
+		LOG_INFO(LOG_MODULE_GAINSPAN, LOG_GS_ACTIVATED);
 		break;
 	case GAINSPAN_ACTIVE_TRUE_WITH_ERRORS:
-		strcpy(gs_activate_status, "activated with errors!");
+		LOG_WARNING(LOG_MODULE_GAINSPAN, LOG_GS_ACTIVATED_WITH_ERRORS);
 		break;
+	case GAINSPAN_ACTIVE_FALSE:
 	default:
-		strcpy(gs_activate_status, "activation failure!");
+		LOG_ERROR(LOG_MODULE_GAINSPAN, LOG_GS_ACTIVATION_FAILED);
 		break;
 	}
+}
 
-	sprintf(string_buffer,"\n\rGainspan Device: %s\n\r", (char *) gs_activate_status);
-	usart_xfprint(gainspan.serial_terminal_usart_id, (uint8_t *) string_buffer);
+
+/*!
+ * \brief Handle an unsolicited event from Gainspan WiFi module.
+ *
+ *
+ * \details Recognizes the events the module sends on its own, whatever the command in progress, and updates the
+ * socket table and the device connection status:
+ * 	- CONNECT <server CID> <client CID> <ip> <port> - a client connected to the TCP server, its socket is established.
+ * 	  Once the web server is started, a CONNECT found here was read with the response of a command, which may have
+ * 	  taken the request of the client as response lines: the client is closed (its browser connects again). The
+ * 	  clients are only accepted from the data read by the web server (gs_route_client_line).
+ * 	- DISCONNECT <CID> - the client disconnected, its socket is reset to listen (its connection is closed).
+ * 	- Disassociation Event - the wireless network was lost.
+ *
+ * \note CONNECT <server CID> alone is the response to AT_START_TCP_SERVER, not an event.
+ *
+ * @param response_line - start of the line, terminated by '\r', '\n' or '\0'.
+ * @return - BOOLEAN_TRUE if the line is an event (handled), else BOOLEAN_FALSE.
+ *
+ */
+BOOLEAN_DATA gs_route_unsolicited_event(char *response_line){
+	TCP_SOCKET socket = 0;
+	uint8_t client_cid = INVALID_CID;
+
+	if ((strncmp(response_line, "CONNECT", 7) == 0) && (response_line[8] != '\0') && (response_line[9] == ' ')){
+		client_cid = gs_web_client_cid(response_line);
+		if (client_cid != INVALID_CID){
+			LOG_WARNING(LOG_MODULE_WEB_SERVER, LOG_WEB_CLIENT_DROPPED, client_cid);
+			gs_close_client_connection(client_cid);
+			return BOOLEAN_TRUE;
+		}
+		for(socket = 0; socket  < MAX_SOCKET_NUMBER; socket++){
+			if((gainspan.socket_table[socket].status == SOCKET_STATUS_LISTEN) && (gainspan.socket_table[socket].cid == hex_to_int(response_line[8]))){
+				if((gainspan.socket_table[socket].protocol == PROTOCOL_TCP) && (gainspan.server_cid == hex_to_int(response_line[8]))){
+					gainspan.active_socket = socket;
+					gainspan.active_client_cid = hex_to_int(response_line[10]);
+					gainspan.socket_table[socket].cid = hex_to_int(response_line[10]);
+					gainspan.socket_table[socket].status = SOCKET_STATUS_ESTABLISHED;
+				}
+			}
+		}
+		return BOOLEAN_TRUE;
+	}else if (strncmp(response_line, "DISCONNECT", 10) == 0){
+		if (web_server_status == WEB_SERVER_ACTIVE){
+			web_connections_close(&web_connections, hex_to_int(response_line[11]));
+			return BOOLEAN_TRUE;
+		}
+		for(socket = 0; socket  < MAX_SOCKET_NUMBER; socket++){
+			if(((gainspan.socket_table[socket].status == SOCKET_STATUS_ESTABLISHED) || (gainspan.socket_table[socket].status == SOCKET_STATUS_LISTEN)) && (gainspan.active_client_cid == hex_to_int(response_line[11]))){
+				gs_reset_socket(socket);
+				gainspan.device_operation_mode = GAINSPAN_DEVICE_MODE_COMMAND;
+			}
+		}
+		return BOOLEAN_TRUE;
+	}else if (strncmp(response_line, "Disassociation Event", 20) == 0){
+		gainspan.device_connection_status = GAINSPAN_ACTIVE_TRUE_WITH_ERRORS;
+		return BOOLEAN_TRUE;
+	}
+	return BOOLEAN_FALSE;
+}
+
+
+/*!
+ * \brief Check the link with Gainspan module.
+ *
+ *
+ * \details Sends AT (up to LINK_CHECK_ATTEMPTS times, the first command after power up may fail) and measures the
+ * time from sending the command to receiving the line with its outcome (OK or ERROR). Unlike
+ * gs_get_command_response, the time does not include the idle gap ending the response, so it reflects the link speed.
+ *
+ *
+ * @param round_trip_in_milliseconds - returns the round trip time of the last attempt.
+ * @return - command outcome, COMMAND_OUTCOME_SUCCESS if the module answered OK.
+ *
+ */
+COMMAND_OUTCOME gs_check_link(unsigned long *round_trip_in_milliseconds){
+	char response_line[CHARACTERS_TO_READ_FROM_GAINSPAN_RESPONSE] = "\0";
+	COMMAND_OUTCOME command_result = COMMAND_OUTCOME_NO_RESPONSE;
+	unsigned long start_time = 0;
+	uint16_t line_length = 0;
+	TickType_t ticks_to_wait = 0;
+	uint8_t attempt = 0;
+
+	gs_link_lock();
+	for (attempt = 0; (attempt < LINK_CHECK_ATTEMPTS) && (command_result != COMMAND_OUTCOME_SUCCESS); attempt++){
+		start_time = time_in_milliseconds();
+		gs_send_command(AT_OK);
+		/*Read lines (echo, blank lines) until the outcome*/
+		command_result = COMMAND_OUTCOME_NO_RESPONSE;
+		ticks_to_wait = (gs_get_command_timeout(AT_OK) + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+		while ((command_result == COMMAND_OUTCOME_NO_RESPONSE) &&
+				((line_length = usart_xreadLine(gainspan.usart_id, (uint8_t *) response_line, sizeof(response_line) - 1, &ticks_to_wait)) > 0)){
+			response_line[line_length] = '\0';
+			command_result = gs_parse_command_response(response_line);
+		}
+		*round_trip_in_milliseconds = time_in_milliseconds() - start_time;
+	}
+	gs_link_unlock();
+	return command_result;
+}
+
+
+/*!
+ * \brief Query the state of Gainspan module.
+ *
+ *
+ * \details Executes a status query through the AT command engine. The response is longer than a command response
+ * buffer, so its lines are checked one by one as they arrive (gs_check_state_line):
+ * 	- AT_GET_CURRENT_WIRELESS_NETWORK_STATUS - the module is associated (network created) with the configured SSID.
+ * 	- AT_GET_CURRENT_NETWORK_STATUS - the module has the configured local IP address.
+ *
+ *
+ * @param at_command - AT_GET_CURRENT_WIRELESS_NETWORK_STATUS or AT_GET_CURRENT_NETWORK_STATUS.
+ * @return - BOOLEAN_TRUE if the module answered OK and the state is as configured, else BOOLEAN_FALSE.
+ *
+ */
+BOOLEAN_DATA gs_query_module_state(AT_COMMAND at_command){
+	GS_STATE_QUERY query;
+	GS_AT_REQUEST request;
+
+	query.expected_value = (at_command == AT_GET_CURRENT_NETWORK_STATUS) ? gainspan.local_ip_address : gainspan.ssid;
+	query.value_found = BOOLEAN_FALSE;
+	query.not_connected = BOOLEAN_FALSE;
+
+	request.at_command = at_command;
+	request.timeout_in_milliseconds = 0;
+	request.socket_mode = SOCKET_MODE_NONE;
+	request.line_callback = gs_check_state_line;
+	request.context = &query;
+
+	if ((gs_execute_request(&request) == COMMAND_OUTCOME_SUCCESS) && (query.value_found == BOOLEAN_TRUE) &&
+			(query.not_connected == BOOLEAN_FALSE)){
+		return BOOLEAN_TRUE;
+	}
+	return BOOLEAN_FALSE;
+}
+
+
+/*!
+ * \brief Check a line of a status response (line callback of gs_query_module_state).
+ *
+ *
+ * @param request - request of the status query, its context is the GS_STATE_QUERY.
+ * @param response_line - line of the response, terminated.
+ *
+ */
+void gs_check_state_line(GS_AT_REQUEST *request, char *response_line){
+	GS_STATE_QUERY *query = (GS_STATE_QUERY *) request->context;
+
+	if (strstr(response_line, "NOT CONNECTED") != NULL){
+		query->not_connected = BOOLEAN_TRUE;
+	}else if (gs_response_has_value(response_line, query->expected_value) == BOOLEAN_TRUE){
+		query->value_found = BOOLEAN_TRUE;
+	}
+}
+
+
+/*!
+ * \brief Find a configuration value in a status response line.
+ *
+ *
+ * \details The value must stand on its own, e.g. 192.168.3.1 is not found in 192.168.3.10, nor the SSID Chico in
+ * "ChicoBot".
+ *
+ *
+ * @param response_line - line of a status response, terminated.
+ * @param value - configuration value (SSID, IP address).
+ * @return - BOOLEAN_TRUE if the value is found, else BOOLEAN_FALSE.
+ *
+ */
+BOOLEAN_DATA gs_response_has_value(char *response_line, char *value){
+	size_t value_length = strlen(value);
+	char *match = response_line;
+
+	if (value_length == 0){
+		return BOOLEAN_FALSE;
+	}
+	while ((match = strstr(match, value)) != NULL){
+		if (!isalnum((unsigned char) match[value_length]) && (match[value_length] != '.') &&
+				((match == response_line) || (!isalnum((unsigned char) match[-1]) && (match[-1] != '.')))){
+			return BOOLEAN_TRUE;
+		}
+		match++;
+	}
+	return BOOLEAN_FALSE;
+}
+
+
+/*!
+ * \brief Create the request queue and the link mutex of the AT command engine.
+ *
+ *
+ * \details Called by gs_initialize_module and by gs_at_engine_task, whichever runs first; later calls do nothing.
+ *
+ *
+ */
+void gs_at_engine_initialize(void){
+	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING){
+		vTaskSuspendAll();
+	}
+	if (gs_at_queue == NULL){
+		gs_at_queue = xQueueCreate(GS_AT_QUEUE_LENGTH, sizeof(GS_AT_REQUEST *));
+	}
+	if (gs_link_mutex == NULL){
+		gs_link_mutex = xSemaphoreCreateMutex();
+	}
+	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING){
+		xTaskResumeAll();
+	}
+}
+
+
+/*!
+ * \brief Exchange a command with Gainspan WiFi module.
+ *
+ *
+ * \details Sends the command, collects its response and parses it, then sends the outcome to the serial terminal.
+ * The caller holds the link (gs_link_lock).
+ *
+ *
+ * @param request - command request: command, timeout (0 for the timeout of the command), socket mode (SOCKET_MODE_NONE,
+ * or socket mode of a TCP command) and line callback.
+ * @return - command outcome, valid values are defined by COMMAND_OUTCOME.
+ *
+ */
+COMMAND_OUTCOME gs_exchange_command(GS_AT_REQUEST *request){
+	char gs_command_response[CHARACTERS_TO_READ_FROM_GAINSPAN_RESPONSE] = "\0";
+	COMMAND_OUTCOME command_result = COMMAND_OUTCOME_NO_RESPONSE;
+	uint16_t timeout_in_milliseconds = request->timeout_in_milliseconds;
+
+	if (timeout_in_milliseconds == 0){
+		timeout_in_milliseconds = gs_get_command_timeout(request->at_command);
+	}
+	if (gs_send_command(request->at_command) == ERROR){
+		/*Not sent, no response to wait for*/
+		command_result = COMMAND_OUTCOME_ERROR;
+	}else{
+		gs_get_command_response(gs_command_response, timeout_in_milliseconds, request);
+		if (request->socket_mode == SOCKET_MODE_NONE){
+			command_result = gs_parse_command_response(gs_command_response);
+		}else{
+			command_result = gs_parse_command_response_tcp(gs_command_response, request->socket_mode, request->at_command);
+		}
+	}
+	gs_send_command_response_to_serial_terminal(request->at_command, command_result);
+
+	return command_result;
+}
+
+
+/*!
+ * \brief Take the link with Gainspan WiFi module.
+ *
+ *
+ * \details Waits until no other task exchanges with the module. Does nothing before the scheduler is started.
+ *
+ *
+ */
+void gs_link_lock(void){
+	if ((gs_link_mutex != NULL) && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)){
+		xSemaphoreTake(gs_link_mutex, portMAX_DELAY);
+	}
+}
+
+
+/*!
+ * \brief Release the link with Gainspan WiFi module, taken with gs_link_lock.
+ *
+ *
+ */
+void gs_link_unlock(void){
+	if ((gs_link_mutex != NULL) && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)){
+		xSemaphoreGive(gs_link_mutex);
+	}
 }
 
 
@@ -2136,10 +2664,377 @@ void gs_send_activation_status_to_serial_terminal(GAINSPAN_ACTIVE gs_active){
 void initialize_web_server(uint16_t port, uint8_t protocol){
 	wifi_server.server_port = 80;
 	wifi_server.server_protocol = PROTOCOL_TCP;
-	#if SET_WEB_SERVER_TERMINAL_OUTPUT_ON == 1
+	/*Send message to serial terminal*/
+	LOG_INFO(LOG_MODULE_WEB_SERVER, LOG_WEB_SERVER_INITIALIZED);
+}
+
+
+/*!\brief Render the web-page.
+ *
+ * \details Renders the HTTP header and the HTML of the configured web-page into client_web_page.rendered_page, so
+ * that each client request sends it as is, in a single data frame. The literal text is kept in program memory.
+ * configure_web_page and add_element_choice mark the rendered page out of date (rendered_length 0).
+ *
+ * \note A web-page longer than WEB_PAGE_RENDERED_SIZE is truncated and marked (rendered_truncated), it is not served.
+ *
+ */
+void gs_render_web_page(void){
+	FORMAT_BUFFER page;
+	uint8_t loop_counter = 0;
+
+	format_initialize(&page, client_web_page.rendered_page, WEB_PAGE_RENDERED_SIZE);
+
+	//HTML header
+	FORMAT_APPEND_LITERAL(&page, "HTTP/1.1 200 OK\n");
+	FORMAT_APPEND_LITERAL(&page, "Content-Type: text/html\n\n");
+	FORMAT_APPEND_LITERAL(&page, "<!DOCTYPE HTML>\n\n");
+	//Web page HTML script/code
+	FORMAT_APPEND_LITERAL(&page, "<html> \n");
+	FORMAT_APPEND_LITERAL(&page, "<head> \n");
+	/*Page title*/
+	FORMAT_APPEND_LITERAL(&page, "<title>");
+	format_append_string(&page, client_web_page.page_title);
+	FORMAT_APPEND_LITERAL(&page, "</title> \n");
+	FORMAT_APPEND_LITERAL(&page, "</head> \n");
+	FORMAT_APPEND_LITERAL(&page, "<body> \n");
+	/*Page title*/
+	FORMAT_APPEND_LITERAL(&page, "<center><h1>");
+	format_append_string(&page, client_web_page.page_title);
+	FORMAT_APPEND_LITERAL(&page, "</h1> \n");
+	FORMAT_APPEND_LITERAL(&page, "<center><h3>");
+	format_append_string(&page, client_web_page.menu_title);
+	FORMAT_APPEND_LITERAL(&page, "</h3> \n\n");
+	FORMAT_APPEND_LITERAL(&page, "<p> \n");
+	FORMAT_APPEND_LITERAL(&page, "<form method=\"get\" action=\"\"> \n");
+	/*Check for element type*/
+	if (client_web_page.element_type == HTML_DROPDOWN_LIST ){
+		FORMAT_APPEND_LITERAL(&page, "<select name=\"l\"> \n");
+		/*Add the elements*/
+		for (loop_counter = 0; loop_counter < client_web_page.element_count; loop_counter++){
+			FORMAT_APPEND_LITERAL(&page, "<option value=\"");
+			format_append_character(&page, client_web_page.web_page_elements[loop_counter].element_identifier);
+			FORMAT_APPEND_LITERAL(&page, "\">");
+			format_append_string(&page, client_web_page.web_page_elements[loop_counter].element_label);
+			FORMAT_APPEND_LITERAL(&page, "</option> \n");
+		}
+		FORMAT_APPEND_LITERAL(&page, "</select> \n");
+	}else if (client_web_page.element_type == HTML_RADIO_BUTTON){
+		for (loop_counter = 0; loop_counter < client_web_page.element_count; loop_counter++){
+			FORMAT_APPEND_LITERAL(&page, "<input type=\"radio\" name=\"choice\" value=\"");
+			format_append_character(&page, client_web_page.web_page_elements[loop_counter].element_identifier);
+			FORMAT_APPEND_LITERAL(&page, "\">");
+			format_append_string(&page, client_web_page.web_page_elements[loop_counter].element_label);
+			FORMAT_APPEND_LITERAL(&page, " \n");
+		}
+	}else{
+		FORMAT_APPEND_LITERAL(&page, "<center><h3> No valid elements added, please check! </h3> \n\n");
+	}
+	FORMAT_APPEND_LITERAL(&page, "<input type=\"submit\" value=\"Set\"> \n");
+	FORMAT_APPEND_LITERAL(&page, "</form> \n");
+	FORMAT_APPEND_LITERAL(&page, "</p> \n");
+	FORMAT_APPEND_LITERAL(&page, "</center> \n");
+	FORMAT_APPEND_LITERAL(&page, "</body> \n");
+	FORMAT_APPEND_LITERAL(&page, "</html>");
+
+	client_web_page.rendered_length = page.length;
+	client_web_page.rendered_truncated = (page.length >= WEB_PAGE_RENDERED_SIZE - 1) ? BOOLEAN_TRUE : BOOLEAN_FALSE;
+	if (client_web_page.rendered_truncated == BOOLEAN_TRUE){
 		/*Send message to serial terminal*/
-		usart_xfprint(SERIAL_TERNMINAL, (uint8_t *) "\n\rWeb Server: Initialized....\n\r");
-	#endif
+		LOG_WARNING(LOG_MODULE_WEB_SERVER, LOG_WEB_PAGE_TRUNCATED, WEB_PAGE_RENDERED_SIZE);
+	}else{
+		LOG_DEBUG(LOG_MODULE_WEB_SERVER, LOG_WEB_PAGE_RENDERED, page.length);
+	}
+}
+
+
+/*!
+ * \brief Send data to socket in bulk data frames.
+ *
+ *
+ * \details Sends ESC Z <CID> <4 digit length> followed by the data, in frames of at most GAINSPAN_BULK_MAX_LENGTH
+ * characters. With SET_GAINSPAN_BULK_ACKNOWLEDGEMENT_ON, each frame waits for the answer of the module before the
+ * next one; otherwise, for the frame to be on the wire (see gs_wait_data_acknowledgement). The caller holds the link
+ * (gs_link_lock).
+ *
+ *
+ * @param cid - CID of the TCP connection.
+ * @param data - data to be written, need not be terminated.
+ * @param data_length - number of characters to write.
+ * @return - outcome, SUCCESS if the module accepted all the frames, else ERROR; defined by SUCCESS_ERROR.
+ *
+ */
+SUCCESS_ERROR gs_send_bulk_data(uint8_t cid, const uint8_t *data, uint16_t data_length){
+	char frame_start[] = {0x1b, 'Z', '0', '0', '0', '0', '0'};
+	USART_IOV frame[2];
+	uint16_t frame_length = 0;
+	uint16_t digits = 0;
+	uint8_t digit = 0;
+	COMMAND_OUTCOME command_result = COMMAND_OUTCOME_SUCCESS;
+
+	if (cid == INVALID_CID){
+		return ERROR;
+	}
+
+	/*Escape, Bulk data start - Z 0x5A, client CID*/
+	frame_start[2] = int_to_hex(cid);
+	while ((data_length > 0) && (command_result == COMMAND_OUTCOME_SUCCESS)){
+		frame_length = MIN(data_length, GAINSPAN_BULK_MAX_LENGTH);
+		/*Length, 4 decimal digits*/
+		digits = frame_length;
+		for (digit = sizeof(frame_start) - 1; digit >= 3; digit--){
+			frame_start[digit] = '0' + (digits % 10);
+			digits /= 10;
+		}
+		frame[0].base = frame_start;
+		frame[0].len = sizeof(frame_start);
+		frame[0].mem = USART_IOV_RAM;
+		frame[1].base = data;
+		frame[1].len = frame_length;
+		frame[1].mem = USART_IOV_RAM;
+
+		/*Discard an answer parsed earlier (late answer to a frame that timed out), so it is not taken for this one*/
+		web_connections_acknowledgement(&web_connections);
+		/*Block, rather than drop characters, while the transmit buffer drains*/
+		if (usart_xwritevWait(gainspan.usart_id, frame, 2, SOCKET_WRITE_TIMEOUT_IN_MILLISECONDS / portTICK_PERIOD_MS) == pdFAIL){
+			command_result = COMMAND_OUTCOME_NO_RESPONSE;
+			break;
+		}
+		command_result = gs_wait_data_acknowledgement();
+		if (command_result != COMMAND_OUTCOME_SUCCESS){
+			LOG_WARNING(LOG_MODULE_GAINSPAN, LOG_GS_BULK_NOT_ACKNOWLEDGED, cid, command_result, frame_length);
+		}
+		data += frame_length;
+		data_length -= frame_length;
+	}
+	return (command_result == COMMAND_OUTCOME_SUCCESS) ? SUCCESS : ERROR;
+}
+
+
+/*!
+ * \brief Wait for the answer of Gainspan module to a data frame.
+ *
+ *
+ * \details With SET_GAINSPAN_BULK_ACKNOWLEDGEMENT_ON, reads until ESC O (accepted) or ESC F (failed), for at most
+ * GAINSPAN_BULK_ACKNOWLEDGEMENT_TIMEOUT_IN_MILLISECONDS. Otherwise, waits for the frame to be on the wire.
+ * The characters go through the stream parser (web_connections), which finds the answer outside the data frames,
+ * so the requests and events of the other clients are not lost while a page is sent, and an escape sequence in
+ * their data is not taken for the answer.
+ *
+ *
+ * @return - COMMAND_OUTCOME_SUCCESS (accepted), COMMAND_OUTCOME_ERROR (failed) or COMMAND_OUTCOME_NO_RESPONSE.
+ *
+ */
+COMMAND_OUTCOME gs_wait_data_acknowledgement(void){
+#if SET_GAINSPAN_BULK_ACKNOWLEDGEMENT_ON
+	uint8_t data[CHARACTERS_TO_READ_FROM_GAINSPAN_RESPONSE];
+	TickType_t start_time = xTaskGetTickCount();
+	TickType_t ticks_to_wait = GAINSPAN_BULK_ACKNOWLEDGEMENT_TIMEOUT_IN_MILLISECONDS / portTICK_PERIOD_MS;
+	TickType_t elapsed_ticks = 0;
+	uint16_t number_of_characters = 0;
+	uint8_t acknowledgement = WEB_CONNECTIONS_ACKNOWLEDGEMENT_NONE;
+
+	while ((elapsed_ticks = xTaskGetTickCount() - start_time) < ticks_to_wait){
+		/*The characters already received at once, else sleep until one arrives*/
+		number_of_characters = MIN(usart_AvailableCharRx(gainspan.usart_id), sizeof(data));
+		if (usart_xread(gainspan.usart_id, data, (number_of_characters > 0) ? number_of_characters : 1,
+				ticks_to_wait - elapsed_ticks) == 0){
+			break;
+		}
+		web_connections_receive(&web_connections, data, (number_of_characters > 0) ? number_of_characters : 1,
+				gs_route_client_line);
+		acknowledgement = web_connections_acknowledgement(&web_connections);
+		if (acknowledgement == WEB_CONNECTIONS_ACKNOWLEDGEMENT_OK){
+			return COMMAND_OUTCOME_SUCCESS;
+		}
+		if (acknowledgement == WEB_CONNECTIONS_ACKNOWLEDGEMENT_FAILED){
+			return COMMAND_OUTCOME_ERROR;
+		}
+	}
+	return COMMAND_OUTCOME_NO_RESPONSE;
+#else
+	/*No answer: complete once the frame is on the wire*/
+	if (usart_xflushTx(gainspan.usart_id, SOCKET_WRITE_TIMEOUT_IN_MILLISECONDS / portTICK_PERIOD_MS) == pdFAIL){
+		return COMMAND_OUTCOME_NO_RESPONSE;
+	}
+	return COMMAND_OUTCOME_SUCCESS;
+#endif
+}
+
+
+/*!
+ * \brief Close the connection of a client.
+ *
+ *
+ * \details Sends ESC S <CID> ESC C (escape, TCP data start - S 0x53, client CID, escape, close - C 0x43). The caller
+ * holds the link (gs_link_lock).
+ *
+ *
+ * @param cid - CID of the TCP connection.
+ *
+ */
+void gs_close_client_connection(uint8_t cid){
+	char frame_start[] = {0x1b, 0x53, '0'};
+	USART_IOV frame[2];
+
+	frame_start[2] = int_to_hex(cid);
+	frame[0].base = frame_start;
+	frame[0].len = sizeof(frame_start);
+	frame[0].mem = USART_IOV_RAM;
+	frame[1].base = gs_frame_close;
+	frame[1].len = sizeof(gs_frame_close);
+	frame[1].mem = USART_IOV_PGM;
+	usart_xwritev(gainspan.usart_id, frame, 2);
+}
+
+
+/*!
+ * \brief Read the data from the web clients.
+ *
+ *
+ * \details Passes the characters received from Gainspan module to web_connections, which stores the requests in the
+ * connection of their client and routes the events (CONNECT, DISCONNECT) to gs_route_client_line. Waits for the
+ * data for at most the polling period, then reads until the receiving buffer is empty: nothing is discarded, a
+ * request may arrive in several reads. The caller holds the link (gs_link_lock).
+ *
+ *
+ * @param polling_period_in_milliseconds - Polling period, 0 to read the characters already received.
+ *
+ */
+void gs_receive_client_data(uint16_t polling_period_in_milliseconds){
+	uint8_t data[CHARACTERS_TO_READ_FROM_GAINSPAN_RESPONSE];
+	uint16_t number_of_characters_read = 0;
+	TickType_t ticks_to_wait = (polling_period_in_milliseconds + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+
+	do{
+		number_of_characters_read = usart_xreadMessage(gainspan.usart_id, data, sizeof(data), ticks_to_wait);
+		web_connections_receive(&web_connections, data, number_of_characters_read, gs_route_client_line);
+		ticks_to_wait = 0;
+	}while (number_of_characters_read > 0);
+}
+
+
+/*!
+ * \brief Handle a response line received with the data of the web clients.
+ *
+ *
+ * \details Line handler of web_connections: a client connecting to the web server gets a connection, or is closed
+ * when all the connections are in use; its data is read by the same parser, so none of it is lost. Other events
+ * are handled by gs_route_unsolicited_event, other lines are sent to serial terminal for debugging.
+ *
+ *
+ * @param line - the line, terminated.
+ *
+ */
+void gs_route_client_line(char *line){
+	uint8_t client_cid = gs_web_client_cid(line);
+
+	if (client_cid != INVALID_CID){
+		if (web_connections_open(&web_connections, client_cid, time_in_milliseconds()) == 0){
+			LOG_WARNING(LOG_MODULE_WEB_SERVER, LOG_WEB_CLIENT_REFUSED, client_cid, WEB_CONNECTIONS_MAXIMUM);
+			gs_close_client_connection(client_cid);
+		}else{
+			gainspan.active_client_cid = client_cid;
+			LOG_DEBUG(LOG_MODULE_WEB_SERVER, LOG_WEB_CLIENT_CONNECTED, client_cid,
+					web_connections_count(&web_connections));
+		}
+	}else if (gs_route_unsolicited_event(line) == BOOLEAN_FALSE){
+		LOG_DEBUG(LOG_MODULE_GAINSPAN, LOG_GS_RESPONSE, line);
+	}
+}
+
+
+/*!
+ * \brief Find the client of a CONNECT event of the web server.
+ *
+ *
+ * @param response_line - start of the line, terminated by '\r', '\n' or '\0'.
+ * @return - CID of the client for CONNECT <server CID> <client CID> once the web server is started, else INVALID_CID.
+ *
+ */
+uint8_t gs_web_client_cid(char *response_line){
+	if ((web_server_status == WEB_SERVER_ACTIVE) && (strncmp(response_line, "CONNECT", 7) == 0) &&
+			(response_line[8] != '\0') && (response_line[9] == ' ') && (response_line[10] != '\0') &&
+			(gainspan.server_cid == hex_to_int(response_line[8]))){
+		return hex_to_int(response_line[10]);
+	}
+	return INVALID_CID;
+}
+
+
+/*!
+ * \brief Serve a web client.
+ *
+ *
+ * \details Stores the client response of the request, GET /?<name>=<choice>, in the ring buffer, sends the web-page
+ * and closes the connection. A web-page that is truncated or not rendered is not sent: the client is closed and a
+ * warning is logged. The caller holds the link (gs_link_lock).
+ *
+ *
+ * @param connection - index of a ready connection in web_connections.
+ *
+ */
+void gs_serve_client(uint8_t connection){
+	uint8_t cid = web_connections.connections[connection].cid;
+	char *request_get = strstr(web_connections.connections[connection].request, "GET");
+	unsigned long page_start_time = time_in_milliseconds();
+
+	/*Extract client request and store in ring buffer*/
+	if ((request_get != NULL) && (strlen(request_get) > 8) && (request_get[5] == '?')){
+		client_response_buffer[client_response_buffer_write_pointer] = request_get[8];
+		client_response_buffer_write_pointer++;
+		if (client_response_buffer_write_pointer >= RING_BUFFER_SIZE){
+			client_response_buffer_write_pointer = 0;
+		}
+	}
+
+	/*Web-page changed since it was last served*/
+	if (client_web_page.rendered_length == 0){
+		gs_render_web_page();
+	}
+	if ((client_web_page.rendered_length == 0) || (client_web_page.rendered_truncated == BOOLEAN_TRUE)){
+		LOG_WARNING(LOG_MODULE_WEB_SERVER, LOG_WEB_SERVER_PAGE_NOT_SERVED, cid, client_web_page.rendered_length);
+		gs_close_client_connection(cid);
+		web_connections_close(&web_connections, cid);
+		return;
+	}
+	gs_send_bulk_data(cid, (uint8_t *) client_web_page.rendered_page, client_web_page.rendered_length);
+
+	/*Close, unless the client disconnected while the page was sent*/
+	if ((web_connections.connections[connection].state == WEB_CONNECTION_READY) &&
+			(web_connections.connections[connection].cid == cid)){
+		gs_close_client_connection(cid);
+		web_connections_close(&web_connections, cid);
+	}
+
+	LOG_DEBUG(LOG_MODULE_WEB_SERVER, LOG_WEB_SERVER_CLIENT_SERVED, cid, time_in_milliseconds() - page_start_time,
+			client_web_page.rendered_length, (uint32_t) gainspan.baud_rate);
+}
+
+
+/*!
+ * \brief Send the health counters of the Gainspan link to serial terminal.
+ *
+ *
+ * \details Log messages, rather than the text of usart_printStats, which would be interleaved with the telemetry
+ * frames of the serial terminal.
+ *
+ *
+ */
+void gs_log_link_stats(void){
+	USART_STATS stats;
+	USART_LOCK_STATS lock_stats;
+
+	if (LOG_ENABLED(LOG_MODULE_GAINSPAN, LOG_LEVEL_DEBUG)){
+		usart_getStats(gainspan.usart_id, &stats);
+		usart_getLockStats(gainspan.usart_id, &lock_stats);
+		LOG_DEBUG(LOG_MODULE_GAINSPAN, LOG_USART_TRAFFIC, gainspan.usart_id, stats.rxBytes, stats.txBytes);
+		LOG_DEBUG(LOG_MODULE_GAINSPAN, LOG_USART_DROPS, gainspan.usart_id, stats.rxFrameErrors, stats.rxOverruns,
+				stats.rxParityErrors, stats.rxRingFull, stats.txRingFull);
+		LOG_DEBUG(LOG_MODULE_GAINSPAN, LOG_USART_LOAD, gainspan.usart_id, stats.rxHighWater, stats.txHighWater,
+				lock_stats.contentions, (uint16_t) lock_stats.maxWait);
+		LOG_DEBUG(LOG_MODULE_GAINSPAN, LOG_USART_FLOW, gainspan.usart_id, stats.rxRtsStops, stats.txCtsPauses,
+				stats.txPriorityMaxDelay);
+	}
 }
 
 
@@ -2189,7 +3084,7 @@ char int_to_hex(uint8_t character){
 		value = character + '0';
 	}
 	else if (character >= 10 && character <= 15) {
-		value = character + 'A' - 10;
+		value = character + 'a' - 10;
 	}
 
 	return value;
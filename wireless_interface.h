@@ -67,10 +67,11 @@
  *
  * Usage guide (For "Limited AP" or hot-spot mode):
  *
- * 		=> Set SET_GAINSPAN_TERMINAL_OUTPUT_ON to 1 in "gainspan_gs1011m.h" to get the command response/progress on
- * 			serial terminal.
- *
- * 		=> Set SET_WEB_SERVER_TERMINAL_OUTPUT_ON to 1 in "web_server.h" to get server logs on serial terminal.
+ * 		=> The progress and server logs are sent as tokenized log messages (see log_messages.h) on the telemetry
+ * 			port; decode them with tools/telemetry_decoder. Their level is set per module (LOG_MODULE_GAINSPAN,
+ * 			LOG_MODULE_WEB_SERVER) with logSetLevel, up to LOG_COMPILE_LEVEL (see logging.h); build with
+ * 			LOG_COMPILE_LEVEL=LOG_LEVEL_DEBUG and call logSetLevel(LOG_MODULE_GAINSPAN, LOG_LEVEL_DEBUG) to get
+ * 			every command and response.
  *
  * 		=> Initialize USART0 and USART2
  *
@@ -86,6 +87,22 @@
  *
  * 			Example: gs_set_wireless_ssid("WifiTeamX")
  *
+ * 		=> Optionally call gs_set_baud_rate(BAUD_RATE target_baud_rate) to switch the link with the module to a
+ * 			higher baud rate; the link falls back to the current baud rate on failure.
+ *
+ * 			Example: gs_set_baud_rate(BAUD_RATE_115200);
+ *
+ * 		=> At higher baud rates, wire the RTS/CTS lines of the module and set SET_GAINSPAN_FLOW_CONTROL_ON to 1, so
+ * 			that the module pauses instead of overflowing the MCU reception ring buffer while a task is busy;
+ * 			gs_activate_wireless_connection() then enables hardware flow control on both sides.
+ *
+ * 		=> Create the AT command engine task, gs_at_engine_task, at a priority below the control tasks. Once it
+ * 			runs, the commands (gs_execute_command, gs_submit_command) are exchanged with the module by this task,
+ * 			so the tasks waiting on the module sleep and the other tasks keep their schedule. Before the scheduler
+ * 			is started, or without the task, the commands are exchanged by the calling task.
+ *
+ * 			Example: xTaskCreate(gs_at_engine_task, (const portCHAR *)"", GS_AT_ENGINE_STACK_SIZE, NULL, 2, NULL);
+ *
  * 		=> Call gs_activate_wireless_connection(), to activate wireless network with configuration parameters
  *			defined in earlier step. Status will be returned defined by GAINSPAN_ACTIVE, which you can verify.
  *
@@ -145,6 +162,8 @@
 
 #include <avr/pgmspace.h>
 
+#include "task.h"							/*TaskHandle_t, notified on completion of an AT command request*/
+
 #include "usart_serial.h"					/*USART Serial communication*/
 
 /******************************************************************************************************************/
@@ -161,9 +180,27 @@
  * Note: Avoid initialized data definitions.
  */
 
-/*Send commands and respective command response to terminal*/
-#define SET_GAINSPAN_TERMINAL_OUTPUT_ON					1				/*!Default - 0; set to 1 to send the commands and respective response from Gainspan device to serial terminal define in Gainspan data structure gainspan.serial_terminal_usart_id*/
-#define SET_WEB_SERVER_TERMINAL_OUTPUT_ON				1				/*!Default - 0; set to 1 to send the commands and respective response from Gainspan device to serial terminal define in Gainspan data structure gainspan.serial_terminal_usart_id*/
+/*Hardware flow control (RTS/CTS) with Gainspan module, driven by GPIO pins (see usart_xsetFlowControl)*/
+#define SET_GAINSPAN_FLOW_CONTROL_ON					0				/*!<Default - 0; set to 1 once the RTS and CTS lines of the module are wired to the pins below*/
+#define GAINSPAN_RTS_PORT								(&PORTK)		/*!<Port of the MCU output driving the CTS input of the module (high - module stops sending)*/
+#define GAINSPAN_RTS_BIT								PK0				/*!<Default - PK0 (A8)*/
+#define GAINSPAN_CTS_PIN								(&PINK)			/*!<Input register of the MCU input driven by the RTS output of the module; pin change interrupt pin (port B, J or K)*/
+#define GAINSPAN_CTS_BIT								PK1				/*!<Default - PK1 (A9)*/
+
+/*End of a response of Gainspan module: the line is idle for this gap (see usart_xsetIdleGap)*/
+#define GAINSPAN_RESPONSE_IDLE_GAP_IN_CHARACTER_TIMES	40				/*!<Default - 40 character times (about 42 ms at 9600 baud); increase if responses are cut short*/
+
+/*AT command engine (see gs_at_engine_task)*/
+#define GS_AT_QUEUE_LENGTH								4				/*!<Requests waiting for the engine task; gs_submit_command fails when the queue is full*/
+#define GS_AT_ENGINE_STACK_SIZE							576				/*!<Stack of the engine task (bytes): response buffer, command buffer and log record*/
+#ifndef GS_AT_NOTIFY_INDEX
+#define GS_AT_NOTIFY_INDEX								2				/*!<Notification entry of a task waiting in gs_execute_command; entry 0 is left to the requests of gs_submit_command and USART_NOTIFY_INDEX to the USART waits*/
+#endif
+
+/*Bulk data transfer: ESC Z <CID> <4 digit length> <data> (see gs_write_bulk_to_socket)*/
+#define GAINSPAN_BULK_MAX_LENGTH						1400			/*!<Largest payload of a bulk data frame; longer data is sent in several frames*/
+#define SET_GAINSPAN_BULK_ACKNOWLEDGEMENT_ON			0				/*!<Default - 0, a frame completes once it is on the wire; set to 1 only for a module configured to answer each data frame with ESC O (accepted) or ESC F (failed), the activation does not enable these answers*/
+#define GAINSPAN_BULK_ACKNOWLEDGEMENT_TIMEOUT_IN_MILLISECONDS	1000	/*!<Maximum time to wait for the answer to a bulk data frame*/
 
 /*Serial2WiFi: AT commands*/
 
@@ -181,8 +218,8 @@
 #define AT_SET_WIRELESS_MODE							9				/*!<Set wireless mode: 0-Infrastructure, 1-Ad Hoc, 2-limited AP.*/
 #define AT_ASSOCIATE_START_NETWORK						10				/*!<Associate with a Network, or Start an Ad Hoc or Infrastructure (AP) Network. Parameters-SSID,BSSID,Ch,Rssi Flag.*/
 #define AT_DISASSOCIATE_CURRENT_NETWORK					11				/*!<Disassociate from current network.*/
-#define AT_GET_CURRENT_NETWORK_STATUS					12				/*!<Get current network status; returns-MAC, WLAN, Mode, BSSID, SSID, Channel, Security, RSSI, Network configuration, Rx count, Tx count. *Not implemented*/
-#define AT_GET_CURRENT_WIRELESS_NETWORK_STATUS			13				/*!<Get wireless network status; returns-Mode, BSSID, SSID, Channel, Security. *Not implemented*/
+#define AT_GET_CURRENT_NETWORK_STATUS					12				/*!<Get current network status; returns-MAC, WLAN, Mode, BSSID, SSID, Channel, Security, RSSI, Network configuration, Rx count, Tx count. Response read by gs_query_module_state*/
+#define AT_GET_CURRENT_WIRELESS_NETWORK_STATUS			13				/*!<Get wireless network status; returns-Mode, BSSID, SSID, Channel, Security. Response read by gs_query_module_state*/
 #define AT_GET_WIRELESS_RSSI							14				/*!<Get wireless RSSI in dBm. *Not implemented */
 #define AT_SET_TRANSMISSION_RATE						15				/*!<Set transmission rate: 0-Auto, 2-1 Mbps, 4-2 Mbps, 1-5.5 Mbps, 22-11 Mbps*/
 #define AT_GET_TRANSMISSION_RATE						16				/*!<Get transmission rate; returns: 0-Auto, 2-1 Mbps, 4-2 Mbps, 1-5.5 Mbps, 22-11 Mbps. *Not implemented*/
@@ -218,9 +255,14 @@
 /*Provisioning*/
 #define AT_START_WEB_PROVISIONING						44				/*!<Start support provisioning through web pages:user name , password ,[SSL Enabled,Param StoreOption,idletimeout,ncmautoconnect].  *Not implemented*/
 #define AT_STOP_WEB_PROVISIONING						45				/*!<Stop support provisioning through web pages.  *Not implemented*/
+/*Serial-to-WiFi profile configuration*/
+#define AT_ENABLE_HARDWARE_FLOW_CONTROL					46				/*!<Enable (1) hardware flow control (RTS/CTS) on the UART.*/
+/*Connection management configuration*/
+#define AT_CLOSE_ALL_CONNECTIONS						47				/*!<Close all the connections (server and clients), e.g. left open before a reset of the MCU.*/
 /*General identifiers*/
 #define TCP_RESPONSE									42				/*!<This is not a command, it is used to identify and send message to serial/terminal*/
 #define AT_COMMAND_INVALID								43				/*!<This is not a command, Identifier for Invalid command.*/
+#define AT_COMMAND_COUNT								48				/*!<Number of identifiers (highest + 1), entries of the command tables.*/
 
 /*Client ID*/
 #define INVALID_CID										255				/*!<Invalid CID.*/
@@ -384,6 +426,7 @@ typedef enum{
  *
  */
 typedef enum{
+	SOCKET_MODE_NONE											= 0,						/*!<Not a socket command, the response is OK or ERROR*/
 	SOCKET_MODE_ENABLE											= 1,						/*!<Socket mode enable*/
 	SOCKET_MODE_PROCESS											= 2 						/*!<Socket mode process*/
 } SOCKET_MODE;
@@ -542,6 +585,43 @@ typedef enum {
 } DEVICE_CONNECTION_STATUS;
 
 
+/*AT command request*/
+/*!
+ * \brief AT command request, for the AT command engine.
+ *
+ *
+ * \details Command submitted with gs_submit_command. The request belongs to the submitter and must stay valid until
+ * it completes: the engine task then sets command_result, calls callback (if not NULL, from the engine task) and
+ * notifies notify_task (if not NULL, on its entry notify_index, with xTaskNotifyGiveIndexed). With a line_callback, the lines of the response before
+ * the final result are handed to it one by one instead of being collected, for responses longer than the response
+ * buffer (e.g. status queries).
+ *
+ */
+typedef struct _GS_AT_REQUEST GS_AT_REQUEST;
+
+/*!
+ * \brief Completion callback of an AT command request, called by the engine task.
+ */
+typedef void (*GS_AT_CALLBACK)(GS_AT_REQUEST *request);
+
+/*!
+ * \brief Line callback of an AT command request, called by the engine task with each line (terminated) of the response.
+ */
+typedef void (*GS_AT_LINE_CALLBACK)(GS_AT_REQUEST *request, char *response_line);
+
+struct _GS_AT_REQUEST {
+	AT_COMMAND at_command;													/*!<Command, parameters are taken from the configuration of the module*/
+	uint16_t timeout_in_milliseconds;										/*!<Maximum time to wait for the response, 0 for the timeout of the command*/
+	SOCKET_MODE socket_mode;												/*!<SOCKET_MODE_NONE, or socket mode of a TCP command*/
+	COMMAND_OUTCOME command_result;											/*!<Outcome, set on completion*/
+	GS_AT_CALLBACK callback;												/*!<Called on completion, or NULL*/
+	GS_AT_LINE_CALLBACK line_callback;										/*!<Called with each line of the response before the final result, or NULL*/
+	TaskHandle_t notify_task;												/*!<Notified on completion, or NULL*/
+	UBaseType_t notify_index;												/*!<Notification entry of notify_task: 0 for gs_submit_command, GS_AT_NOTIFY_INDEX for gs_execute_request*/
+	void *context;															/*!<Free for the submitter*/
+};
+
+
 /*WiFi - wireless connection profile*/
 /*!
  * \brief Wireless connection profile.
@@ -622,6 +702,8 @@ void gs_initialize_module(USART_ID target_usart_id, BAUD_RATE target_baud_rate,
 
 void gs_set_usart(USART_ID target_usart_id, BAUD_RATE target_baud_rate, USART_ID target_serial_terminal_usart_id, BAUD_RATE target_serial_terminal_baud_rate);
 
+SUCCESS_ERROR gs_set_baud_rate(BAUD_RATE target_baud_rate);
+
 void gs_set_network_configuration(NETWORK_PROFILE target_network_profile);
 
 void gs_set_wireless_configuration(WIRELESS_PROFILE target_wireless_profile);
@@ -660,10 +742,20 @@ SUCCESS_ERROR gs_get_socket_connection_status(TCP_SOCKET socket);
 
 void gs_write_data_to_socket(TCP_SOCKET socket, char *data_string);
 
+SUCCESS_ERROR gs_write_bulk_to_socket(TCP_SOCKET socket, const uint8_t *data, uint16_t data_length);
+
 void gs_write_complete_to_socket(TCP_SOCKET socket);
 
 void gs_flush(void);
 
+/*AT command engine APIs*/
+
+void gs_at_engine_task(void *pvParameters);
+
+SUCCESS_ERROR gs_submit_command(GS_AT_REQUEST *request);
+
+COMMAND_OUTCOME gs_execute_command(AT_COMMAND at_command, SOCKET_MODE socket_mode);
+
 /*Web server APIs*/
 
 void configure_web_page(char *page_title, char *menu_title, HTML_ELEMENT_TYPE element_type);